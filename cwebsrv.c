@@ -3,23 +3,247 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
+#include <signal.h>
 
 #include "cws/cws_socket.h"
 #include "cws/cws_client_handler.h"
+#include "cws/cws_reactor.h"
+#include "cws/cws_pool.h"
+#include "cws/cws_uring.h"
+#include "cws/cws_router.h"
+#include "cws/cws_static.h"
+#include "cws/cws_conditional.h"
+#include "util/strfmt.h"
 #include "util/mman.h"
 
-int main(void)
+/*
+============================================================================
+                                   Routes                                   
+============================================================================
+*/
+
+/**
+ * @brief Greet by the name captured from the path
+ */
+static void route_hello(cws_client_t *client, cws_route_match_t *match, void *arg)
+{
+  strslice_t *name = cws_route_match_param(match, "name");
+  scptr char *body = strfmt_direct("Hello, %.*s! :)", (int) name->len, name->ptr);
+  cws_conditional_send_buf(client, NULL, body, strlen(body));
+}
+
+/**
+ * @brief Respond to any other request with a simple test response
+ */
+static void route_fallback(cws_client_t *client, cws_route_match_t *match, void *arg)
+{
+  cws_response_t response;
+  cws_response_init(&response);
+
+  // This header should be added
+  cws_response_add_header(&response, "X-Custom", "Hello, world! :)");
+
+  // This header should override the default
+  cws_response_add_header(&response, "Content-Type", "text/plain");
+
+  // This header should be skipped, as it frames the response
+  cws_response_add_header(&response, "Content-Length", "128");
+
+  cws_response_send(client, STATUS_OK, &response, "Thank you for your request! :)");
+}
+
+/**
+ * @brief Set up the routes all sockets serve
+ * 
+ * @param files Files to serve below /static/, NULL for none
+ * @return cws_router_t* Router or NULL on errors
+ */
+static cws_router_t *make_router(cws_static_t *files)
+{
+  scptr cws_router_t *router = cws_router_make();
+  scptr char *err = NULL;
+
+  // All routes are added at once, which copies the routing table only once
+  cws_route_def_t defs[3 + CWS_HTTP_NUM_METHODS];
+  size_t num_defs = 0;
+
+  defs[num_defs++] = (cws_route_def_t) { GET, "/hello/:name", { route_hello, NULL, NULL } };
+
+  if (files)
+  {
+    defs[num_defs++] = (cws_route_def_t) { GET, "/static/*path", { cws_static_handle, NULL, files } };
+    defs[num_defs++] = (cws_route_def_t) { HEAD, "/static/*path", { cws_static_handle, NULL, files } };
+  }
+
+  for (cws_http_method_t method = 0; method < CWS_HTTP_NUM_METHODS; method++)
+    defs[num_defs++] = (cws_route_def_t) { method, "/*path", { route_fallback, NULL, NULL } };
+
+  if (!cws_router_add_all(router, defs, num_defs, &err))
+  {
+    fprintf(stderr, "Could not add routes: %s\n", err);
+    return NULL;
+  }
+
+  return mman_ref(router);
+}
+
+/**
+ * @brief Serve using one SO_REUSEPORT listener per core, each with it's own
+ * pinned accept loop and single-loop reactor, so nothing is shared across cores
+ * 
+ * @param addr Address to listen on
+ * @param port Port to listen on
+ * @param router Routes to serve
+ * @return int Exit code
+ */
+static int serve_reuseport(in_addr_t addr, int port, cws_router_t *router)
 {
+  long num_cores = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t num_listeners = num_cores > 0 ? num_cores : 1;
+
+  scptr cws_socket_t **socks = (cws_socket_t **) mman_alloc(sizeof(cws_socket_t *), num_listeners, NULL);
+  scptr cws_reactor_t **reactors = (cws_reactor_t **) mman_alloc(sizeof(cws_reactor_t *), num_listeners, NULL);
+
+  // Create one listener and one reactor per core
+  for (size_t i = 0; i < num_listeners; i++)
+  {
+    socks[i] = cws_socket_create(addr, port, true);
+    if (!socks[i])
+    {
+      fprintf(stderr, "Could not create server socket #%lu (%d)!\n", i, errno);
+      return 1;
+    }
+
+    reactors[i] = cws_reactor_make(1, i);
+    if (!reactors[i])
+    {
+      fprintf(stderr, "Could not start reactor #%lu (%d)!\n", i, errno);
+      return 1;
+    }
+
+    cws_socket_pin(socks[i], i);
+    cws_socket_set_router(socks[i], router);
+    if (!cws_socket_listen(socks[i], SOMAXCONN, cws_reactor_handle_client, reactors[i]))
+    {
+      fprintf(stderr, "Could not go into listen mode on socket #%lu (%d)!\n", i, errno);
+      return 1;
+    }
+  }
+
+  // Inform about endpoint
+  printf("Listening for requests on ");
+  cws_print_addr_in(socks[0]->addr);
+  printf(" (reuseport, %lu listeners)!\n", num_listeners);
+
+  // Join listener threads
+  for (size_t i = 0; i < num_listeners; i++)
+  {
+    int err = pthread_join(socks[i]->thread, NULL);
+    if (err)
+    {
+      fprintf(stderr, "Could not join listener thread #%lu (%d)!\n", i, err);
+      return 1;
+    }
+
+    printf(
+      "Listener #%lu accepted %lu connections (%lu errors)!\n",
+      i, socks[i]->stats.accepted, socks[i]->stats.accept_errors
+    );
+  }
+
+  // Listener threads have been exited
+  printf("Done! Exiting...\n");
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  // Serving mode, either "threads" (one thread per client), "pool" (fixed set of
+  // work-stealing worker threads), "reactor" (epoll event loops), "reuseport"
+  // (one listener with it's own event loop per core) or "uring" (io_uring, falls
+  // back to "reactor" if unavailable)
+  const char *mode = argc > 1 ? argv[1] : "threads";
+
+  // Writing to a connection the peer closed should not terminate the server
+  signal(SIGPIPE, SIG_IGN);
+
+  // Files below the optional document root are served as static content
+  scptr cws_static_t *files = argc > 2 ? cws_static_make(argv[2]) : NULL;
+
+  // All modes serve the same routes
+  scptr cws_router_t *router = make_router(files);
+  if (!router) return 1;
+
+  // Shared-nothing mode manages it's own set of sockets
+  if (strcmp(mode, "reuseport") == 0)
+    return serve_reuseport(INADDR_ANY, 8192, router);
+
   // Try to create a server socket
-  scptr cws_socket_t *sock = cws_socket_create(INADDR_ANY, 8192);
+  scptr cws_socket_t *sock = cws_socket_create(INADDR_ANY, 8192, false);
   if (!sock)
   {
     fprintf(stderr, "Could not create server socket (%d)!\n", errno);
     return 1;
   }
+  cws_socket_set_router(sock, router);
+
+  // The ring accepts on it's own, only fall through if it's unavailable
+  if (strcmp(mode, "uring") == 0)
+  {
+    scptr cws_uring_t *uring = cws_uring_make(sock, SOMAXCONN);
+    if (uring)
+    {
+      printf("Listening for requests on ");
+      cws_print_addr_in(sock->addr);
+      printf(" (uring)!\n");
+
+      pthread_join(uring->thread, NULL);
+      printf("Done! Exiting...\n");
+      return 0;
+    }
+
+    fprintf(stderr, "Could not set up io_uring (%d), falling back to the reactor!\n", errno);
+    mode = "reactor";
+  }
+
+  // Select the client handler based on the serving mode
+  cws_client_handler_t handler = cws_handle_client;
+  void *handler_arg = NULL;
+  scptr cws_reactor_t *reactor = NULL;
+  scptr cws_pool_t *pool = NULL;
+  if (strcmp(mode, "reactor") == 0)
+  {
+    reactor = cws_reactor_make(0, -1);
+    if (!reactor)
+    {
+      fprintf(stderr, "Could not start the reactor (%d)!\n", errno);
+      return 1;
+    }
+
+    handler = cws_reactor_handle_client;
+    handler_arg = reactor;
+  }
+  else if (strcmp(mode, "pool") == 0)
+  {
+    pool = cws_pool_make(0);
+    if (!pool)
+    {
+      fprintf(stderr, "Could not start the worker pool (%d)!\n", errno);
+      return 1;
+    }
+
+    handler = cws_pool_handle_client;
+    handler_arg = pool;
+  }
+  else if (strcmp(mode, "threads") != 0)
+  {
+    fprintf(stderr, "Unknown serving mode \"%s\"!\n", mode);
+    return 1;
+  }
 
   // Listen for requests
-  if (!cws_socket_listen(sock, 16, cws_handle_client))
+  if (!cws_socket_listen(sock, SOMAXCONN, handler, handler_arg))
   {
     fprintf(stderr, "Could not go into listen mode (%d)!\n", errno);
     return 1;
@@ -28,7 +252,7 @@ int main(void)
   // Inform about endpoint
   printf("Listening for requests on ");
   cws_print_addr_in(sock->addr);
-  printf("!\n");
+  printf(" (%s)!\n", mode);
 
   // Join listener thread
   int err = pthread_join(sock->thread, NULL);
@@ -41,4 +265,4 @@ int main(void)
   // Listener thread has been exited
   printf("Done! Exiting...\n");
   return 0;
-}
\ No newline at end of file
+}
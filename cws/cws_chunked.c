@@ -0,0 +1,193 @@
+#include "cws/cws_chunked.h"
+#include "cws/cws_common.h"
+
+void cws_chunked_init(cws_chunked_t *decoder, size_t max_len)
+{
+  decoder->state = CWS_CK_SIZE;
+  decoder->chunk_remaining = 0;
+  decoder->line_len = 0;
+  decoder->decoded = 0;
+  decoder->max_len = max_len;
+}
+
+/**
+ * @brief Get the value of a hexadecimal digit
+ * 
+ * @return int Value of the digit, -1 if it's not a hexadecimal digit
+ */
+INLINED static int cws_chunked_hex(char c)
+{
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+/**
+ * @brief Check whether a character is allowed within a token, which names and
+ * unquoted values of extensions consist of
+ */
+INLINED static bool cws_chunked_tchar(char c)
+{
+  if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) return true;
+  return c != 0 && strchr("!#$%&'*+-.^_`|~", c) != NULL;
+}
+
+/**
+ * @brief Check whether a character is allowed within a quoted string or a
+ * trailer line, which is any visible character, whitespace or obs-text
+ */
+INLINED static bool cws_chunked_qchar(char c)
+{
+  unsigned char u = (unsigned char) c;
+  return u == '\t' || (u >= ' ' && u != 0x7F);
+}
+
+/**
+ * @brief Finish the size line, the last chunk is empty and followed by the trailers
+ */
+INLINED static void cws_chunked_size_done(cws_chunked_t *decoder)
+{
+  decoder->decoded += decoder->chunk_remaining;
+  decoder->line_len = 0;
+  decoder->state = decoder->chunk_remaining > 0 ? CWS_CK_DATA : CWS_CK_TRAILER;
+}
+
+cws_chunked_result_t cws_chunked_decode(
+  cws_chunked_t *decoder,
+  char *data, size_t data_len,
+  size_t *consumed, strslice_t *chunk,
+  char **error_msg
+)
+{
+  size_t offs = 0;
+
+  while (offs < data_len && decoder->state != CWS_CK_DONE)
+  {
+    // Chunk data is passed on in place, as much of it as has been received
+    if (decoder->state == CWS_CK_DATA)
+    {
+      size_t avail = data_len - offs;
+      size_t len = avail < decoder->chunk_remaining ? avail : decoder->chunk_remaining;
+      *chunk = strslice_make(&data[offs], len);
+      decoder->chunk_remaining -= len;
+      if (decoder->chunk_remaining == 0) decoder->state = CWS_CK_DATA_CR;
+
+      *consumed = offs + len;
+      return CWS_CHUNKED_DATA;
+    }
+
+    char c = data[offs++];
+    switch (decoder->state)
+    {
+      case CWS_CK_SIZE:
+      {
+        if (rp_exit(++decoder->line_len > CWS_CHUNKED_MAX_LINE, error_msg, "Chunk size line too long (max=%lu)!", CWS_CHUNKED_MAX_LINE))
+          return CWS_CHUNKED_TOO_LARGE;
+
+        int digit = cws_chunked_hex(c);
+        if (digit >= 0)
+        {
+          // The chunk has to fit into what's left of the body
+          size_t left = decoder->max_len - decoder->decoded;
+          if (rp_exit(
+            decoder->chunk_remaining > left / 16 || decoder->chunk_remaining * 16 + digit > left,
+            error_msg, "The request body is too large (max=%lu)!", decoder->max_len
+          )) return CWS_CHUNKED_TOO_LARGE;
+
+          decoder->chunk_remaining = decoder->chunk_remaining * 16 + digit;
+          break;
+        }
+
+        // At least one digit is required
+        if (rp_exit(decoder->line_len == 1, error_msg, "Chunk size missing!")) return CWS_CHUNKED_MALFORMED;
+
+        if (c == ';' || c == ' ' || c == '\t') decoder->state = CWS_CK_EXT;
+        else if (c == '\r') decoder->state = CWS_CK_SIZE_LF;
+        else
+        {
+          rp_exit(true, error_msg, "Malformed chunk size!");
+          return CWS_CHUNKED_MALFORMED;
+        }
+        break;
+      }
+
+      case CWS_CK_EXT:
+      case CWS_CK_EXT_QUOTED:
+      case CWS_CK_EXT_ESCAPE:
+        // Extensions are ignored, but have to consist of tokens and quoted strings
+        if (rp_exit(++decoder->line_len > CWS_CHUNKED_MAX_LINE, error_msg, "Chunk size line too long (max=%lu)!", CWS_CHUNKED_MAX_LINE))
+          return CWS_CHUNKED_TOO_LARGE;
+
+        if (decoder->state == CWS_CK_EXT_ESCAPE)
+        {
+          if (rp_exit(!cws_chunked_qchar(c), error_msg, "Malformed chunk extension!")) return CWS_CHUNKED_MALFORMED;
+          decoder->state = CWS_CK_EXT_QUOTED;
+        }
+        else if (decoder->state == CWS_CK_EXT_QUOTED)
+        {
+          if (rp_exit(!cws_chunked_qchar(c), error_msg, "Malformed chunk extension!")) return CWS_CHUNKED_MALFORMED;
+          if (c == '"') decoder->state = CWS_CK_EXT;
+          else if (c == '\\') decoder->state = CWS_CK_EXT_ESCAPE;
+        }
+        else if (c == '"') decoder->state = CWS_CK_EXT_QUOTED;
+        else if (c == '\r') decoder->state = CWS_CK_SIZE_LF;
+        else if (rp_exit(
+          !cws_chunked_tchar(c) && c != ';' && c != '=' && c != ' ' && c != '\t',
+          error_msg, "Malformed chunk extension!"
+        )) return CWS_CHUNKED_MALFORMED;
+        break;
+
+      case CWS_CK_SIZE_LF:
+        if (rp_exit(c != '\n', error_msg, "Malformed chunk size line!")) return CWS_CHUNKED_MALFORMED;
+        cws_chunked_size_done(decoder);
+        break;
+
+      case CWS_CK_DATA_CR:
+        if (rp_exit(c != '\r', error_msg, "Chunk data exceeds it's size!")) return CWS_CHUNKED_MALFORMED;
+        decoder->state = CWS_CK_DATA_LF;
+        break;
+
+      case CWS_CK_DATA_LF:
+        if (rp_exit(c != '\n', error_msg, "Chunk data exceeds it's size!")) return CWS_CHUNKED_MALFORMED;
+        decoder->state = CWS_CK_SIZE;
+        break;
+
+      case CWS_CK_TRAILER:
+        // Empty line terminates the body
+        if (c == '\r') decoder->state = CWS_CK_TRAILER_LF;
+        else if (rp_exit(!cws_chunked_qchar(c), error_msg, "Malformed trailer line!")) return CWS_CHUNKED_MALFORMED;
+        else
+        {
+          decoder->line_len++;
+          decoder->state = CWS_CK_TRAILER_LINE;
+        }
+        break;
+
+      case CWS_CK_TRAILER_LINE:
+        // Trailers are skipped, but limited in size
+        if (rp_exit(++decoder->line_len > CWS_CHUNKED_MAX_TRAILERS, error_msg, "Trailers too large (max=%lu)!", CWS_CHUNKED_MAX_TRAILERS))
+          return CWS_CHUNKED_TOO_LARGE;
+
+        if (c == '\r') decoder->state = CWS_CK_TRAILER_LINE_LF;
+        else if (rp_exit(!cws_chunked_qchar(c), error_msg, "Malformed trailer line!")) return CWS_CHUNKED_MALFORMED;
+        break;
+
+      case CWS_CK_TRAILER_LINE_LF:
+        if (rp_exit(c != '\n', error_msg, "Malformed trailer line!")) return CWS_CHUNKED_MALFORMED;
+        decoder->state = CWS_CK_TRAILER;
+        break;
+
+      case CWS_CK_TRAILER_LF:
+        if (rp_exit(c != '\n', error_msg, "Malformed end of chunked body!")) return CWS_CHUNKED_MALFORMED;
+        decoder->state = CWS_CK_DONE;
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  *consumed = offs;
+  return decoder->state == CWS_CK_DONE ? CWS_CHUNKED_DONE : CWS_CHUNKED_INCOMPLETE;
+}
@@ -1,4 +1,6 @@
 #include "cws/cws_client.h"
+#include "cws/cws_request.h"
+#include "cws/cws_router.h"
 
 /**
  * @brief Clean up a cws_client struct that is about to be destroyed
@@ -7,6 +9,18 @@ static void cws_client_cleanup(mman_meta_t *ref)
 {
   mman_dealloc(((cws_client_t *) ref->ptr)->address);
   mman_dealloc(((cws_client_t *) ref->ptr)->thread);
+  mman_dealloc(((cws_client_t *) ref->ptr)->head);
+  mman_dealloc(((cws_client_t *) ref->ptr)->body);
+  mman_dealloc(((cws_client_t *) ref->ptr)->rbuf);
+
+  // Drop output that never made it out
+  cws_client_t *client = (cws_client_t *) ref->ptr;
+  cws_client_out_drop(client->out_queue, client->out_count);
+  mman_dealloc(client->out_queue);
+
+  // Let go of the route's table, the router is only borrowed
+  if (client->route_match) cws_route_match_release(client->route_match);
+  mman_dealloc(client->route_match);
 }
 
 cws_client_t *cws_client_make()
@@ -18,5 +32,341 @@ cws_client_t *cws_client_make()
   client->address = (struct sockaddr_in *) mman_alloc(addr_size, 1, NULL);
   client->thread = (pthread_t *) mman_alloc(sizeof(pthread_t *), 1, NULL);
 
+  // Start out awaiting a request head
+  client->state = CWS_CS_HEAD;
+  client->head = NULL;
+  client->router = NULL;
+  client->route_match = NULL;
+  client->body_handler = NULL;
+  client->body_handler_arg = NULL;
+  client->body = NULL;
+  client->body_received = 0;
+  client->seg_data_remaining = 0;
+  client->body_chunked = false;
+  client->rbuf = NULL;
+  client->rbuf_len = 0;
+  client->rbuf_cap = 0;
+  client->out_queue = (cws_client_out_t *) mman_alloc(sizeof(cws_client_out_t), CWS_CLIENT_MAX_QUEUED, NULL);
+  client->out_count = 0;
+  client->out_cap = CWS_CLIENT_MAX_QUEUED;
+  client->corked = false;
+  client->deferred_flush = false;
+  client->nonblocking = false;
+  client->write_blocked = false;
+
+  // Connections persist unless the request opts out
+  client->num_requests = 0;
+  client->keep_alive = true;
+  client->last_active_ms = 0;
+  client->_idle_prev = NULL;
+  client->_idle_next = NULL;
+
   return mman_ref(client);
-}
\ No newline at end of file
+}
+
+void cws_client_reset_request(cws_client_t *client)
+{
+  // The head is kept around to be parsed into by the next request
+  if (client->head) cws_request_head_reset(client->head);
+  if (client->route_match) cws_route_match_release(client->route_match);
+  mman_dealloc(client->body);
+
+  client->state = CWS_CS_HEAD;
+  client->body_handler = NULL;
+  client->body_handler_arg = NULL;
+  client->body = NULL;
+  client->body_received = 0;
+  client->seg_data_remaining = 0;
+  client->body_chunked = false;
+}
+
+/*
+============================================================================
+                                Output queue                                
+============================================================================
+*/
+
+size_t cws_client_out_gather(cws_client_out_t *out, size_t count, struct iovec *iov, size_t max)
+{
+  size_t iovcnt = 0;
+  while (iovcnt < count && iovcnt < max && out[iovcnt].fd < 0)
+  {
+    iov[iovcnt] = out[iovcnt].iov;
+    iovcnt++;
+  }
+  return iovcnt;
+}
+
+/**
+ * @brief Release an entry once it has been written or dropped
+ */
+INLINED static void cws_client_out_release(cws_client_out_t *out)
+{
+  if (out->fd >= 0) close(out->fd);
+  scptr void *queue_ref = out->ref;
+}
+
+size_t cws_client_out_advance(cws_client_out_t *out, size_t count, size_t written)
+{
+  // Skip all entries that have been written completely
+  size_t done = 0;
+  while (done < count && written >= out[done].iov.iov_len)
+  {
+    written -= out[done].iov.iov_len;
+    cws_client_out_release(&out[done++]);
+  }
+
+  // Resume within a partially written entry
+  if (done < count && written > 0)
+  {
+    if (out[done].fd >= 0) out[done].offset += written;
+    else out[done].iov.iov_base += written;
+    out[done].iov.iov_len -= written;
+  }
+
+  return done;
+}
+
+void cws_client_out_drop(cws_client_out_t *out, size_t count)
+{
+  for (size_t i = 0; i < count; i++)
+    cws_client_out_release(&out[i]);
+}
+
+/**
+ * @brief Queue up a piece of output behind everything queued so far
+ * 
+ * @param client Recipient
+ * @param out Entry to queue, it's reference and descriptor are taken over
+ */
+static bool cws_client_enqueue(cws_client_t *client, cws_client_out_t out)
+{
+  // Make room by writing out what's been queued so far
+  if (
+    client->out_count >= CWS_CLIENT_MAX_QUEUED
+    && !client->deferred_flush
+    && !client->write_blocked
+    && !cws_client_flush(client)
+  )
+  {
+    cws_client_out_release(&out);
+    return false;
+  }
+
+  // Output the socket can't take right now, or which the I/O backend writes later, grows the queue
+  if (client->out_count == client->out_cap)
+  {
+    if (!mman_realloc((void **) &client->out_queue, sizeof(cws_client_out_t), client->out_cap * 2))
+    {
+      cws_client_out_release(&out);
+      return false;
+    }
+    client->out_cap *= 2;
+  }
+
+  client->out_queue[client->out_count++] = out;
+  return true;
+}
+
+/*
+============================================================================
+                                  Writing                                   
+============================================================================
+*/
+
+/**
+ * @brief Decide on a write which failed with errno set
+ * 
+ * @return ssize_t Zero if the non-blocking socket is full, negative otherwise
+ */
+static ssize_t cws_client_write_failed(cws_client_t *client)
+{
+  // Blocking sockets only fail like this once their send timeout expired
+  if ((errno != EAGAIN && errno != EWOULDBLOCK) || !client->nonblocking) return -1;
+
+  client->write_blocked = true;
+  return 0;
+}
+
+/**
+ * @brief Write as much of a vector as the socket takes
+ * 
+ * @return ssize_t Number of bytes written, zero if the non-blocking socket is full, negative on errors
+ */
+static ssize_t cws_client_sendmsg(cws_client_t *client, struct iovec *iov, size_t iovcnt)
+{
+  struct msghdr msg = { .msg_iov = iov, .msg_iovlen = iovcnt };
+
+  while (true)
+  {
+    ssize_t written = sendmsg(client->descriptor, &msg, MSG_NOSIGNAL);
+    if (written >= 0) return written;
+    if (errno != EINTR) return cws_client_write_failed(client);
+  }
+}
+
+/**
+ * @brief Send as much of a file's part as the socket takes
+ * 
+ * @return ssize_t Number of bytes sent, zero if the non-blocking socket is full, negative on
+ * errors or if the file has been truncated in the meantime
+ */
+static ssize_t cws_client_sendfile_part(cws_client_t *client, int fd, off_t offset, size_t len)
+{
+  while (true)
+  {
+    ssize_t sent = sendfile(client->descriptor, fd, &offset, len);
+    if (sent > 0) return sent;
+    if (sent == 0) return -1;
+    if (errno != EINTR) return cws_client_write_failed(client);
+  }
+}
+
+bool cws_client_writev(cws_client_t *client, struct iovec *iov, size_t iovcnt)
+{
+  size_t len = 0;
+  for (size_t i = 0; i < iovcnt; i++) len += iov[i].iov_len;
+
+  // Queued up output has to go out first, the I/O backend writes on it's own
+  while (len > 0 && client->out_count == 0 && !client->write_blocked && !client->deferred_flush)
+  {
+    ssize_t written = cws_client_sendmsg(client, iov, iovcnt);
+    if (written < 0) return false;
+    len -= written;
+
+    // Skip all buffers that have been written completely
+    while (iovcnt > 0 && (size_t) written >= iov->iov_len)
+    {
+      written -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+
+    // Resume within a partially written buffer
+    if (iovcnt > 0)
+    {
+      iov->iov_base += written;
+      iov->iov_len -= written;
+    }
+  }
+
+  if (len == 0) return true;
+
+  // The buffers are only borrowed, keep a copy of the rest until the socket drains
+  char *rest = mman_alloc(sizeof(char), len, NULL);
+  if (!rest) return false;
+
+  size_t offs = 0;
+  for (size_t i = 0; i < iovcnt; i++)
+  {
+    memcpy(&rest[offs], iov[i].iov_base, iov[i].iov_len);
+    offs += iov[i].iov_len;
+  }
+
+  return cws_client_enqueue(client, (cws_client_out_t) { { rest, len }, rest, -1, 0 });
+}
+
+bool cws_client_sendfile(cws_client_t *client, int fd, off_t offset, size_t len)
+{
+  // Whatever has been queued up goes out before the file
+  if (!cws_client_flush(client)) return false;
+
+  while (len > 0 && client->out_count == 0 && !client->deferred_flush)
+  {
+    ssize_t sent = cws_client_sendfile_part(client, fd, offset, len);
+    if (sent < 0) return false;
+    if (sent == 0) break;
+
+    offset += sent;
+    len -= sent;
+  }
+
+  if (len == 0) return true;
+
+  // The rest goes out later, from a descriptor of it's own, as the caller's may be closed by then
+  int own_fd = dup(fd);
+  if (own_fd < 0) return false;
+  return cws_client_enqueue(client, (cws_client_out_t) { { NULL, len }, NULL, own_fd, offset });
+}
+
+bool cws_client_flush(cws_client_t *client)
+{
+  // The I/O backend takes the queue over on it's own
+  if (client->deferred_flush) return true;
+
+  client->write_blocked = false;
+  size_t next = 0;
+  while (next < client->out_count && !client->write_blocked)
+  {
+    cws_client_out_t *out = &client->out_queue[next];
+    size_t count = client->out_count - next;
+    ssize_t written;
+
+    // Consecutive buffers are written at once, file parts on their own
+    if (out->fd >= 0) written = cws_client_sendfile_part(client, out->fd, out->offset, out->iov.iov_len);
+    else
+    {
+      struct iovec iov[CWS_CLIENT_MAX_QUEUED];
+      written = cws_client_sendmsg(client, iov, cws_client_out_gather(out, count, iov, CWS_CLIENT_MAX_QUEUED));
+    }
+
+    // Drop everything that's left, the connection is done
+    if (written < 0)
+    {
+      cws_client_out_drop(out, count);
+      client->out_count = 0;
+      client->write_blocked = false;
+      return false;
+    }
+
+    next += cws_client_out_advance(out, count, written);
+  }
+
+  // Keep what the socket couldn't take at the front
+  client->out_count -= next;
+  memmove(client->out_queue, &client->out_queue[next], sizeof(cws_client_out_t) * client->out_count);
+  return true;
+}
+
+/*
+============================================================================
+                                  Sending                                   
+============================================================================
+*/
+
+bool cws_client_sendv(cws_client_t *client, struct iovec *iov, size_t iovcnt)
+{
+  // Not batching, write right away
+  if (!client->corked) return cws_client_writev(client, iov, iovcnt);
+
+  for (size_t i = 0; i < iovcnt; i++)
+    if (!cws_client_enqueue(client, (cws_client_out_t) { iov[i], mman_ref(iov[i].iov_base), -1, 0 })) return false;
+
+  return true;
+}
+
+bool cws_client_send_view(cws_client_t *client, void *owner, char *buf, size_t len)
+{
+  struct iovec iov = { .iov_base = buf, .iov_len = len };
+
+  // Not batching, write right away
+  if (!client->corked) return cws_client_writev(client, &iov, 1);
+  return cws_client_enqueue(client, (cws_client_out_t) { iov, mman_ref(owner), -1, 0 });
+}
+
+bool cws_client_sendv_static(cws_client_t *client, struct iovec *iov, size_t iovcnt)
+{
+  // Not batching, write right away
+  if (!client->corked) return cws_client_writev(client, iov, iovcnt);
+
+  for (size_t i = 0; i < iovcnt; i++)
+    if (!cws_client_enqueue(client, (cws_client_out_t) { iov[i], NULL, -1, 0 })) return false;
+
+  return true;
+}
+
+bool cws_client_send(cws_client_t *client, char *buf, size_t len)
+{
+  struct iovec iov = { .iov_base = buf, .iov_len = len };
+  return cws_client_sendv(client, &iov, 1);
+}
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include "cws/cws_client_handler.h"
 
 static void cws_print_prefix(cws_client_t *client)
@@ -9,7 +10,7 @@ static void cws_print_prefix(cws_client_t *client)
 
 /**
  * @brief Calculate the remaining length of a request based on it's head and
- * the Content-Length header's value
+ * the Content-Length header's value, requests without this header carry no body
  * 
  * @param client Client for error-reporting
  * @param head Parsed head of request
@@ -17,99 +18,431 @@ static void cws_print_prefix(cws_client_t *client)
  */
 INLINED static long cws_remaining_len(cws_client_t *client, cws_request_head_t *head, char **err)
 {
-  char *content_length;
-  if (htable_fetch(head->headers, "Content-Length", (void **) &content_length) != HTABLE_SUCCESS)
+  strslice_t *content_length = cws_request_head_known(head, CWS_HDR_CONTENT_LENGTH);
+  if (!content_length) return 0;
+
+  unsigned long content_length_i = 0;
+  if (rp_exit(
+    !strslice_ulong(*content_length, &content_length_i) || content_length_i > LONG_MAX,
+    err, "Could not parse content-length as an integer!"
+  )) return 0;
+
+  return content_length_i;
+}
+
+/**
+ * @brief Decide whether or not the connection persists after responding to
+ * the request, based on the Connection header and the HTTP version's default
+ * 
+ * @param client Client that's being served
+ * @param head Parsed head of request
+ * @return true Connection is to be kept alive
+ * @return false Connection is to be closed
+ */
+INLINED static bool cws_keep_alive(cws_client_t *client, cws_request_head_t *head)
+{
+  // Enforce the maximum number of requests per connection
+  if (client->num_requests >= CWS_KEEPALIVE_MAX_REQUESTS) return false;
+
+  // HTTP/1.1 and above persist by default, HTTP/1.0 needs to opt in
+  bool persistent = head->http_ver_major > 1 || (head->http_ver_major == 1 && head->http_ver_minor >= 1);
+
+  // The Connection header overrides the default
+  strslice_t *connection = cws_request_head_known(head, CWS_HDR_CONNECTION);
+  if (connection)
   {
-    *err = "Error: Could not find content-length header!\n";
-    return 0;
+    if (strslice_has_token_ci(*connection, "close")) persistent = false;
+    else if (strslice_has_token_ci(*connection, "keep-alive")) persistent = true;
   }
 
-  long content_length_i = 0;
-  if (longp(&content_length_i, content_length, 10) != LONGP_SUCCESS)
+  return persistent;
+}
+
+/*
+============================================================================
+                                Request body                                
+============================================================================
+*/
+
+/**
+ * @brief Body handler appending all chunks to the client's body buffer
+ */
+static bool cws_body_buffer(cws_client_t *client, char *chunk, size_t chunk_len, void *arg)
+{
+  return !errif_resp(
+    client, bytebuf_append(client->body, chunk, chunk_len) != BYTEBUF_SUCCESS,
+    STATUS_PAYLOAD_TOO_LARGE, "The request body is too large!"
+  );
+}
+
+void cws_client_stream_body(cws_client_t *client, cws_body_handler_t handler, void *arg)
+{
+  client->body_handler = handler;
+  client->body_handler_arg = arg;
+}
+
+void cws_client_buffer_body(cws_client_t *client, size_t max_len)
+{
+  size_t cap = max_len < CWS_HANDLER_BODY_MINCAP ? max_len : CWS_HANDLER_BODY_MINCAP;
+
+  // Opting in twice starts over with an empty buffer
+  mman_dealloc(client->body);
+  client->body = bytebuf_make(cap, max_len);
+  cws_client_stream_body(client, cws_body_buffer, NULL);
+}
+
+/*
+============================================================================
+                                  Routing                                   
+============================================================================
+*/
+
+/**
+ * @brief Match the request's path against the client's routes and let the
+ * matched route decide on how to receive the body
+ * 
+ * @param client Client that's being served
+ */
+static void cws_client_route(cws_client_t *client)
+{
+  // The match is reused for every request on this connection
+  if (!client->route_match)
+    client->route_match = (cws_route_match_t *) mman_alloc(sizeof(cws_route_match_t), 1, NULL);
+
+  // Without any routes, nothing is found
+  cws_route_match_t *match = client->route_match;
+  if (!client->router)
   {
-    *err = "Error: Could not parse content-length as an integer!\n";
-    return 0;
+    *match = (cws_route_match_t) { .route = NULL, .path_found = false };
+    return;
   }
 
-  long body_part_len = head->body_part ? strlen(head->body_part) : 0;
-  return content_length_i - body_part_len;
+  cws_router_match(client->router, client->head->method, client->head->uri.path, match);
+
+  if (match->route && match->route->head_handler)
+    match->route->head_handler(client, match, match->route->arg);
 }
 
-static void cws_serve_client(void *arg)
+/**
+ * @brief Respond to a request none of the routes matched
+ * 
+ * @param client Client that's being served
+ * @param match Unsuccessful match of the request
+ */
+static void cws_client_respond_unrouted(cws_client_t *client, cws_route_match_t *match)
+{
+  if (!match->path_found)
+  {
+    cws_response_send_canned(client, STATUS_NOT_FOUND);
+    return;
+  }
+
+  // List the methods the path would have been routed for
+  scptr char *allow = mman_alloc(sizeof(char), 64, NULL);
+  size_t allow_offs = 0;
+  for (cws_http_method_t method = 0; method < CWS_HTTP_NUM_METHODS; method++)
+  {
+    if (!(match->allowed_methods & (1U << method))) continue;
+    strfmt(&allow, &allow_offs, "%s%s", allow_offs == 0 ? "" : ", ", cws_http_method_stringify(method));
+  }
+
+  cws_response_t response;
+  cws_response_init(&response);
+  cws_response_add_header(&response, "Allow", allow);
+  cws_response_send(client, STATUS_METHOD_NOT_ALLOWED, &response, "The requested method is not allowed!");
+}
+
+/*
+============================================================================
+                                Serving stages                              
+============================================================================
+*/
+
+static cws_client_state_t cs_head(cws_client_t *client, char *data, size_t data_len, size_t *consumed)
+{
+  // The head is parsed in place and reused for all requests on this connection
+  if (!client->head) client->head = cws_request_head_make();
+
+  // Continue parsing where the last segment left off, the head's slices point into the receive buffer
+  scptr char *err = NULL;
+  size_t head_len = 0;
+  cws_head_parse_result_t res = cws_request_head_feed(
+    client->head, data, data_len, CWS_HANDLER_HEAD_MAXLEN, &head_len, &err
+  );
+
+  // Wait until the head is complete
+  if (res == CWS_HEAD_INCOMPLETE) return CWS_CS_HEAD;
+  if (errif_resp(client, res == CWS_HEAD_TOO_LARGE, STATUS_REQUEST_HEADER_FIELDS_TOO_LARGE, err)) return CWS_CS_CLOSE;
+  if (errif_resp(client, res == CWS_HEAD_MALFORMED, STATUS_BAD_REQUEST, err)) return CWS_CS_CLOSE;
+  *consumed = head_len;
+
+  // Decide on persistence before responding
+  client->num_requests++;
+  client->keep_alive = cws_keep_alive(client, client->head);
+
+  // Chunked bodies are decoded until their last chunk, which takes precedence over Content-Length
+  strslice_t *transfer_encoding = cws_request_head_known(client->head, CWS_HDR_TRANSFER_ENCODING);
+  if (transfer_encoding)
+  {
+    if (errif_resp(
+      client, !strslice_eq_ci(*transfer_encoding, "chunked"),
+      STATUS_NOT_IMPLEMENTED, "Unsupported transfer encoding!"
+    )) return CWS_CS_CLOSE;
+
+    // A request carrying both might be framed differently by intermediaries, don't reuse the connection
+    if (cws_request_head_known(client->head, CWS_HDR_CONTENT_LENGTH)) client->keep_alive = false;
+
+    client->body_chunked = true;
+    cws_chunked_init(&client->chunked, CWS_HANDLER_CHUNKED_MAXLEN);
+    cws_client_route(client);
+    return CWS_CS_BODY;
+  }
+
+  // Calculate remaining length
+  client->seg_data_remaining = cws_remaining_len(client, client->head, &err);
+  if (errif_resp(client, err, STATUS_BAD_REQUEST, err)) return CWS_CS_CLOSE;
+  cws_client_route(client);
+
+  // Await the body only if there is one
+  return client->seg_data_remaining > 0 ? CWS_CS_BODY : CWS_CS_RESPOND;
+}
+
+/**
+ * @brief Decode the next piece of a chunked body and hand it to the body's handler
+ */
+static cws_client_state_t cs_body_chunked(cws_client_t *client, char *data, size_t data_len, size_t *consumed)
+{
+  scptr char *err = NULL;
+  strslice_t chunk;
+  cws_chunked_result_t res = cws_chunked_decode(&client->chunked, data, data_len, consumed, &chunk, &err);
+
+  if (errif_resp(client, res == CWS_CHUNKED_MALFORMED, STATUS_BAD_REQUEST, err)) return CWS_CS_CLOSE;
+  if (errif_resp(client, res == CWS_CHUNKED_TOO_LARGE, STATUS_PAYLOAD_TOO_LARGE, err)) return CWS_CS_CLOSE;
+  if (res == CWS_CHUNKED_DONE) return CWS_CS_RESPOND;
+  if (res == CWS_CHUNKED_INCOMPLETE) return CWS_CS_BODY;
+
+  // Decoded data is passed on in place
+  if (client->body_handler && !client->body_handler(client, chunk.ptr, chunk.len, client->body_handler_arg))
+    return CWS_CS_CLOSE;
+
+  client->body_received += chunk.len;
+  return CWS_CS_BODY;
+}
+
+static cws_client_state_t cs_body(cws_client_t *client, char *data, size_t data_len, size_t *consumed)
+{
+  if (client->body_chunked) return cs_body_chunked(client, data, data_len, consumed);
+
+  // Only take what belongs to this request, the rest is the next request
+  size_t body_len = data_len;
+  if (body_len > (size_t) client->seg_data_remaining) body_len = client->seg_data_remaining;
+
+  // Hand the chunk to the body's handler right away
+  *consumed = body_len;
+  if (client->body_handler && !client->body_handler(client, data, body_len, client->body_handler_arg))
+    return CWS_CS_CLOSE;
+
+  // Decrement remaining segment data by what just has been read
+  client->body_received += body_len;
+  client->seg_data_remaining -= body_len;
+  return client->seg_data_remaining > 0 ? CWS_CS_BODY : CWS_CS_RESPOND;
+}
+
+static cws_client_state_t cs_respond(cws_client_t *client, char *data, size_t data_len, size_t *consumed)
 {
-  // Begin serve by logging
-  scptr cws_client_t *client = (cws_client_t *) arg;
   cws_print_prefix(client);
-  printf("Now serving request in another thread!\n");
+  printf("Done parsing request message (%lu bytes)!\n", client->body_received);
+  cws_request_head_print(client->head);
 
-  // Read buffer management
-  scptr char *message_seg = mman_alloc(sizeof(char), CWS_HANDLER_SEGLEN, NULL);
-  scptr char *message = mman_alloc(sizeof(char), CWS_HANDLER_SEGLEN, NULL);
-  size_t message_offs = 0, read_size = 0;
+  // Hand the request to it's route
+  cws_route_match_t *match = client->route_match;
+  if (match->route) match->route->handler(client, match, match->route->arg);
+  else cws_client_respond_unrouted(client, match);
 
-  // Read all segments
-  scptr cws_request_head_t *head;
-  long seg_data_remaining = 1;
-  bool first_seg = true;
-  while (
-    seg_data_remaining > 0 // There is still data to be read
-    && (read_size = recv(client->descriptor, message_seg, CWS_HANDLER_SEGLEN, 0)) > 0) // And the connection is still available
+  cws_print_prefix(client) ;
+  printf("Responded!\n");
+
+  // Await the next request on persistent connections
+  if (!client->keep_alive) return CWS_CS_CLOSE;
+  cws_client_reset_request(client);
+  return CWS_CS_HEAD;
+}
+
+/*
+============================================================================
+                                Serving chain                               
+============================================================================
+*/
+
+// Register stages by the state they're serving here
+static cws_client_stage_t cws_client_stages[] = {
+  [CWS_CS_HEAD] = cs_head,
+  [CWS_CS_BODY] = cs_body,
+  [CWS_CS_RESPOND] = cs_respond
+};
+
+/**
+ * @brief Run the state machine on the client's receive buffer until no
+ * more progress can be made, then drop the processed data
+ */
+static void cws_client_advance(cws_client_t *client)
+{
+  // Skip the head of a request that's still awaiting it's body
+  size_t offs = client->state == CWS_CS_BODY ? client->head->raw.len : 0;
+
+  // Requests are left buffered while responses back up on a full socket
+  while (client->state != CWS_CS_CLOSE && !client->write_blocked)
   {
-    if (first_seg)
+    cws_client_state_t prev_state = client->state;
+    size_t consumed = 0;
+
+    client->state = cws_client_stages[client->state](
+      client,
+      &client->rbuf[offs],
+      client->rbuf_len - offs,
+      &consumed
+    );
+    offs += consumed;
+
+    // Stuck until more data arrives
+    if (client->state == prev_state && consumed == 0) break;
+
+    // The body stage needs data to make progress
+    if (client->state == CWS_CS_BODY && offs == client->rbuf_len) break;
+  }
+
+  // A request which awaits it's body keeps it's head at the front, as the
+  // parsed head's slices still point into it
+  size_t keep_len = 0;
+  if (client->state == CWS_CS_BODY)
+  {
+    cws_request_head_t *head = client->head;
+    keep_len = head->raw.len;
+    if (head->raw.ptr != client->rbuf)
     {
-      // Parse head
-      scptr char *err;
-      head = cws_request_head_parse(message_seg, &err);
-      if (errif_resp(client, err, STATUS_BAD_REQUEST, err)) break;
-
-      // Calculate remaining length
-      seg_data_remaining = cws_remaining_len(client, head, &err);
-      if (errif_resp(client, err, STATUS_BAD_REQUEST, err)) break;
-      
-      // Copy head into message buffer
-      if (errif_resp(
-        client,
-        !strfmt(&message, &message_offs, "%s", head->body_part),
-        STATUS_INTERNAL_SERVER_ERROR, "Could not allocate space for the head!"
-      )) break;
-
-      // First segment completed
-      first_seg = false;
-      continue;
+      memmove(client->rbuf, head->raw.ptr, keep_len);
+      cws_request_head_rebase(head, client->rbuf);
     }
+  }
 
-    // Concat segment into message
-    if (errif_resp(
-      client,
-      !strfmt(&message, &message_offs, "%s", message_seg),
-      STATUS_INTERNAL_SERVER_ERROR, "Could not allocate space for a segment!"
-    )) break;
-
-    // Decrement remaining segment data by what just has been read
-    // Clear segment buffer and advance to next segment
-    seg_data_remaining -= read_size;
-    memset(message_seg, 0, CWS_HANDLER_SEGLEN);
+  // Move the unprocessed rest behind it
+  client->rbuf_len -= offs;
+  memmove(&client->rbuf[keep_len], &client->rbuf[offs], client->rbuf_len);
+  client->rbuf_len += keep_len;
+  client->rbuf[client->rbuf_len] = 0;
+}
+
+/**
+ * @brief Double the capacity of the receive buffer, up to what's needed to fit
+ * the largest possible head followed by a segment
+ * 
+ * @return true Buffer has been grown
+ * @return false Buffer is already at it's maximum capacity
+ */
+static bool cws_client_grow_rbuf(cws_client_t *client)
+{
+  size_t max_cap = CWS_HANDLER_HEAD_MAXLEN + CWS_HANDLER_SEGLEN;
+  if (client->rbuf_cap >= max_cap) return false;
+
+  size_t new_cap = client->rbuf_cap * 2;
+  if (new_cap > max_cap) new_cap = max_cap;
+
+  // The head's slices are rebased on the next feed or rebase
+  char *old_rbuf = client->rbuf;
+  if (!mman_realloc((void **) &client->rbuf, sizeof(char), new_cap + 1)) return false;
+  client->rbuf_cap = new_cap;
+
+  // A head that's awaiting it's body isn't fed again
+  if (client->state == CWS_CS_BODY && client->rbuf != old_rbuf)
+    cws_request_head_rebase(client->head, client->rbuf);
+
+  return true;
+}
+
+cws_client_state_t cws_client_process(cws_client_t *client, char *seg, size_t seg_len)
+{
+  // Set up the receive buffer on first use
+  if (!client->rbuf)
+  {
+    client->rbuf = mman_alloc(sizeof(char), CWS_HANDLER_SEGLEN + 1, NULL);
+    client->rbuf_cap = CWS_HANDLER_SEGLEN;
+    client->rbuf_len = 0;
   }
 
-  // Terminate final message
-  message[++message_offs] = 0;
+  // Batch up all responses to this segment
+  client->corked = true;
 
-  cws_print_prefix(client);
-  printf("Done parsing request message (%lu bytes)!\n", strlen(message));
-  cws_request_head_print(head);
+  while (seg_len > 0 && client->state != CWS_CS_CLOSE)
+  {
+    // Make room for heads that exceed the buffer
+    if (client->rbuf_len == client->rbuf_cap && !cws_client_grow_rbuf(client))
+    {
+      client->state = CWS_CS_CLOSE;
+      break;
+    }
 
-  // Respond with this simple test response
-  scptr htable_t *headers = htable_make(3, 16, mman_dealloc);
+    // Append as much as fits into the receive buffer
+    size_t space = client->rbuf_cap - client->rbuf_len;
+    size_t chunk_len = seg_len < space ? seg_len : space;
+    memcpy(&client->rbuf[client->rbuf_len], seg, chunk_len);
+    client->rbuf_len += chunk_len;
+    client->rbuf[client->rbuf_len] = 0;
+    seg += chunk_len;
+    seg_len -= chunk_len;
 
-  // This header should be added
-  htable_insert(headers, "X-Custom", strfmt_direct("Hello, world! :)"));
+    cws_client_advance(client);
+  }
 
-  // This header should be skipped, as it's a required auto-gen header
-  htable_insert(headers, "Content-Type", strfmt_direct("128"));
+  // Write all responses at once, unless the I/O backend takes care of that
+  if (client->deferred_flush) return client->state;
+  client->corked = false;
+  if (!cws_client_flush(client)) client->state = CWS_CS_CLOSE;
+  return client->state;
+}
 
-  cws_response_send(client, STATUS_OK, headers, "Thank you for your request! :)");
-  cws_print_prefix(client) ;
-  printf("Responded!\n");
+cws_client_state_t cws_client_resume(cws_client_t *client)
+{
+  // Still waiting for the socket to drain
+  if (!cws_client_flush(client)) client->state = CWS_CS_CLOSE;
+  if (client->write_blocked || client->state == CWS_CS_CLOSE || !client->rbuf) return client->state;
+
+  // Serve the requests which have been received in the meantime
+  client->corked = true;
+  cws_client_advance(client);
+  client->corked = false;
+  if (!cws_client_flush(client)) client->state = CWS_CS_CLOSE;
+  return client->state;
+}
+
+void cws_serve_client(cws_client_t *client)
+{
+  // Begin serve by logging
+  cws_print_prefix(client);
+  printf("Now serving request!\n");
+
+  // Idle connections time out by a failing read
+  struct timeval timeout = {
+    .tv_sec = CWS_KEEPALIVE_TIMEOUT_MS / 1000,
+    .tv_usec = (CWS_KEEPALIVE_TIMEOUT_MS % 1000) * 1000
+  };
+  setsockopt(client->descriptor, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  // Stalled peers time out by a failing write
+  struct timeval send_timeout = {
+    .tv_sec = CWS_CLIENT_SEND_TIMEOUT_MS / 1000,
+    .tv_usec = (CWS_CLIENT_SEND_TIMEOUT_MS % 1000) * 1000
+  };
+  setsockopt(client->descriptor, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+
+  // Read segments and feed them into the state machine until it's done
+  scptr char *message_seg = mman_alloc(sizeof(char), CWS_HANDLER_SEGLEN, NULL);
+  ssize_t read_size = 0;
+  while (
+    client->state != CWS_CS_CLOSE // There is still data to be read
+    && (read_size = recv(client->descriptor, message_seg, CWS_HANDLER_SEGLEN, 0)) > 0) // And the connection is still available
+  {
+    cws_client_process(client, message_seg, read_size);
+  }
 
   // Close the connection
   close(client->descriptor);
@@ -120,7 +453,28 @@ static void cws_serve_client(void *arg)
   mman_print_info();
 }
 
-void cws_handle_client(cws_client_t *client)
+/**
+ * @brief Thread function serving a client, releases the passed reference
+ * 
+ * @param arg Client structure pointer
+ */
+static void *cws_serve_client_thread(void *arg)
+{
+  scptr cws_client_t *client = (cws_client_t *) arg;
+  cws_serve_client(client);
+  return NULL;
+}
+
+void cws_handle_client(cws_client_t *client, void *arg)
 {
-  pthread_create(client->thread, NULL, (void *) cws_serve_client, mman_ref(client));
-}
\ No newline at end of file
+  // Threads are never joined, detach them so they're cleaned up on exit
+  if (pthread_create(client->thread, NULL, cws_serve_client_thread, mman_ref(client)) == 0)
+  {
+    pthread_detach(*client->thread);
+    return;
+  }
+
+  // Could not create thread, release the thread's reference again
+  close(client->descriptor);
+  scptr cws_client_t *thread_ref = client;
+}
@@ -0,0 +1,81 @@
+#include "cws/cws_clock.h"
+
+// Monotonic time of the last tick in milliseconds
+static long cws_clock_ms = 0;
+
+// Formatted Date lines, one per second and reused round robin, each with
+// room for the terminator strftime writes
+static char cws_clock_date_lines[CWS_CLOCK_DATE_SLOTS][CWS_CLOCK_DATE_LINE_LEN + 1];
+
+// Date line of the current second
+static const char *cws_clock_date = NULL;
+
+// Starts the ticker on first use
+static pthread_once_t cws_clock_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Advance the clock, the Date line is only formatted if the second changed
+ * 
+ * @param last_sec Second the Date line has last been formatted for
+ */
+static void cws_clock_tick(time_t *last_sec)
+{
+  struct timespec mono, real;
+  clock_gettime(CLOCK_MONOTONIC, &mono);
+  clock_gettime(CLOCK_REALTIME, &real);
+
+  __atomic_store_n(&cws_clock_ms, mono.tv_sec * 1000L + mono.tv_nsec / 1000000L, __ATOMIC_RELEASE);
+  if (real.tv_sec == *last_sec) return;
+
+  // Format into the slot of this second, which nobody has read for a while
+  struct tm tm;
+  char *line = cws_clock_date_lines[real.tv_sec % CWS_CLOCK_DATE_SLOTS];
+  gmtime_r(&real.tv_sec, &tm);
+  strftime(line, CWS_CLOCK_DATE_LINE_LEN + 1, "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+
+  __atomic_store_n(&cws_clock_date, line, __ATOMIC_RELEASE);
+  *last_sec = real.tv_sec;
+}
+
+/**
+ * @brief Ticker thread function, advancing the clock forever
+ */
+static void *cws_clock_loop(void *arg)
+{
+  time_t last_sec = *((time_t *) arg);
+  struct timespec tick = { .tv_sec = 0, .tv_nsec = CWS_CLOCK_TICK_MS * 1000000L };
+
+  while (true)
+  {
+    nanosleep(&tick, NULL);
+    cws_clock_tick(&last_sec);
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Set the clock and start ticking
+ */
+static void cws_clock_start()
+{
+  // The clock is valid before the first reader returns
+  static time_t last_sec = 0;
+  cws_clock_tick(&last_sec);
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, cws_clock_loop, &last_sec) == 0)
+    pthread_detach(thread);
+}
+
+long cws_clock_now_ms()
+{
+  pthread_once(&cws_clock_once, cws_clock_start);
+  return __atomic_load_n(&cws_clock_ms, __ATOMIC_ACQUIRE);
+}
+
+const char *cws_clock_date_line()
+{
+  pthread_once(&cws_clock_once, cws_clock_start);
+  return __atomic_load_n(&cws_clock_date, __ATOMIC_ACQUIRE);
+}
@@ -1,4 +1,6 @@
+#define _GNU_SOURCE
 #include "cws/cws_common.h"
+#include <sched.h>
 
 void cws_print_addr_in(struct sockaddr_in addr)
 {
@@ -14,6 +16,18 @@ void cws_print_addr_in(struct sockaddr_in addr)
   printf(":%" PRIu16, htons(addr.sin_port));
 }
 
+bool cws_pin_thread(pthread_t thread, int cpu)
+{
+  // Wrap around the available cores
+  long num_cores = sysconf(_SC_NPROCESSORS_ONLN);
+  if (num_cores > 0) cpu %= num_cores;
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+}
+
 bool rp_exit(bool exit, char **error_msg, const char *error_fmt, ...)
 {
   if (!exit | !error_msg) return false;
@@ -72,6 +86,16 @@ bool errif_resp(
   // Error did not occur
   if (!error_cond) return false;
 
+  // The request's framing is unknown after an error, don't reuse the connection
+  client->keep_alive = false;
+
+  // Common errors are answered with a pre-serialized response, so floods of
+  // bad requests are as cheap to answer as possible, the rest of the request
+  // isn't drained, as the connection is closed anyway
+  if (cws_response_send_canned(client, code)) return true;
+
+  cws_discard_request(client);
+
   // Set up response body buffer
   scptr char *body = mman_alloc(sizeof(char), 128, NULL);
   size_t body_offs = 0;
@@ -82,8 +106,7 @@ bool errif_resp(
   strfmt(&body, &body_offs, "\"message\": \"%s\"," CRLF, message);
   strfmt(&body, &body_offs, "}");
 
-  // Send response to the client after discarding their message
-  cws_discard_request(client);
+  // Send response to the client
   cws_response_send(client, code, NULL, body);
   return true;
 }
\ No newline at end of file
@@ -0,0 +1,164 @@
+#include "cws/cws_conditional.h"
+
+/*
+============================================================================
+                                 Validators                                 
+============================================================================
+*/
+
+static const char *cws_http_months[] = {
+  "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+  "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+size_t cws_etag_body(const char *body, size_t body_len, bool weak, char *etag)
+{
+  // FNV-1a, the length is part of the tag as well
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < body_len; i++)
+  {
+    hash ^= (unsigned char) body[i];
+    hash *= 0x100000001b3ULL;
+  }
+
+  return snprintf(
+    etag, CWS_ETAG_MAXLEN, "%s\"%zx-%016" PRIx64 "\"",
+    weak ? "W/" : "", body_len, hash
+  );
+}
+
+size_t cws_etag_file(struct stat *st, char *etag)
+{
+  uint64_t mtime_ns = (uint64_t) st->st_mtim.tv_sec * 1000000000ULL + st->st_mtim.tv_nsec;
+  return snprintf(
+    etag, CWS_ETAG_MAXLEN, "\"%" PRIx64 "-%" PRIx64 "-%" PRIx64 "\"",
+    (uint64_t) st->st_ino, (uint64_t) st->st_size, mtime_ns
+  );
+}
+
+/**
+ * @brief Strip the weakness prefix off of an entity tag
+ */
+static strslice_t cws_etag_opaque(strslice_t etag)
+{
+  if (etag.len >= 2 && etag.ptr[0] == 'W' && etag.ptr[1] == '/')
+    return strslice_make(&etag.ptr[2], etag.len - 2);
+  return etag;
+}
+
+bool cws_etag_listed(strslice_t list, strslice_t etag)
+{
+  strslice_t opaque = cws_etag_opaque(etag);
+
+  size_t i = 0;
+  while (i < list.len)
+  {
+    // Skip separators and whitespace
+    while (i < list.len && (list.ptr[i] == ',' || list.ptr[i] == ' ' || list.ptr[i] == '\t')) i++;
+
+    size_t start = i;
+    while (i < list.len && list.ptr[i] != ',' && list.ptr[i] != ' ' && list.ptr[i] != '\t') i++;
+    if (i == start) break;
+
+    strslice_t listed = strslice_make(&list.ptr[start], i - start);
+    if (listed.len == 1 && *listed.ptr == '*') return true;
+
+    listed = cws_etag_opaque(listed);
+    if (listed.len == opaque.len && memcmp(listed.ptr, opaque.ptr, opaque.len) == 0) return true;
+  }
+
+  return false;
+}
+
+void cws_http_date_format(time_t time, char *date)
+{
+  struct tm tm;
+  gmtime_r(&time, &tm);
+  strftime(date, CWS_HTTP_DATE_LEN, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+bool cws_http_date_parse(strslice_t date, time_t *time)
+{
+  if (date.len != CWS_HTTP_DATE_LEN - 1) return false;
+
+  char buf[CWS_HTTP_DATE_LEN];
+  memcpy(buf, date.ptr, date.len);
+  buf[date.len] = 0;
+
+  struct tm tm = { 0 };
+  char month[4];
+  int consumed = 0;
+  if (
+    sscanf(
+      buf, "%*3s, %2d %3s %4d %2d:%2d:%2d GMT%n",
+      &tm.tm_mday, month, &tm.tm_year, &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &consumed
+    ) != 6
+    || consumed != (int) date.len
+  ) return false;
+
+  tm.tm_mon = -1;
+  for (int i = 0; i < 12; i++)
+    if (strcmp(month, cws_http_months[i]) == 0) tm.tm_mon = i;
+  if (tm.tm_mon < 0) return false;
+
+  tm.tm_year -= 1900;
+  *time = timegm(&tm);
+  return *time >= 0;
+}
+
+/*
+============================================================================
+                            Conditional requests                            
+============================================================================
+*/
+
+bool cws_conditional_not_modified(cws_request_head_t *head, strslice_t etag, time_t last_modified)
+{
+  // Other methods would have to fail with 412 instead
+  if (head->method != GET && head->method != HEAD) return false;
+
+  strslice_t *none_match = cws_request_head_known(head, CWS_HDR_IF_NONE_MATCH);
+  if (none_match) return etag.len > 0 && cws_etag_listed(*none_match, etag);
+
+  strslice_t *modified_since = cws_request_head_known(head, CWS_HDR_IF_MODIFIED_SINCE);
+  time_t since;
+  return (
+    modified_since
+    && last_modified >= 0
+    && cws_http_date_parse(*modified_since, &since)
+    && last_modified <= since
+  );
+}
+
+bool cws_conditional_respond(
+  cws_client_t *client,
+  cws_response_t *response,
+  strslice_t etag,
+  time_t last_modified
+)
+{
+  if (!cws_conditional_not_modified(client->head, etag, last_modified)) return false;
+
+  // A 304 has no body and isn't framed by it's length
+  if (!cws_response_send_head(client, STATUS_NOT_MODIFIED, response, 0)) client->keep_alive = false;
+  return true;
+}
+
+bool cws_conditional_send_buf(
+  cws_client_t *client,
+  cws_response_t *response,
+  char *body,
+  size_t body_len
+)
+{
+  cws_response_t tagged;
+  if (response) tagged = *response;
+  else cws_response_init(&tagged);
+
+  char etag[CWS_ETAG_MAXLEN];
+  size_t etag_len = cws_etag_body(body, body_len, false, etag);
+  cws_response_add_header(&tagged, "ETag", etag);
+
+  if (cws_conditional_respond(client, &tagged, strslice_make(etag, etag_len), -1)) return true;
+  return cws_response_send_buf(client, STATUS_OK, &tagged, body, body_len);
+}
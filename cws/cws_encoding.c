@@ -0,0 +1,340 @@
+#include "cws/cws_encoding.h"
+
+/**
+ * @brief Part of the compression cache, holding the variants whose keys map to it
+ */
+typedef struct cws_encoding_shard
+{
+  pthread_mutex_t lock;                                        // Guards the variants
+  cws_encoding_variant_t variants[CWS_ENCODING_CACHE_SHARD_SIZE]; // Cached variants
+  size_t victim;                                               // Next slot to be evicted when full
+} cws_encoding_shard_t;
+
+static cws_encoding_shard_t cws_encoding_shards[CWS_ENCODING_CACHE_SHARDS];
+static pthread_once_t cws_encoding_shards_once = PTHREAD_ONCE_INIT;
+
+// Deflate state of the current thread, released as it exits
+static __thread z_stream *cws_encoding_stream = NULL;
+static pthread_key_t cws_encoding_stream_key;
+static pthread_once_t cws_encoding_stream_once = PTHREAD_ONCE_INIT;
+
+// Content types which aren't text/ but compress well
+static const char *cws_encoding_compressible_types[] = {
+  "application/json",
+  "application/javascript",
+  "application/xml",
+  "application/wasm",
+  "application/manifest+json",
+  "image/svg+xml"
+};
+
+/*
+============================================================================
+                                 Encodings                                  
+============================================================================
+*/
+
+/**
+ * @brief Split an element of Accept-Encoding into it's coding and check
+ * whether or not it's quality is above zero
+ * 
+ * @param element Element of the list
+ * @param coding Output for the coding
+ * @return true Coding is acceptable
+ * @return false Coding is refused
+ */
+static bool cws_encoding_accepted(strslice_t element, strslice_t *coding)
+{
+  size_t i = 0;
+  while (i < element.len && (element.ptr[i] == ' ' || element.ptr[i] == '\t')) i++;
+
+  size_t start = i;
+  while (i < element.len && element.ptr[i] != ';' && element.ptr[i] != ' ' && element.ptr[i] != '\t') i++;
+  *coding = strslice_make(&element.ptr[start], i - start);
+
+  // Look for the weight among the parameters, which defaults to one
+  while (i < element.len)
+  {
+    while (i < element.len && (element.ptr[i] == ';' || element.ptr[i] == ' ' || element.ptr[i] == '\t')) i++;
+    if (i + 2 > element.len || (element.ptr[i] != 'q' && element.ptr[i] != 'Q') || element.ptr[i + 1] != '=')
+    {
+      while (i < element.len && element.ptr[i] != ';') i++;
+      continue;
+    }
+
+    // Any non-zero digit makes for a positive weight
+    for (i += 2; i < element.len && element.ptr[i] != ';'; i++)
+      if (element.ptr[i] >= '1' && element.ptr[i] <= '9') return true;
+    return false;
+  }
+
+  return true;
+}
+
+cws_encoding_t cws_encoding_negotiate(cws_request_head_t *head)
+{
+  strslice_t *accept = cws_request_head_known(head, CWS_HDR_ACCEPT_ENCODING);
+  if (!accept) return CWS_ENCODING_IDENTITY;
+
+  // Whether or not gzip has been listed by name or by wildcard, and accepted
+  bool gzip_listed = false, gzip_accepted = false;
+  bool any_listed = false, any_accepted = false;
+
+  size_t i = 0;
+  while (i < accept->len)
+  {
+    size_t start = i;
+    while (i < accept->len && accept->ptr[i] != ',') i++;
+
+    strslice_t coding;
+    bool accepted = cws_encoding_accepted(strslice_make(&accept->ptr[start], i++ - start), &coding);
+
+    if (strslice_eq_ci(coding, "gzip") || strslice_eq_ci(coding, "x-gzip"))
+    {
+      gzip_listed = true;
+      gzip_accepted = accepted;
+    }
+    else if (strslice_eq_ci(coding, "*"))
+    {
+      any_listed = true;
+      any_accepted = accepted;
+    }
+  }
+
+  if (gzip_listed ? gzip_accepted : any_listed && any_accepted) return CWS_ENCODING_GZIP;
+  return CWS_ENCODING_IDENTITY;
+}
+
+const char *cws_encoding_name(cws_encoding_t encoding)
+{
+  return encoding == CWS_ENCODING_GZIP ? "gzip" : NULL;
+}
+
+bool cws_encoding_compressible(strslice_t content_type)
+{
+  // Parameters don't matter
+  size_t len = 0;
+  while (len < content_type.len && content_type.ptr[len] != ';' && content_type.ptr[len] != ' ') len++;
+  strslice_t type = strslice_make(content_type.ptr, len);
+
+  if (type.len >= 5 && strncasecmp(type.ptr, "text/", 5) == 0) return true;
+
+  for (size_t i = 0; i < sizeof(cws_encoding_compressible_types) / sizeof(char *); i++)
+    if (strslice_eq_ci(type, cws_encoding_compressible_types[i])) return true;
+
+  return false;
+}
+
+/**
+ * @brief Clean up a deflate state that's about to be destroyed
+ */
+static void cws_encoding_stream_cleanup(mman_meta_t *ref)
+{
+  deflateEnd((z_stream *) ref->ptr);
+}
+
+/**
+ * @brief Release an exiting thread's deflate state
+ */
+static void cws_encoding_stream_release(void *stream)
+{
+  mman_dealloc(stream);
+}
+
+static void cws_encoding_stream_key_make()
+{
+  pthread_key_create(&cws_encoding_stream_key, cws_encoding_stream_release);
+}
+
+/**
+ * @brief Get the current thread's deflate state, set up on first use and
+ * reset on every further use, as setting it up allocates a whole window
+ */
+static z_stream *cws_encoding_stream_get()
+{
+  if (cws_encoding_stream) return deflateReset(cws_encoding_stream) == Z_OK ? cws_encoding_stream : NULL;
+
+  pthread_once(&cws_encoding_stream_once, cws_encoding_stream_key_make);
+
+  // Ending a state that's never been set up is a no-op
+  z_stream *stream = (z_stream *) mman_alloc(sizeof(z_stream), 1, cws_encoding_stream_cleanup);
+  memset(stream, 0, sizeof(z_stream));
+
+  // Window bits above 15 select the gzip wrapper
+  if (deflateInit2(stream, CWS_ENCODING_GZIP_LEVEL, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+  {
+    mman_dealloc(stream);
+    return NULL;
+  }
+
+  pthread_setspecific(cws_encoding_stream_key, stream);
+  cws_encoding_stream = stream;
+  return stream;
+}
+
+char *cws_encoding_compress(cws_encoding_t encoding, const char *body, size_t body_len, size_t *encoded_len)
+{
+  if (encoding != CWS_ENCODING_GZIP || body_len > UINT32_MAX) return NULL;
+
+  z_stream *stream = cws_encoding_stream_get();
+  if (!stream) return NULL;
+
+  size_t bound = deflateBound(stream, body_len);
+  scptr char *encoded = (char *) mman_alloc(sizeof(char), bound, NULL);
+
+  stream->next_in = (Bytef *) body;
+  stream->avail_in = body_len;
+  stream->next_out = (Bytef *) encoded;
+  stream->avail_out = bound;
+
+  // Not getting any smaller isn't worth the client's effort of decompressing
+  if (deflate(stream, Z_FINISH) != Z_STREAM_END || stream->total_out >= body_len) return NULL;
+
+  *encoded_len = stream->total_out;
+  if (!mman_realloc((void **) &encoded, sizeof(char), *encoded_len)) return NULL;
+  return mman_ref(encoded);
+}
+
+/*
+============================================================================
+                             Compression cache                              
+============================================================================
+*/
+
+static void cws_encoding_shards_init()
+{
+  for (size_t i = 0; i < CWS_ENCODING_CACHE_SHARDS; i++)
+  {
+    pthread_mutex_init(&cws_encoding_shards[i].lock, NULL);
+    memset(cws_encoding_shards[i].variants, 0, sizeof(cws_encoding_shards[i].variants));
+    cws_encoding_shards[i].victim = 0;
+  }
+}
+
+/**
+ * @brief Get the shard of the cache a key maps to
+ */
+static cws_encoding_shard_t *cws_encoding_shard(strslice_t resource, strslice_t etag, cws_encoding_t encoding)
+{
+  pthread_once(&cws_encoding_shards_once, cws_encoding_shards_init);
+
+  // FNV-1a over both parts of the key
+  uint64_t hash = 0xcbf29ce484222325ULL ^ encoding;
+  strslice_t parts[] = { resource, etag };
+  for (size_t i = 0; i < 2; i++)
+  {
+    for (size_t j = 0; j < parts[i].len; j++)
+    {
+      hash ^= (unsigned char) parts[i].ptr[j];
+      hash *= 0x100000001b3ULL;
+    }
+  }
+
+  return &cws_encoding_shards[hash % CWS_ENCODING_CACHE_SHARDS];
+}
+
+/**
+ * @brief Find a variant within it's shard, the shard has to be locked
+ */
+static cws_encoding_variant_t *cws_encoding_find(
+  cws_encoding_shard_t *shard,
+  strslice_t resource,
+  strslice_t etag,
+  cws_encoding_t encoding
+)
+{
+  for (size_t i = 0; i < CWS_ENCODING_CACHE_SHARD_SIZE; i++)
+  {
+    cws_encoding_variant_t *variant = &shard->variants[i];
+    if (
+      variant->resource
+      && variant->encoding == encoding
+      && variant->resource_len == resource.len
+      && variant->etag_len == etag.len
+      && memcmp(variant->resource, resource.ptr, resource.len) == 0
+      && memcmp(variant->etag, etag.ptr, etag.len) == 0
+    ) return variant;
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Check whether or not a key can be cached under
+ */
+static bool cws_encoding_cacheable(strslice_t resource, strslice_t etag)
+{
+  return resource.len > 0 && etag.len > 0 && etag.len < CWS_ETAG_MAXLEN;
+}
+
+bool cws_encoding_cache_get(strslice_t resource, strslice_t etag, cws_encoding_t encoding, char **body, size_t *body_len)
+{
+  if (!cws_encoding_cacheable(resource, etag)) return false;
+
+  cws_encoding_shard_t *shard = cws_encoding_shard(resource, etag, encoding);
+  pthread_mutex_lock(&shard->lock);
+
+  cws_encoding_variant_t *variant = cws_encoding_find(shard, resource, etag, encoding);
+  if (variant)
+  {
+    // The reference keeps the body alive across an eviction
+    *body = mman_ref(variant->body);
+    *body_len = variant->body_len;
+  }
+
+  pthread_mutex_unlock(&shard->lock);
+  return variant != NULL;
+}
+
+/**
+ * @brief Cache a variant, replacing another one if the shard is full
+ * 
+ * @param resource Name of the resource
+ * @param etag Strong entity tag of the uncompressed body
+ * @param encoding Encoding of the variant
+ * @param body Managed compressed body, a reference is taken, NULL if it's not worth compressing
+ * @param body_len Length of the compressed body
+ */
+static void cws_encoding_cache_put(strslice_t resource, strslice_t etag, cws_encoding_t encoding, char *body, size_t body_len)
+{
+  cws_encoding_shard_t *shard = cws_encoding_shard(resource, etag, encoding);
+  pthread_mutex_lock(&shard->lock);
+
+  // Another thread might have been compressing the same body
+  cws_encoding_variant_t *variant = cws_encoding_find(shard, resource, etag, encoding);
+
+  for (size_t i = 0; !variant && i < CWS_ENCODING_CACHE_SHARD_SIZE; i++)
+    if (!shard->variants[i].resource) variant = &shard->variants[i];
+
+  if (!variant)
+  {
+    variant = &shard->variants[shard->victim];
+    shard->victim = (shard->victim + 1) % CWS_ENCODING_CACHE_SHARD_SIZE;
+  }
+
+  scptr char *evicted_resource = variant->resource;
+  scptr char *evicted_body = variant->body;
+  variant->resource = strslice_dup(resource);
+  variant->resource_len = resource.len;
+  memcpy(variant->etag, etag.ptr, etag.len);
+  variant->etag_len = etag.len;
+  variant->encoding = encoding;
+  variant->body = mman_ref(body);
+  variant->body_len = body_len;
+
+  pthread_mutex_unlock(&shard->lock);
+}
+
+char *cws_encoding_variant(strslice_t resource, strslice_t etag, cws_encoding_t encoding, const char *body, size_t body_len, size_t *encoded_len)
+{
+  char *encoded = NULL;
+  if (cws_encoding_cache_get(resource, etag, encoding, &encoded, encoded_len)) return encoded;
+
+  encoded = cws_encoding_compress(encoding, body, body_len, encoded_len);
+
+  // Bodies which don't get any smaller are remembered as well
+  if (cws_encoding_cacheable(resource, etag) && body_len <= CWS_ENCODING_MAX_LEN)
+    cws_encoding_cache_put(resource, etag, encoding, encoded, encoded ? *encoded_len : 0);
+
+  return encoded;
+}
@@ -0,0 +1,140 @@
+#include "cws/cws_header.h"
+
+static const char *cws_header_names[] = {
+  [CWS_HDR_HOST] = "Host",
+  [CWS_HDR_CONTENT_LENGTH] = "Content-Length",
+  [CWS_HDR_CONTENT_TYPE] = "Content-Type",
+  [CWS_HDR_CONNECTION] = "Connection",
+  [CWS_HDR_TRANSFER_ENCODING] = "Transfer-Encoding",
+  [CWS_HDR_COOKIE] = "Cookie",
+  [CWS_HDR_ACCEPT] = "Accept",
+  [CWS_HDR_ACCEPT_ENCODING] = "Accept-Encoding",
+  [CWS_HDR_ACCEPT_LANGUAGE] = "Accept-Language",
+  [CWS_HDR_IF_NONE_MATCH] = "If-None-Match",
+  [CWS_HDR_IF_MODIFIED_SINCE] = "If-Modified-Since",
+  [CWS_HDR_IF_RANGE] = "If-Range",
+  [CWS_HDR_RANGE] = "Range",
+  [CWS_HDR_USER_AGENT] = "User-Agent",
+  [CWS_HDR_AUTHORIZATION] = "Authorization",
+  [CWS_HDR_EXPECT] = "Expect",
+  [CWS_HDR_UPGRADE] = "Upgrade",
+  [CWS_HDR_REFERER] = "Referer",
+  [CWS_HDR_ORIGIN] = "Origin",
+  [CWS_HDR_CACHE_CONTROL] = "Cache-Control",
+  [CWS_HDR_KEEP_ALIVE] = "Keep-Alive",
+  [CWS_HDR_TE] = "TE",
+  [CWS_HDR_X_FORWARDED_FOR] = "X-Forwarded-For",
+  [CWS_HDR_TRACEPARENT] = "Traceparent"
+};
+
+/*
+============================================================================
+                                Perfect hash                                
+============================================================================
+*/
+
+// Number of slots of the hash, a power of two
+#define CWS_HEADER_HASH_SLOTS 32
+
+// Character weights of the hash, chosen such that no two well-known names
+// collide, both cases of a letter share their weight
+// INFO: Keep these in sync with the list of well-known headers, the weights
+// have been found by a randomized search over all of the names' characters
+static const unsigned char cws_header_asso[256] = {
+  ['-'] = 14,
+  ['a'] = 5, ['A'] = 5,
+  ['c'] = 15, ['C'] = 15,
+  ['d'] = 20, ['D'] = 20,
+  ['e'] = 28, ['E'] = 28,
+  ['f'] = 24, ['F'] = 24,
+  ['g'] = 20, ['G'] = 20,
+  ['h'] = 26, ['H'] = 26,
+  ['i'] = 13, ['I'] = 13,
+  ['k'] = 3, ['K'] = 3,
+  ['l'] = 7, ['L'] = 7,
+  ['m'] = 25, ['M'] = 25,
+  ['n'] = 26, ['N'] = 26,
+  ['o'] = 7, ['O'] = 7,
+  ['p'] = 30, ['P'] = 30,
+  ['r'] = 15, ['R'] = 15,
+  ['s'] = 18, ['S'] = 18,
+  ['t'] = 5, ['T'] = 5,
+  ['u'] = 27, ['U'] = 27,
+  ['v'] = 11, ['V'] = 11,
+  ['w'] = 24, ['W'] = 24,
+  ['x'] = 25, ['X'] = 25,
+  ['y'] = 22, ['Y'] = 22,
+  ['z'] = 31, ['Z'] = 31
+};
+
+// Well-known header residing in each slot of the hash
+static const cws_header_id_t cws_header_slots[CWS_HEADER_HASH_SLOTS] = {
+  [0] = CWS_HDR_UNKNOWN,
+  [1] = CWS_HDR_REFERER,
+  [2] = CWS_HDR_CONNECTION,
+  [3] = CWS_HDR_EXPECT,
+  [4] = CWS_HDR_ACCEPT_ENCODING,
+  [5] = CWS_HDR_CONTENT_LENGTH,
+  [6] = CWS_HDR_X_FORWARDED_FOR,
+  [7] = CWS_HDR_IF_MODIFIED_SINCE,
+  [8] = CWS_HDR_UNKNOWN,
+  [9] = CWS_HDR_UNKNOWN,
+  [10] = CWS_HDR_RANGE,
+  [11] = CWS_HDR_UNKNOWN,
+  [12] = CWS_HDR_ACCEPT,
+  [13] = CWS_HDR_UPGRADE,
+  [14] = CWS_HDR_KEEP_ALIVE,
+  [15] = CWS_HDR_USER_AGENT,
+  [16] = CWS_HDR_IF_NONE_MATCH,
+  [17] = CWS_HDR_UNKNOWN,
+  [18] = CWS_HDR_CACHE_CONTROL,
+  [19] = CWS_HDR_TRACEPARENT,
+  [20] = CWS_HDR_COOKIE,
+  [21] = CWS_HDR_HOST,
+  [22] = CWS_HDR_IF_RANGE,
+  [23] = CWS_HDR_ACCEPT_LANGUAGE,
+  [24] = CWS_HDR_TRANSFER_ENCODING,
+  [25] = CWS_HDR_AUTHORIZATION,
+  [26] = CWS_HDR_UNKNOWN,
+  [27] = CWS_HDR_ORIGIN,
+  [28] = CWS_HDR_CONTENT_TYPE,
+  [29] = CWS_HDR_UNKNOWN,
+  [30] = CWS_HDR_UNKNOWN,
+  [31] = CWS_HDR_TE
+};
+
+/**
+ * @brief Hash a header's name by it's length, first, middle and last character
+ */
+INLINED static size_t cws_header_hash(strslice_t name)
+{
+  unsigned char *chars = (unsigned char *) name.ptr;
+  return (
+    name.len
+    + cws_header_asso[chars[0]]
+    + cws_header_asso[chars[name.len / 2]]
+    + cws_header_asso[chars[name.len - 1]]
+  ) & (CWS_HEADER_HASH_SLOTS - 1);
+}
+
+/*
+============================================================================
+                                   Lookup                                   
+============================================================================
+*/
+
+const char *cws_header_name(cws_header_id_t id)
+{
+  if (id >= CWS_HDR_UNKNOWN) return NULL;
+  return cws_header_names[id];
+}
+
+cws_header_id_t cws_header_lookup(strslice_t name)
+{
+  if (name.len == 0) return CWS_HDR_UNKNOWN;
+
+  // Only one well-known header can reside in the slot, confirm it's the right one
+  cws_header_id_t id = cws_header_slots[cws_header_hash(name)];
+  if (id == CWS_HDR_UNKNOWN || !strslice_eq_ci(name, cws_header_names[id])) return CWS_HDR_UNKNOWN;
+  return id;
+}
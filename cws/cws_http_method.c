@@ -20,12 +20,11 @@ const char *cws_http_method_stringify(cws_http_method_t method)
   return cws_http_method_str[method];
 }
 
-bool cws_http_method_parse(char *string, cws_http_method_t *output)
+bool cws_http_method_parse(strslice_t string, cws_http_method_t *output)
 {
   for (size_t i = 0; i < cws_http_method_str_len; i++)
   {
-    const char *curr = cws_http_method_str[i];
-    if (strncmp(curr, string, strlen(curr)) != 0) continue;
+    if (!strslice_eq(string, cws_http_method_str[i])) continue;
     *output = (cws_http_method_t) i;
     return true;
   }
@@ -0,0 +1,476 @@
+#include "cws/cws_pool.h"
+
+/*
+============================================================================
+                                 Run queues                                 
+============================================================================
+*/
+
+/**
+ * @brief Close and release a client which has never been served
+ */
+static void cws_pool_client_cleanup(void *ref)
+{
+  scptr cws_client_t *client = (cws_client_t *) ref;
+  close(client->descriptor);
+}
+
+/**
+ * @brief Take the next client off a worker's run queue
+ * 
+ * @param worker Worker to take from
+ * @param steal Whether the caller is stealing from another worker, which takes
+ * the oldest queued client instead of the most recent one
+ * @return cws_client_t* Client or NULL if the queue is empty
+ */
+static cws_client_t *cws_pool_take(cws_pool_worker_t *worker, bool steal)
+{
+  void *client = NULL;
+
+  pthread_mutex_lock(&worker->lock);
+  if (steal) deque_pop_front(worker->queue, &client);
+  else deque_pop_back(worker->queue, &client);
+  pthread_mutex_unlock(&worker->lock);
+
+  return (cws_client_t *) client;
+}
+
+/**
+ * @brief Take the next client off the worker's own run queue, or steal one
+ * from the others in order
+ * 
+ * @return cws_client_t* Client or NULL if all queues are empty
+ */
+static cws_client_t *cws_pool_find(cws_pool_worker_t *worker)
+{
+  cws_pool_t *pool = worker->pool;
+  cws_client_t *client = NULL;
+
+  for (size_t i = 0; !client && i < pool->num_workers; i++)
+  {
+    cws_pool_worker_t *victim = &pool->workers[(worker->id + i) % pool->num_workers];
+    client = cws_pool_take(victim, victim != worker);
+  }
+
+  return client;
+}
+
+/**
+ * @brief Wake up a worker if it's about to sleep, every announcement is
+ * taken up by exactly one waker
+ * 
+ * @return true Worker has been woken up
+ * @return false Worker is busy
+ */
+static bool cws_pool_wake(cws_pool_worker_t *worker)
+{
+  if (!__atomic_load_n(&worker->idle, __ATOMIC_SEQ_CST)) return false;
+  if (!__atomic_exchange_n(&worker->idle, false, __ATOMIC_SEQ_CST)) return false;
+
+  sem_post(&worker->wakeup);
+  return true;
+}
+
+/*
+============================================================================
+                                   Poller                                   
+============================================================================
+*/
+
+/**
+ * @brief Unlink a client from the poller's idle list
+ */
+static void cws_pool_idle_remove(cws_pool_t *pool, cws_client_t *client)
+{
+  // Not linked into the list
+  if (!client->_idle_prev && !client->_idle_next && pool->idle_head != client) return;
+
+  if (client->_idle_prev) client->_idle_prev->_idle_next = client->_idle_next;
+  else pool->idle_head = client->_idle_next;
+
+  if (client->_idle_next) client->_idle_next->_idle_prev = client->_idle_prev;
+  else pool->idle_tail = client->_idle_prev;
+
+  client->_idle_prev = NULL;
+  client->_idle_next = NULL;
+}
+
+/**
+ * @brief Start tracking all clients which have been parked since the last call,
+ * the idle list stays roughly ordered by the time they were parked at
+ */
+static void cws_pool_idle_adopt(cws_pool_t *pool)
+{
+  // Take the whole parked stack at once
+  cws_client_t *client = __sync_lock_test_and_set(&pool->parked, NULL);
+
+  while (client)
+  {
+    cws_client_t *next = client->_idle_next;
+    client->_idle_next = NULL;
+
+    client->_idle_prev = pool->idle_tail;
+    if (pool->idle_tail) pool->idle_tail->_idle_next = client;
+    else pool->idle_head = client;
+    pool->idle_tail = client;
+
+    client = next;
+  }
+}
+
+/**
+ * @brief Stop watching a parked client, it has to be unlinked before it's
+ * submitted, as the next worker may park it again right away
+ */
+static void cws_pool_unpark(cws_pool_t *pool, cws_client_t *client)
+{
+  cws_pool_idle_remove(pool, client);
+  epoll_ctl(pool->epoll_fd, EPOLL_CTL_DEL, client->descriptor, NULL);
+}
+
+/**
+ * @brief Unpark a client, close the connection and drop the poller's reference
+ */
+static void cws_pool_close(cws_pool_t *pool, cws_client_t *client)
+{
+  cws_pool_unpark(pool, client);
+  close(client->descriptor);
+
+  // Release the reference taken on parking
+  scptr cws_client_t *released = client;
+}
+
+/**
+ * @brief Park a client between two requests, until it turns readable or
+ * it's idle timeout expires
+ * 
+ * @param pool Pool whose poller watches the client
+ * @param client Client to park, the poller takes a reference
+ */
+static void cws_pool_park(cws_pool_t *pool, cws_client_t *client)
+{
+  // Hand the client over to the poller by pushing it onto the parked stack
+  cws_client_t *poller_ref = mman_ref(client);
+  client->last_active_ms = cws_clock_now_ms();
+  do client->_idle_next = pool->parked;
+  while (!__sync_bool_compare_and_swap(&pool->parked, client->_idle_next, poller_ref));
+
+  // Report the next request only once, a failed registration leaves the
+  // client silent, so it will be closed by it's idle timeout
+  struct epoll_event ev = {
+    .events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT,
+    .data.ptr = poller_ref
+  };
+  epoll_ctl(pool->epoll_fd, EPOLL_CTL_ADD, client->descriptor, &ev);
+}
+
+/**
+ * @brief Poller subroutine to be used as a thread function
+ * 
+ * @param arg Pool structure pointer
+ */
+static void *cws_pool_poll(void *arg)
+{
+  cws_pool_t *pool = (cws_pool_t *) arg;
+  struct epoll_event events[CWS_POOL_MAX_EVENTS];
+
+  while (pool->poller_active)
+  {
+    // Wake up when the least recently parked client expires, but at least once
+    // per tick, so newly parked clients which stay silent are adopted in time
+    long timeout_ms = CWS_POOL_TICK_MS;
+    if (pool->idle_head)
+    {
+      long expiry_ms = pool->idle_head->last_active_ms + CWS_KEEPALIVE_TIMEOUT_MS - cws_clock_now_ms();
+      if (expiry_ms < timeout_ms) timeout_ms = expiry_ms < 0 ? 0 : expiry_ms;
+    }
+
+    int num_events = epoll_wait(pool->epoll_fd, events, CWS_POOL_MAX_EVENTS, timeout_ms);
+
+    // Interrupted by a signal, wait again
+    if (num_events < 0 && errno == EINTR) continue;
+
+    // Epoll instance is unusable
+    if (num_events < 0) break;
+
+    // Clients are pushed onto the parked stack before they're registered,
+    // so every client an event is reported for has been adopted by now
+    long now_ms = cws_clock_now_ms();
+    cws_pool_idle_adopt(pool);
+
+    for (int i = 0; i < num_events; i++)
+    {
+      // The wakeup descriptor carries no client, it only interrupts the wait
+      if (!events[i].data.ptr) continue;
+
+      // The reference taken on parking is released after submitting
+      scptr cws_client_t *client = (cws_client_t *) events[i].data.ptr;
+      cws_pool_unpark(pool, client);
+
+      // The next request arrived, a worker picks it up, unless the connection broke
+      bool hangup = events[i].events & (EPOLLERR | EPOLLHUP);
+      if (!hangup && cws_pool_submit(pool, client)) continue;
+
+      // Shed load when all workers are saturated
+      if (!hangup) errif_resp(client, true, STATUS_SERVICE_UNAVAILABLE, "All workers are busy!");
+      close(client->descriptor);
+    }
+
+    // Close all connections which have been idle for too long
+    while (pool->idle_head && pool->idle_head->last_active_ms + CWS_KEEPALIVE_TIMEOUT_MS <= now_ms)
+      cws_pool_close(pool, pool->idle_head);
+  }
+
+  return NULL;
+}
+
+/*
+============================================================================
+                                  Workers                                   
+============================================================================
+*/
+
+/**
+ * @brief Serve a client using blocking reads while a request is underway,
+ * between two requests the client is parked instead of waiting for the next
+ * 
+ * @param worker Worker serving the client
+ * @param client Client to serve
+ */
+static void cws_pool_serve(cws_pool_worker_t *worker, cws_client_t *client)
+{
+  while (client->state != CWS_CS_CLOSE)
+  {
+    // Nothing of the next request has been received yet, don't wait for it
+    bool between = client->state == CWS_CS_HEAD && client->rbuf_len == 0;
+    ssize_t read_size = recv(client->descriptor, worker->seg, CWS_HANDLER_SEGLEN, between ? MSG_DONTWAIT : 0);
+
+    // Feed the segment into the state machine
+    if (read_size > 0)
+    {
+      cws_client_process(client, worker->seg, read_size);
+      continue;
+    }
+
+    if (read_size < 0 && errno == EINTR) continue;
+
+    // Idle, the poller hands the client back once the next request arrives
+    if (read_size < 0 && between && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+      cws_pool_park(worker->pool, client);
+      return;
+    }
+
+    // Orderly shutdown, connection error or timeout
+    break;
+  }
+
+  close(client->descriptor);
+}
+
+/**
+ * @brief Worker subroutine to be used as a thread function
+ * 
+ * @param arg Worker structure pointer
+ */
+static void *cws_pool_work(void *arg)
+{
+  cws_pool_worker_t *worker = (cws_pool_worker_t *) arg;
+
+  while (worker->thread_active)
+  {
+    scptr cws_client_t *client = cws_pool_find(worker);
+    if (!client)
+    {
+      // Announce going to sleep, then look once more, as a client may have
+      // been queued before the announcement became visible to submitters
+      __atomic_store_n(&worker->idle, true, __ATOMIC_SEQ_CST);
+      client = cws_pool_find(worker);
+
+      // Sleep until woken, a submitter who took the announcement up in the
+      // meantime already posted, which is consumed right away
+      if (!client || !__atomic_exchange_n(&worker->idle, false, __ATOMIC_SEQ_CST))
+        while (sem_wait(&worker->wakeup) < 0 && errno == EINTR);
+
+      if (!client) continue;
+    }
+
+    cws_pool_serve(worker, client);
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Clean up a cws_pool struct that is about to be destroyed
+ * by stopping and joining all of it's workers and it's poller
+ */
+static void cws_pool_cleanup(mman_meta_t *ref)
+{
+  cws_pool_t *pool = (cws_pool_t *) ref->ptr;
+
+  // Signal termination and wake up every worker
+  for (size_t i = 0; i < pool->num_workers; i++)
+    pool->workers[i].thread_active = false;
+  for (size_t i = 0; i < pool->num_workers; i++)
+    sem_post(&pool->workers[i].wakeup);
+
+  for (size_t i = 0; i < pool->num_workers; i++)
+    if (pool->workers[i].thread) pthread_join(pool->workers[i].thread, NULL);
+
+  // Stop the poller by a wakeup-event, once no worker parks clients anymore
+  if (pool->poller_active)
+  {
+    pool->poller_active = false;
+    int wakeup_fd = eventfd(1, 0);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    epoll_ctl(pool->epoll_fd, EPOLL_CTL_ADD, wakeup_fd, &ev);
+    pthread_join(pool->poller, NULL);
+    close(wakeup_fd);
+  }
+
+  // Close all parked clients
+  cws_pool_idle_adopt(pool);
+  while (pool->idle_head) cws_pool_close(pool, pool->idle_head);
+  if (pool->epoll_fd >= 0) close(pool->epoll_fd);
+
+  // Drop left over clients
+  for (size_t i = 0; i < pool->num_workers; i++)
+  {
+    cws_pool_worker_t *worker = &pool->workers[i];
+    pthread_mutex_destroy(&worker->lock);
+    sem_destroy(&worker->wakeup);
+    mman_dealloc(worker->queue);
+    mman_dealloc(worker->seg);
+  }
+
+  mman_dealloc(pool->workers);
+}
+
+cws_pool_t *cws_pool_make(size_t num_workers)
+{
+  // Default to one worker per online core
+  if (num_workers == 0)
+  {
+    long num_cores = sysconf(_SC_NPROCESSORS_ONLN);
+    num_workers = num_cores > 0 ? num_cores : 1;
+  }
+
+  scptr cws_pool_t *pool = (cws_pool_t *) mman_alloc(sizeof(cws_pool_t), 1, cws_pool_cleanup);
+  pool->num_workers = num_workers;
+  pool->next_worker = 0;
+  pool->epoll_fd = -1;
+  pool->poller_active = false;
+  pool->parked = NULL;
+  pool->idle_head = NULL;
+  pool->idle_tail = NULL;
+
+  // Set up all run queues before any worker may steal from them
+  pool->workers = (cws_pool_worker_t *) mman_alloc(sizeof(cws_pool_worker_t), num_workers, NULL);
+  for (size_t i = 0; i < num_workers; i++)
+  {
+    cws_pool_worker_t *worker = &pool->workers[i];
+    worker->queue = deque_make(CWS_POOL_QUEUE_LEN, cws_pool_client_cleanup);
+    pthread_mutex_init(&worker->lock, NULL);
+    sem_init(&worker->wakeup, 0, 0);
+    worker->idle = false;
+    worker->thread = 0;
+    worker->thread_active = true;
+    worker->id = i;
+    worker->seg = mman_alloc(sizeof(char), CWS_HANDLER_SEGLEN, NULL);
+    worker->pool = pool;
+  }
+
+  // Start up the poller, which submits parked clients to the workers
+  pool->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (pool->epoll_fd < 0) return NULL;
+
+  pool->poller_active = true;
+  int poller_err = pthread_create(&pool->poller, NULL, cws_pool_poll, pool);
+  if (poller_err)
+  {
+    pool->poller_active = false;
+    errno = poller_err;
+    return NULL;
+  }
+
+  // Start up all workers
+  for (size_t i = 0; i < num_workers; i++)
+  {
+    int err = pthread_create(&pool->workers[i].thread, NULL, cws_pool_work, &pool->workers[i]);
+
+    // Could not create thread
+    if (err)
+    {
+      pool->workers[i].thread = 0;
+      errno = err;
+      return NULL;
+    }
+  }
+
+  return mman_ref(pool);
+}
+
+/*
+============================================================================
+                                 Submission                                 
+============================================================================
+*/
+
+bool cws_pool_submit(cws_pool_t *pool, cws_client_t *client)
+{
+  // Distribute clients onto the workers round robin, skip over full queues
+  size_t start = atomic_increment(&pool->next_worker);
+  for (size_t i = 0; i < pool->num_workers; i++)
+  {
+    cws_pool_worker_t *worker = &pool->workers[(start + i) % pool->num_workers];
+
+    // The queue now holds a reference
+    pthread_mutex_lock(&worker->lock);
+    deque_result_t res = deque_push_back(worker->queue, mman_ref(client));
+    pthread_mutex_unlock(&worker->lock);
+
+    if (res == DEQUE_SUCCESS)
+    {
+      // Order the push before looking for sleeping workers, pairs with the
+      // workers announcing their sleep before looking once more
+      __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+      // Wake the owner, or else any sleeping worker to steal the client
+      if (cws_pool_wake(worker)) return true;
+      for (size_t j = 1; j < pool->num_workers; j++)
+        if (cws_pool_wake(&pool->workers[(start + i + j) % pool->num_workers])) break;
+
+      return true;
+    }
+
+    // Queue full, release the reference again
+    scptr cws_client_t *queue_ref = client;
+  }
+
+  return false;
+}
+
+void cws_pool_handle_client(cws_client_t *client, void *arg)
+{
+  // Requests which stall midway time out by a failing read
+  struct timeval timeout = {
+    .tv_sec = CWS_KEEPALIVE_TIMEOUT_MS / 1000,
+    .tv_usec = (CWS_KEEPALIVE_TIMEOUT_MS % 1000) * 1000
+  };
+  setsockopt(client->descriptor, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  // Stalled peers time out by a failing write
+  struct timeval send_timeout = {
+    .tv_sec = CWS_CLIENT_SEND_TIMEOUT_MS / 1000,
+    .tv_usec = (CWS_CLIENT_SEND_TIMEOUT_MS % 1000) * 1000
+  };
+  setsockopt(client->descriptor, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+
+  // Shed load when all workers are saturated
+  if (!cws_pool_submit((cws_pool_t *) arg, client))
+  {
+    errif_resp(client, true, STATUS_SERVICE_UNAVAILABLE, "All workers are busy!");
+    close(client->descriptor);
+  }
+}
@@ -0,0 +1,167 @@
+#include "cws/cws_range.h"
+
+/*
+============================================================================
+                                   Ranges                                   
+============================================================================
+*/
+
+/**
+ * @brief Parse an unsigned decimal number
+ * 
+ * @param str String to parse from
+ * @param i Index to parse at, advanced past the digits
+ * @param num Output for the number
+ * @return true Number parsed
+ * @return false No digits or the number overflows
+ */
+static bool cws_range_number(strslice_t str, size_t *i, uint64_t *num)
+{
+  size_t start = *i;
+  *num = 0;
+
+  for (; *i < str.len && str.ptr[*i] >= '0' && str.ptr[*i] <= '9'; (*i)++)
+  {
+    uint64_t digit = str.ptr[*i] - '0';
+    if (*num > (UINT64_MAX - digit) / 10) return false;
+    *num = *num * 10 + digit;
+  }
+
+  return *i > start;
+}
+
+/**
+ * @brief Skip optional whitespace
+ */
+static void cws_range_ows(strslice_t str, size_t *i)
+{
+  while (*i < str.len && (str.ptr[*i] == ' ' || str.ptr[*i] == '\t')) (*i)++;
+}
+
+/**
+ * @brief Sort ranges by their start and merge the ones which overlap or touch
+ */
+static void cws_range_coalesce(cws_range_t *ranges, size_t *num_ranges)
+{
+  for (size_t i = 1; i < *num_ranges; i++)
+  {
+    cws_range_t range = ranges[i];
+    size_t j = i;
+    for (; j > 0 && ranges[j - 1].start > range.start; j--) ranges[j] = ranges[j - 1];
+    ranges[j] = range;
+  }
+
+  size_t merged = 0;
+  for (size_t i = 1; i < *num_ranges; i++)
+  {
+    cws_range_t *last = &ranges[merged];
+    uint64_t last_end = last->start + last->len;
+
+    if (ranges[i].start <= last_end)
+    {
+      uint64_t end = ranges[i].start + ranges[i].len;
+      if (end > last_end) last->len = end - last->start;
+      continue;
+    }
+
+    ranges[++merged] = ranges[i];
+  }
+
+  if (*num_ranges > 0) *num_ranges = merged + 1;
+}
+
+cws_range_result_t cws_range_parse(strslice_t header, uint64_t size, cws_range_t *ranges, size_t *num_ranges)
+{
+  *num_ranges = 0;
+
+  if (header.len < 6 || strncasecmp(header.ptr, "bytes=", 6) != 0) return CWS_RANGE_FULL;
+
+  size_t i = 6;
+  size_t num_specs = 0;
+  while (i < header.len)
+  {
+    cws_range_ows(header, &i);
+    if (i == header.len) break;
+
+    // Empty list elements are allowed
+    if (i < header.len && header.ptr[i] == ',')
+    {
+      i++;
+      continue;
+    }
+
+    if (++num_specs > CWS_RANGE_MAX) return CWS_RANGE_FULL;
+
+    uint64_t first = 0, last = UINT64_MAX;
+    bool suffix = i < header.len && header.ptr[i] == '-';
+
+    if (!suffix && !cws_range_number(header, &i, &first)) return CWS_RANGE_FULL;
+    if (i == header.len || header.ptr[i] != '-') return CWS_RANGE_FULL;
+    i++;
+
+    // Last byte is optional, except for suffixes
+    bool has_last = i < header.len && header.ptr[i] >= '0' && header.ptr[i] <= '9';
+    if ((has_last || suffix) && !cws_range_number(header, &i, &last)) return CWS_RANGE_FULL;
+    if (!suffix && last < first) return CWS_RANGE_FULL;
+
+    cws_range_ows(header, &i);
+    if (i < header.len && header.ptr[i] != ',') return CWS_RANGE_FULL;
+
+    // Suffixes address the last bytes, but not more than there are
+    if (suffix)
+    {
+      if (last == 0 || size == 0) continue;
+      first = last >= size ? 0 : size - last;
+      last = size - 1;
+    }
+
+    // Doesn't overlap, ranges reaching past the end are cut off
+    if (first >= size) continue;
+    if (last >= size) last = size - 1;
+
+    ranges[(*num_ranges)++] = (cws_range_t) { .start = first, .len = last - first + 1 };
+  }
+
+  if (num_specs == 0) return CWS_RANGE_FULL;
+  if (*num_ranges == 0) return CWS_RANGE_UNSATISFIABLE;
+
+  cws_range_coalesce(ranges, num_ranges);
+  return CWS_RANGE_PARTIAL;
+}
+
+bool cws_range_if_range(cws_request_head_t *head, strslice_t etag, time_t last_modified)
+{
+  strslice_t *if_range = cws_request_head_known(head, CWS_HDR_IF_RANGE);
+  if (!if_range) return true;
+
+  // Entity tags are always quoted, weak tags never match strongly
+  if (if_range->len > 0 && (*if_range->ptr == '"' || *if_range->ptr == 'W'))
+  {
+    return (
+      etag.len > 0 && *etag.ptr == '"'
+      && if_range->len == etag.len
+      && memcmp(if_range->ptr, etag.ptr, etag.len) == 0
+    );
+  }
+
+  time_t date;
+  return last_modified >= 0 && cws_http_date_parse(*if_range, &date) && date == last_modified;
+}
+
+cws_range_result_t cws_range_evaluate(
+  cws_request_head_t *head,
+  strslice_t etag,
+  time_t last_modified,
+  uint64_t size,
+  cws_range_t *ranges,
+  size_t *num_ranges
+)
+{
+  *num_ranges = 0;
+  if (head->method != GET) return CWS_RANGE_FULL;
+
+  strslice_t *range = cws_request_head_known(head, CWS_HDR_RANGE);
+  if (!range || !cws_range_if_range(head, etag, last_modified)) return CWS_RANGE_FULL;
+
+  return cws_range_parse(*range, size, ranges, num_ranges);
+}
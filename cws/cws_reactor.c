@@ -0,0 +1,297 @@
+#include "cws/cws_reactor.h"
+
+/*
+============================================================================
+                                 Idle list                                  
+============================================================================
+*/
+
+/**
+ * @brief Unlink a client from the loop's idle list
+ */
+static void cws_reactor_idle_remove(cws_reactor_loop_t *loop, cws_client_t *client)
+{
+  // Not linked into the list
+  if (!client->_idle_prev && !client->_idle_next && loop->idle_head != client) return;
+
+  if (client->_idle_prev) client->_idle_prev->_idle_next = client->_idle_next;
+  else loop->idle_head = client->_idle_next;
+
+  if (client->_idle_next) client->_idle_next->_idle_prev = client->_idle_prev;
+  else loop->idle_tail = client->_idle_prev;
+
+  client->_idle_prev = NULL;
+  client->_idle_next = NULL;
+}
+
+/**
+ * @brief Mark a client as active by moving it to the tail of the idle list,
+ * which keeps the list ordered by the time of last activity
+ */
+static void cws_reactor_idle_touch(cws_reactor_loop_t *loop, cws_client_t *client, long now_ms)
+{
+  if (loop->idle_tail != client)
+  {
+    cws_reactor_idle_remove(loop, client);
+
+    client->_idle_prev = loop->idle_tail;
+    if (loop->idle_tail) loop->idle_tail->_idle_next = client;
+    else loop->idle_head = client;
+    loop->idle_tail = client;
+  }
+
+  client->last_active_ms = now_ms;
+}
+
+/**
+ * @brief Start tracking all clients which have been registered since the last call
+ */
+static void cws_reactor_idle_adopt(cws_reactor_loop_t *loop)
+{
+  // Take the whole incoming stack at once
+  cws_client_t *client = __sync_lock_test_and_set(&loop->incoming, NULL);
+
+  while (client)
+  {
+    cws_client_t *next = client->_idle_next;
+    client->_idle_next = NULL;
+
+    // Idle time counts from the registration on
+    cws_reactor_idle_touch(loop, client, client->last_active_ms);
+    client = next;
+  }
+}
+
+/*
+============================================================================
+                                Client events                               
+============================================================================
+*/
+
+/**
+ * @brief Unregister a client from it's loop, close the connection and
+ * drop the loop's reference
+ */
+static void cws_reactor_close(cws_reactor_loop_t *loop, cws_client_t *client)
+{
+  cws_reactor_idle_remove(loop, client);
+  epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, client->descriptor, NULL);
+  close(client->descriptor);
+
+  // Release the reference taken on registration
+  scptr cws_client_t *released = client;
+}
+
+/**
+ * @brief Serve a client which has been signaled as readable or writable, drains
+ * the socket as required by edge-triggered notifications
+ */
+static void cws_reactor_serve(cws_reactor_loop_t *loop, cws_client_t *client, uint32_t events, long now_ms)
+{
+  bool hangup = events & (EPOLLERR | EPOLLHUP);
+  cws_reactor_idle_touch(loop, client, now_ms);
+
+  // Output which has been waiting for the socket to drain goes out first,
+  // requests received in the meantime are served right after
+  if (!hangup && client->write_blocked) cws_client_resume(client);
+
+  // Read until the socket would block, the connection is done or responses back up,
+  // the data left unread is picked up once the socket drained
+  while (!hangup && client->state != CWS_CS_CLOSE && !client->write_blocked)
+  {
+    ssize_t read_size = recv(client->descriptor, loop->seg, CWS_HANDLER_SEGLEN, 0);
+
+    // Feed the segment into the state machine
+    if (read_size > 0)
+    {
+      cws_client_process(client, loop->seg, read_size);
+      continue;
+    }
+
+    // Drained, wait for the next edge
+    if (read_size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+    if (read_size < 0 && errno == EINTR) continue;
+
+    // Orderly shutdown or connection error
+    hangup = true;
+  }
+
+  // Output that's still pending keeps the connection open, until it's written or times out
+  if (hangup || (client->state == CWS_CS_CLOSE && !client->write_blocked))
+    cws_reactor_close(loop, client);
+}
+
+/*
+============================================================================
+                                 Event loop                                 
+============================================================================
+*/
+
+/**
+ * @brief Event loop subroutine to be used as a thread function
+ * 
+ * @param arg Event loop structure pointer
+ */
+static void *cws_reactor_loop(void *arg)
+{
+  cws_reactor_loop_t *loop = (cws_reactor_loop_t *) arg;
+  struct epoll_event events[CWS_REACTOR_MAX_EVENTS];
+
+  while (loop->thread_active)
+  {
+    // Wake up when the least recently active client expires, but at least once per
+    // tick, so newly registered clients which stay silent are adopted in time
+    long timeout_ms = CWS_REACTOR_TICK_MS;
+    if (loop->idle_head)
+    {
+      long expiry_ms = loop->idle_head->last_active_ms + CWS_KEEPALIVE_TIMEOUT_MS - cws_clock_now_ms();
+      if (expiry_ms < timeout_ms) timeout_ms = expiry_ms < 0 ? 0 : expiry_ms;
+    }
+
+    int num_events = epoll_wait(loop->epoll_fd, events, CWS_REACTOR_MAX_EVENTS, timeout_ms);
+
+    // Interrupted by a signal, wait again
+    if (num_events < 0 && errno == EINTR) continue;
+
+    // Epoll instance is unusable
+    if (num_events < 0) break;
+
+    // Clients are pushed onto the incoming stack before they're registered,
+    // so every client an event is reported for has been adopted by now
+    long now_ms = cws_clock_now_ms();
+    cws_reactor_idle_adopt(loop);
+
+    // The wakeup descriptor carries no client, it only interrupts the wait
+    for (int i = 0; i < num_events; i++)
+      if (events[i].data.ptr)
+        cws_reactor_serve(loop, (cws_client_t *) events[i].data.ptr, events[i].events, now_ms);
+
+    // Close all connections which have been idle for too long
+    while (loop->idle_head && loop->idle_head->last_active_ms + CWS_KEEPALIVE_TIMEOUT_MS <= now_ms)
+      cws_reactor_close(loop, loop->idle_head);
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Clean up a cws_reactor struct that is about to be destroyed
+ * by stopping and joining all of it's loops
+ */
+static void cws_reactor_cleanup(mman_meta_t *ref)
+{
+  cws_reactor_t *reactor = (cws_reactor_t *) ref->ptr;
+
+  for (size_t i = 0; i < reactor->num_loops; i++)
+  {
+    cws_reactor_loop_t *loop = &reactor->loops[i];
+
+    // Loop has never been started
+    if (!loop->thread_active) continue;
+
+    // Signal termination and wake the loop up by a wakeup-event
+    loop->thread_active = false;
+    int wakeup_fd = eventfd(1, 0);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, wakeup_fd, &ev);
+    pthread_join(loop->thread, NULL);
+
+    close(wakeup_fd);
+    close(loop->epoll_fd);
+    mman_dealloc(loop->seg);
+  }
+
+  mman_dealloc(reactor->loops);
+}
+
+cws_reactor_t *cws_reactor_make(size_t num_loops, int cpu)
+{
+  // Default to one loop per online core
+  if (num_loops == 0)
+  {
+    long num_cores = sysconf(_SC_NPROCESSORS_ONLN);
+    num_loops = num_cores > 0 ? num_cores : 1;
+  }
+
+  scptr cws_reactor_t *reactor = (cws_reactor_t *) mman_alloc(sizeof(cws_reactor_t), 1, cws_reactor_cleanup);
+  reactor->num_loops = num_loops;
+  reactor->next_loop = 0;
+  reactor->loops = (cws_reactor_loop_t *) mman_alloc(sizeof(cws_reactor_loop_t), num_loops, NULL);
+  for (size_t i = 0; i < num_loops; i++)
+  {
+    reactor->loops[i].thread_active = false;
+    reactor->loops[i].incoming = NULL;
+    reactor->loops[i].idle_head = NULL;
+    reactor->loops[i].idle_tail = NULL;
+  }
+
+  // Start up all loops
+  for (size_t i = 0; i < num_loops; i++)
+  {
+    cws_reactor_loop_t *loop = &reactor->loops[i];
+
+    // Create the loop's epoll instance
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd < 0) return NULL;
+
+    // Start looping in another thread
+    loop->seg = mman_alloc(sizeof(char), CWS_HANDLER_SEGLEN, NULL);
+    loop->thread_active = true;
+    int err = pthread_create(&loop->thread, NULL, cws_reactor_loop, loop);
+
+    // Could not create thread
+    if (err)
+    {
+      loop->thread_active = false;
+      close(loop->epoll_fd);
+      mman_dealloc(loop->seg);
+      errno = err;
+      return NULL;
+    }
+
+    // Keep the loop on it's designated core
+    if (cpu >= 0) cws_pin_thread(loop->thread, cpu + i);
+  }
+
+  return mman_ref(reactor);
+}
+
+/*
+============================================================================
+                               Client handler                               
+============================================================================
+*/
+
+void cws_reactor_handle_client(cws_client_t *client, void *arg)
+{
+  cws_reactor_t *reactor = (cws_reactor_t *) arg;
+
+  // Distribute clients onto the loops round robin
+  size_t loop_id = atomic_increment(&reactor->next_loop) % reactor->num_loops;
+  cws_reactor_loop_t *loop = &reactor->loops[loop_id];
+
+  // Switch the client socket into non-blocking mode
+  int flags = fcntl(client->descriptor, F_GETFL, 0);
+  if (flags < 0 || fcntl(client->descriptor, F_SETFL, flags | O_NONBLOCK) < 0)
+  {
+    close(client->descriptor);
+    return;
+  }
+  client->nonblocking = true;
+
+  // Hand the client over to the loop by pushing it onto the incoming stack,
+  // the loop now holds a reference
+  cws_client_t *loop_ref = mman_ref(client);
+  client->last_active_ms = cws_clock_now_ms();
+  do client->_idle_next = loop->incoming;
+  while (!__sync_bool_compare_and_swap(&loop->incoming, client->_idle_next, loop_ref));
+
+  // Register for edge-triggered read and write events, writes only signal once
+  // a full socket drained, a failed registration leaves the client silent, so
+  // it will be closed by it's idle timeout
+  struct epoll_event ev = {
+    .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+    .data.ptr = loop_ref
+  };
+  epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, client->descriptor, &ev);
+}
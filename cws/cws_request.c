@@ -5,8 +5,24 @@
  */
 INLINED static void cws_request_cleanup(mman_meta_t *ref)
 {
-  mman_dealloc(((cws_request_head_t *) ref->ptr)->headers);
-  mman_dealloc(((cws_request_head_t *) ref->ptr)->uri);
+  cws_uri_release(&((cws_request_head_t *) ref->ptr)->uri);
+}
+
+cws_request_head_t *cws_request_head_make()
+{
+  cws_request_head_t *head = (cws_request_head_t *) mman_alloc(sizeof(cws_request_head_t), 1, cws_request_cleanup);
+  cws_uri_init(&head->uri);
+  cws_request_head_reset(head);
+  return head;
+}
+
+void cws_request_head_reset(cws_request_head_t *head)
+{
+  head->raw = strslice_make(NULL, 0);
+  head->part = CWS_HP_REQUEST_LINE;
+  head->scanned = 0;
+  head->num_headers = 0;
+  memset(head->known_headers, 0, sizeof(head->known_headers));
 }
 
 /*
@@ -15,11 +31,52 @@ INLINED static void cws_request_cleanup(mman_meta_t *ref)
 ============================================================================
 */
 
-static bool ps_http_method(char *req, size_t *offs, cws_request_head_t *res, char **err)
+// Delimiters the tokenizers scan for
+static const strscan_set_t ps_delim_space = STRSCAN_SET(" ");
+static const strscan_set_t ps_delim_lf = STRSCAN_SET("\n");
+static const strscan_set_t ps_delim_colon = STRSCAN_SET(":");
+static const strscan_set_t ps_delim_slash = STRSCAN_SET("/");
+static const strscan_set_t ps_delim_dot = STRSCAN_SET(".");
+
+/**
+ * @brief Cut a slice up to the next delimiter and skip past it
+ * 
+ * @return true Delimiter found, slice is set
+ * @return false Delimiter not found
+ */
+INLINED static bool ps_cut(char *req, size_t req_len, size_t *offs, const strscan_set_t *delim, strslice_t *slice)
+{
+  char *start = &req[*offs];
+  char *end = strscan_find(start, req_len - *offs, delim);
+  if (!end) return false;
+
+  *slice = strslice_make(start, end - start);
+  *offs += slice->len + 1;
+  return true;
+}
+
+/**
+ * @brief Trim leading and trailing whitespace off of a slice
+ */
+INLINED static strslice_t ps_trim(strslice_t slice)
+{
+  while (slice.len > 0 && (slice.ptr[0] == ' ' || slice.ptr[0] == '\t'))
+  {
+    slice.ptr++;
+    slice.len--;
+  }
+
+  while (slice.len > 0 && (slice.ptr[slice.len - 1] == ' ' || slice.ptr[slice.len - 1] == '\t'))
+    slice.len--;
+
+  return slice;
+}
+
+static bool ps_http_method(char *req, size_t req_len, size_t *offs, cws_request_head_t *res, char **err)
 {
   // Cut method string
-  scptr char *method_str = partial_strdup(req, offs, " ", false);
-  if (rp_exit(!method_str, err, "HTTP method missing!")) return false;
+  strslice_t method_str;
+  if (rp_exit(!ps_cut(req, req_len, offs, &ps_delim_space, &method_str), err, "HTTP method missing!")) return false;
 
   // Parse method string
   cws_http_method_t method;
@@ -29,43 +86,43 @@ static bool ps_http_method(char *req, size_t *offs, cws_request_head_t *res, cha
   return true;
 }
 
-static bool ps_uri(char *req, size_t *offs, cws_request_head_t *res, char **err)
+static bool ps_uri(char *req, size_t req_len, size_t *offs, cws_request_head_t *res, char **err)
 {
   // Cut URI string
-  scptr char *raw_uri = partial_strdup(req, offs, " ", false);
-  if (rp_exit(!raw_uri, err, "URI missing!")) return false;
+  strslice_t raw_uri;
+  if (rp_exit(!ps_cut(req, req_len, offs, &ps_delim_space, &raw_uri), err, "URI missing!")) return false;
 
   // Parse URI string
-  scptr cws_uri_t *uri;
-  if (rp_exit(!cws_uri_parse(raw_uri, &uri, err), err, "Could not parse the URI!")) return false;
+  if (rp_exit(!cws_uri_parse(raw_uri, &res->uri, err), err, "Could not parse the URI!")) return false;
 
-  res->uri = mman_ref(uri);
   return true;
 }
 
-static bool ps_http_version(char *req, size_t *offs, cws_request_head_t *res, char **err)
+static bool ps_http_version(char *req, size_t req_len, size_t *offs, cws_request_head_t *res, char **err)
 {
-  // Cut HTTP version
-  scptr char *raw_vers = partial_strdup(req, offs, "\n", false);
-  if (rp_exit(!raw_vers, err, "HTTP version missing!")) return false;
+  // Cut HTTP version, which makes up the rest of the line
+  strslice_t raw_vers = strslice_make(&req[*offs], req_len - *offs);
+  if (rp_exit(raw_vers.len == 0, err, "HTTP version missing!")) return false;
+  *offs = req_len;
 
   // Skip "HTTP/"
   size_t vers_offs = 0;
-  partial_strdup(raw_vers, &vers_offs, "/", true);
+  strslice_t protocol;
+  if (rp_exit(!ps_cut(raw_vers.ptr, raw_vers.len, &vers_offs, &ps_delim_slash, &protocol), err, "HTTP version missing!")) return false;
 
   // Cut major version
-  scptr char *vers_major_str = partial_strdup(raw_vers, &vers_offs, ".", false);
-  if (rp_exit(!vers_major_str, err, "Major HTTP version missing!")) return false;
+  strslice_t vers_major_str;
+  if (rp_exit(!ps_cut(raw_vers.ptr, raw_vers.len, &vers_offs, &ps_delim_dot, &vers_major_str), err, "Major HTTP version missing!")) return false;
 
   // Cut minor version
-  scptr char *vers_minor_str = partial_strdup(raw_vers, &vers_offs, "\n", false);
-  if (rp_exit(!vers_minor_str, err, "Minor HTTP version missing!")) return false;
+  strslice_t vers_minor_str = strslice_make(&raw_vers.ptr[vers_offs], raw_vers.len - vers_offs);
+  if (rp_exit(vers_minor_str.len == 0, err, "Minor HTTP version missing!")) return false;
 
   // Parse major/minor version
-  long vers_major = 0, vers_minor = 0;
+  unsigned long vers_major = 0, vers_minor = 0;
   if (rp_exit((
-    longp(&vers_major, vers_major_str, 10) != LONGP_SUCCESS ||
-    longp(&vers_minor, vers_minor_str, 10) != LONGP_SUCCESS),
+    !strslice_ulong(vers_major_str, &vers_major) ||
+    !strslice_ulong(vers_minor_str, &vers_minor)),
     err, "HTTP version major/minor non-numerical!"
   )) return false;
 
@@ -74,44 +131,45 @@ static bool ps_http_version(char *req, size_t *offs, cws_request_head_t *res, ch
   return true;
 }
 
-static bool ps_headers(char *req, size_t *offs, cws_request_head_t *res, char **err)
+static bool ps_header(strslice_t line, cws_request_head_t *res, char **err)
 {
-  // Create headers hash table
-  scptr htable_t *headers = htable_make(16, CWS_MAX_NUM_HEADERS, mman_dealloc);
+  // Split into key and value, based on first occurrence of ":"
+  size_t line_offs = 0;
+  strslice_t key;
+  if (rp_exit(
+    !ps_cut(line.ptr, line.len, &line_offs, &ps_delim_colon, &key) || key.len == 0,
+    err, "Malformed header!"
+  )) return false;
 
-  // Parse all available headers
-  char *curr_header;
-  while (
-    // Parse next header line
-    (curr_header = partial_strdup(req, offs, "\n", false)) &&
+  strslice_t value = ps_trim(strslice_make(&line.ptr[line_offs], line.len - line_offs));
 
-    // Stop when encountering an empty line
-    !(curr_header[0] == 0 || strcmp(curr_header, "\n") == 0 || strcmp(curr_header, "\r\n") == 0)
-  )
+  // Intern the first occurrence of well-known headers into their slot
+  cws_header_id_t id = cws_header_lookup(key);
+  if (id != CWS_HDR_UNKNOWN && !res->known_headers[id].ptr)
   {
-    // Split into key and value, based on first occurrence of ":"
-    size_t curr_header_offs = 0;
-    scptr char *header_key = partial_strdup(curr_header, &curr_header_offs, ": ", false);
-    scptr char *header_value = partial_strdup(curr_header, &curr_header_offs, "\n", false);
-    if (rp_exit(!header_key || !header_value, err, "Malformed header!")) return false;
-
-    // Insert into the hash table
-    htable_result_t ins_res = htable_insert(headers, header_key, mman_ref(header_value));
-    if (rp_exit(ins_res == HTABLE_KEY_ALREADY_EXISTS, err, "Duplicate header in request!")) return false;
-    if (rp_exit(ins_res == HTABLE_FULL, err, "Too many headers (max=%u)!", CWS_MAX_NUM_HEADERS)) return false;
-
-    mman_dealloc(curr_header);
+    res->known_headers[id] = value;
+    return true;
   }
 
-  res->headers = mman_ref(headers);
-  return true;
-}
+  // Repeated framing headers could be told apart differently by a proxy
+  // in front, which would allow for smuggling requests
+  if (id == CWS_HDR_CONTENT_LENGTH)
+  {
+    strslice_t *first = &res->known_headers[id];
+    if (rp_exit(
+      first->len != value.len || memcmp(first->ptr, value.ptr, value.len) != 0,
+      err, "Conflicting Content-Length headers!"
+    )) return false;
+  }
 
-static bool ps_body_part(char *req, size_t *offs, cws_request_head_t *res, char **err)
-{
-  // Just get the rest as the body
-  scptr char *body = partial_strdup(req, offs, "\0", false);
-  res->body_part = mman_ref(body);
+  if (rp_exit(id == CWS_HDR_TRANSFER_ENCODING, err, "Repeated Transfer-Encoding header!"))
+    return false;
+
+  // Everything else spills into the list
+  if (rp_exit(res->num_headers == CWS_MAX_NUM_HEADERS, err, "Too many headers (max=%lu)!", CWS_MAX_NUM_HEADERS))
+    return false;
+
+  res->headers[res->num_headers++] = (cws_header_t) { .key = key, .value = value };
   return true;
 }
 
@@ -121,27 +179,128 @@ static bool ps_body_part(char *req, size_t *offs, cws_request_head_t *res, char
 ============================================================================
 */
 
-cws_request_head_t *cws_request_head_parse(char *request, char **error_msg)
+/**
+ * @brief Parse the request line by running all of it's stages
+ */
+static bool ps_request_line(strslice_t line, cws_request_head_t *res, char **err)
 {
-  // Allocate an empty request
-  scptr cws_request_head_t *req = (cws_request_head_t *) mman_alloc(sizeof(cws_request_head_t), 1, cws_request_cleanup);
-
   // Register stages in the right order here
-  cws_head_parser_t parsing_stages[] = {
+  static const cws_head_parser_t parsing_stages[] = {
     ps_http_method,
     ps_uri,
-    ps_http_version,
-    ps_headers,
-    ps_body_part
+    ps_http_version
   };
 
   // Execute all stages
-  size_t req_offs = 0;
+  size_t line_offs = 0;
   size_t num_stages = sizeof(parsing_stages) / sizeof(cws_head_parser_t);
   for (size_t i = 0; i < num_stages; i++)
-    if (!parsing_stages[i](request, &req_offs, req, error_msg)) return NULL;
+    if (!parsing_stages[i](line.ptr, line.len, &line_offs, res, err)) return false;
 
-  return mman_ref(req);
+  return true;
+}
+
+cws_head_parse_result_t cws_request_head_feed(
+  cws_request_head_t *head,
+  char *data, size_t data_len, size_t max_len,
+  size_t *head_len, char **error_msg
+)
+{
+  // The data has been moved since the last feed
+  if (head->raw.ptr && head->raw.ptr != data) cws_request_head_rebase(head, data);
+  head->raw.ptr = data;
+
+  // Only look at what's allowed to belong to the head
+  size_t scan_len = data_len < max_len ? data_len : max_len;
+
+  // Parse line by line, resuming after the last complete line
+  while (head->part != CWS_HP_DONE)
+  {
+    // Don't search the part of the current line that's already been searched
+    size_t offs = head->raw.len;
+    size_t scan_from = head->scanned > offs ? head->scanned : offs;
+    char *lf = strscan_find(&data[scan_from], scan_len - scan_from, &ps_delim_lf);
+
+    // Line is incomplete, it either fits once more data arrives or never
+    if (!lf)
+    {
+      head->scanned = scan_len;
+      if (rp_exit(scan_len == max_len, error_msg, "The request head is too large (max=%lu)!", max_len))
+        return CWS_HEAD_TOO_LARGE;
+      return CWS_HEAD_INCOMPLETE;
+    }
+
+    // Cut the line without it's terminator
+    strslice_t line = strslice_make(&data[offs], lf - &data[offs]);
+    if (line.len > 0 && line.ptr[line.len - 1] == '\r') line.len--;
+    offs = lf - data + 1;
+
+    if (head->part == CWS_HP_REQUEST_LINE)
+    {
+      // Empty lines preceding the request line are ignored
+      if (line.len > 0)
+      {
+        if (!ps_request_line(line, head, error_msg)) return CWS_HEAD_MALFORMED;
+        head->part = CWS_HP_HEADERS;
+      }
+    }
+
+    // Empty line terminates the head
+    else if (line.len == 0) head->part = CWS_HP_DONE;
+
+    // Running out of space for headers is a matter of size
+    else if (!ps_header(line, head, error_msg))
+      return head->num_headers == CWS_MAX_NUM_HEADERS ? CWS_HEAD_TOO_LARGE : CWS_HEAD_MALFORMED;
+
+    head->raw.len = offs;
+  }
+
+  *head_len = head->raw.len;
+  return CWS_HEAD_COMPLETE;
+}
+
+bool cws_request_head_parse(char *request, size_t request_len, cws_request_head_t *head, char **error_msg)
+{
+  size_t head_len = 0;
+  cws_request_head_reset(head);
+  cws_head_parse_result_t res = cws_request_head_feed(head, request, request_len, request_len, &head_len, error_msg);
+  return !rp_exit(res == CWS_HEAD_INCOMPLETE, error_msg, "Incomplete request head!") && res == CWS_HEAD_COMPLETE;
+}
+
+void cws_request_head_rebase(cws_request_head_t *head, char *raw)
+{
+  char *old_raw = head->raw.ptr;
+
+  cws_uri_rebase(&head->uri, old_raw, raw);
+
+  for (size_t i = 0; i < CWS_HDR_UNKNOWN; i++)
+    strslice_rebase(&head->known_headers[i], old_raw, raw);
+
+  for (size_t i = 0; i < head->num_headers; i++)
+  {
+    strslice_rebase(&head->headers[i].key, old_raw, raw);
+    strslice_rebase(&head->headers[i].value, old_raw, raw);
+  }
+
+  head->raw.ptr = raw;
+}
+
+strslice_t *cws_request_head_known(cws_request_head_t *head, cws_header_id_t id)
+{
+  strslice_t *value = &head->known_headers[id];
+  return value->ptr ? value : NULL;
+}
+
+strslice_t *cws_request_head_header(cws_request_head_t *head, const char *name)
+{
+  // Well-known headers are only in the list if they occur repeatedly
+  cws_header_id_t id = cws_header_lookup(strslice_make((char *) name, strlen(name)));
+  if (id != CWS_HDR_UNKNOWN) return cws_request_head_known(head, id);
+
+  for (size_t i = 0; i < head->num_headers; i++)
+    if (strslice_eq_ci(head->headers[i].key, name)) return &head->headers[i].value;
+
+  return NULL;
 }
 
 /*
@@ -158,27 +317,22 @@ void cws_request_head_print(cws_request_head_t *request)
   printf("Method: %s\n", cws_http_method_stringify(request->method));
   printf("Version: HTTP/%ld.%ld\n", request->http_ver_major, request->http_ver_minor);
 
-  cws_uri_t *uri = request->uri;
-  if (uri)
+  cws_uri_t *uri = &request->uri;
+  printf("URI Raw: %.*s\n", (int) uri->raw_uri.len, uri->raw_uri.ptr);
+  printf("URI Path: %.*s\n", (int) uri->path.len, uri->path.ptr);
+  printf("URI Query: %.*s\n", (int) uri->query_string.len, uri->query_string.ptr);
+
+  printf("Headers:\n");
+  for (size_t i = 0; i < CWS_HDR_UNKNOWN; i++)
   {
-    printf("URI Raw: %s\n", request->uri->raw_uri);
-    printf("URI Path: %s\n", request->uri->path);
-    printf("URI Parameters:\n");
-    if (uri->query)
-    {
-      scptr char *res = htable_dump_hr(uri->query, (stringifier_t) dynarr_dump_hr_strs);
-      printf("%s", res);
-    }
-    else printf("URI parameters not parsed!\n");
+    strslice_t *value = cws_request_head_known(request, i);
+    if (value) printf("%s: %.*s\n", cws_header_name(i), (int) value->len, value->ptr);
   }
-  else printf("URI not parsed!\n");
 
-  printf("Headers:\n");
-  if (request->headers)
+  for (size_t i = 0; i < request->num_headers; i++)
   {
-    scptr char *res = htable_dump_hr(request->headers, NULL);
-    printf("%s", res);
+    cws_header_t *header = &request->headers[i];
+    printf("%.*s: %.*s\n", (int) header->key.len, header->key.ptr, (int) header->value.len, header->value.ptr);
   }
-  else printf("Headers not parsed!\n");
   printf("----------< HTTP Request Head >----------\n");
-}
\ No newline at end of file
+}
@@ -1,4 +1,175 @@
 #include "cws/cws_response.h"
+#include "cws/cws_encoding.h"
+
+/**
+ * @brief Whether the response answers a HEAD request, which is framed just like
+ * a GET response but never carries the body
+ */
+INLINED static bool cws_response_omits_body(cws_client_t *client)
+{
+  return client->head && client->head->part != CWS_HP_REQUEST_LINE && client->head->method == HEAD;
+}
+
+/*
+============================================================================
+                              Canned responses                              
+============================================================================
+*/
+
+// Error responses which are sent often enough to be serialized up front
+static const cws_response_code_t cws_response_canned_codes[] = {
+  STATUS_BAD_REQUEST,
+  STATUS_NOT_FOUND,
+  STATUS_PAYLOAD_TOO_LARGE,
+  STATUS_REQUEST_HEADER_FIELDS_TOO_LARGE,
+  STATUS_INTERNAL_SERVER_ERROR,
+  STATUS_SERVICE_UNAVAILABLE
+};
+
+#define CWS_RESPONSE_NUM_CANNED (sizeof(cws_response_canned_codes) / sizeof(cws_response_code_t))
+
+// Serialized responses by code and whether the connection persists, which
+// are split where the current Date line goes
+static char cws_response_canned[CWS_RESPONSE_NUM_CANNED][2][CWS_RESPONSE_CANNED_MAXLEN];
+static size_t cws_response_canned_lens[CWS_RESPONSE_NUM_CANNED][2];
+static size_t cws_response_canned_splits[CWS_RESPONSE_NUM_CANNED][2];
+static size_t cws_response_canned_head_lens[CWS_RESPONSE_NUM_CANNED][2];
+
+/**
+ * @brief Serialize all canned responses, runs before main
+ */
+__attribute__((constructor))
+static void cws_response_canned_make()
+{
+  for (size_t i = 0; i < CWS_RESPONSE_NUM_CANNED; i++)
+  {
+    cws_response_code_t code = cws_response_canned_codes[i];
+    char body[CWS_RESPONSE_CANNED_MAXLEN];
+    int body_len = snprintf(
+      body, sizeof(body),
+      "{" CRLF "\"error\": true," CRLF "\"message\": \"%s\"," CRLF "}",
+      cws_response_code_stringify(code)
+    );
+
+    for (int keep_alive = 0; keep_alive < 2; keep_alive++)
+    {
+      char *canned = cws_response_canned[i][keep_alive];
+      int split = snprintf(
+        canned, CWS_RESPONSE_CANNED_MAXLEN,
+        "HTTP/1.1 %d %s" CRLF
+        "Connection: %s" CRLF
+        "Content-Type: text/html" CRLF
+        "Server: " CWS_RESPONSE_SERVER CRLF,
+        code, cws_response_code_stringify(code),
+        keep_alive ? "keep-alive" : "close"
+      );
+
+      int head_len = split + snprintf(
+        &canned[split], CWS_RESPONSE_CANNED_MAXLEN - split,
+        "Content-Length: %d" CRLF
+        CRLF,
+        body_len
+      );
+
+      cws_response_canned_splits[i][keep_alive] = split;
+      cws_response_canned_head_lens[i][keep_alive] = head_len;
+      cws_response_canned_lens[i][keep_alive] = head_len + snprintf(
+        &canned[head_len], CWS_RESPONSE_CANNED_MAXLEN - head_len,
+        "%s",
+        body
+      );
+    }
+  }
+}
+
+bool cws_response_send_canned(cws_client_t *client, cws_response_code_t code)
+{
+  for (size_t i = 0; i < CWS_RESPONSE_NUM_CANNED; i++)
+  {
+    if (cws_response_canned_codes[i] != code) continue;
+
+    int keep_alive = client->keep_alive ? 1 : 0;
+    char *canned = cws_response_canned[i][keep_alive];
+    size_t split = cws_response_canned_splits[i][keep_alive];
+    size_t len = cws_response_omits_body(client)
+      ? cws_response_canned_head_lens[i][keep_alive]
+      : cws_response_canned_lens[i][keep_alive];
+
+    struct iovec iov[] = {
+      { .iov_base = canned, .iov_len = split },
+      { .iov_base = (char *) cws_clock_date_line(), .iov_len = CWS_CLOCK_DATE_LINE_LEN },
+      { .iov_base = &canned[split], .iov_len = len - split }
+    };
+
+    // Written right behind the queued responses, only what the socket doesn't
+    // take is copied, as a queued write may outlive the clock's slot
+    return cws_client_flush(client) && cws_client_writev(client, iov, 3);
+  }
+
+  return false;
+}
+
+/*
+============================================================================
+                                  Response                                  
+============================================================================
+*/
+
+// Names of the required headers
+static const char *cws_response_required_names[CWS_RH_COUNT] = {
+  [CWS_RH_CONNECTION] = "Connection",
+  [CWS_RH_KEEP_ALIVE] = "Keep-Alive",
+  [CWS_RH_CONTENT_LENGTH] = "Content-Length",
+  [CWS_RH_CONTENT_TYPE] = "Content-Type",
+  [CWS_RH_SERVER] = "Server",
+  [CWS_RH_DATE] = "Date"
+};
+
+// Required headers which frame the response and thus can't be overridden
+#define CWS_RH_FRAMING ((1U << CWS_RH_CONNECTION) | (1U << CWS_RH_KEEP_ALIVE) | (1U << CWS_RH_CONTENT_LENGTH))
+
+void cws_response_init(cws_response_t *response)
+{
+  response->num_headers = 0;
+  response->lines = strslice_make(NULL, 0);
+  response->resource = strslice_make(NULL, 0);
+  response->overridden = 0;
+}
+
+bool cws_response_add_header(cws_response_t *response, const char *key, const char *value)
+{
+  strslice_t key_slice = strslice_make((char *) key, strlen(key));
+
+  for (cws_response_required_t req = 0; req < CWS_RH_COUNT; req++)
+  {
+    if (!strslice_eq_ci(key_slice, cws_response_required_names[req])) continue;
+    if (CWS_RH_FRAMING & (1U << req)) return false;
+    response->overridden |= 1U << req;
+    break;
+  }
+
+  if (response->num_headers == CWS_RESPONSE_MAX_HEADERS) return false;
+
+  response->headers[response->num_headers++] = (cws_header_t) {
+    .key = key_slice,
+    .value = strslice_make((char *) value, strlen(value))
+  };
+  return true;
+}
+
+bool cws_response_set_lines(cws_response_t *response, const char *lines, size_t len, unsigned int overrides)
+{
+  if (overrides & CWS_RH_FRAMING) return false;
+
+  response->lines = strslice_make((char *) lines, len);
+  response->overridden |= overrides;
+  return true;
+}
+
+void cws_response_set_resource(cws_response_t *response, const char *resource, size_t len)
+{
+  response->resource = strslice_make((char *) resource, len);
+}
 
 /*
 ============================================================================
@@ -6,122 +177,141 @@
 ============================================================================
 */
 
-bool rb_status_line (
-  cws_client_t *client,
-  cws_response_code_t code,
-  htable_t *headers,
-  htable_t *header_buf,
-  char *body,
-  size_t *offs,
-  char **response
-)
+/**
+ * @brief Append raw bytes to the head, growing it's buffer as needed
+ */
+static bool rb_append(char **head, size_t *offs, const char *data, size_t len)
 {
-  // Stringify and check the status-code
-  const char *code_str = cws_response_code_stringify(code);
-  if (!code_str) return false;
+  size_t cap = mman_fetch_meta(*head)->num_blocks;
+  if (*offs + len + 1 > cap && !mman_realloc((void **) head, sizeof(char), (*offs + len + 1) * 2)) return false;
 
-  // Append status line
-  strfmt(response, offs, "HTTP/1.1 %d %s" CRLF, code, code_str);
+  memcpy(&(*head)[*offs], data, len);
+  *offs += len;
+  (*head)[*offs] = 0;
   return true;
 }
 
-bool rb_headers_append(
+/**
+ * @brief Append an unsigned number in decimal notation to the head
+ */
+static bool rb_append_ulong(char **head, size_t *offs, unsigned long value)
+{
+  char digits[20];
+  size_t num_digits = 0;
+
+  do {
+    digits[sizeof(digits) - ++num_digits] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+
+  return rb_append(head, offs, &digits[sizeof(digits) - num_digits], num_digits);
+}
+
+/**
+ * @brief Append a header line to the head
+ */
+static bool rb_append_header(char **head, size_t *offs, const char *key, size_t key_len, const char *value, size_t value_len)
+{
+  return (
+    rb_append(head, offs, key, key_len)
+    && rb_append(head, offs, ": ", 2)
+    && rb_append(head, offs, value, value_len)
+    && rb_append(head, offs, CRLF, 2)
+  );
+}
+
+/**
+ * @brief Append a header line with a string literal as it's value
+ */
+#define rb_append_literal(head, offs, key, value) \
+  rb_append_header(head, offs, key, sizeof(key) - 1, value, sizeof(value) - 1)
+
+bool rb_status_line (
   cws_client_t *client,
   cws_response_code_t code,
-  htable_t *headers,
-  htable_t *header_buf,
-  char *body,
+  cws_response_t *response,
+  size_t body_len,
   size_t *offs,
-  char **response
+  char **head
 )
 {
-  // List all available header keys
-  char **keys;
-  htable_list_keys(header_buf, &keys);
-
-  // Loop all keys
-  for (char **key = keys; *key; key++)
-  {
-    // Get the corresponding value
-    char *value;
-    if (htable_fetch(header_buf, *key, (void **) &value) != HTABLE_SUCCESS) return false;
-
-    // Append to the response
-    strfmt(response, offs, "%s: %s" CRLF, *key, value);
-  }
+  // Look up and check the preformatted status line
+  size_t line_len;
+  const char *line = cws_response_status_line(code, &line_len);
+  if (!line) return false;
 
-  return true;
+  return rb_append(head, offs, line, line_len);
 }
 
 bool rb_headers_required(
   cws_client_t *client,
   cws_response_code_t code,
-  htable_t *headers,
-  htable_t *header_buf,
-  char *body,
+  cws_response_t *response,
+  size_t body_len,
   size_t *offs,
-  char **response
+  char **head
 )
 {
-  // Determine the length of the body
-  size_t body_len = body ? strlen(body) : 0;
+  unsigned int overridden = response ? response->overridden : 0;
 
-  // Insert all required headers
-  if (htable_insert(header_buf, "Connection", strfmt_direct("Closed")) != HTABLE_SUCCESS) return false;
-  if (htable_insert(header_buf, "Content-Type", strfmt_direct("text/html")) != HTABLE_SUCCESS) return false;
-  if (htable_insert(header_buf, "Server", strfmt_direct("cWebSrv/0.0.1")) != HTABLE_SUCCESS) return false;
-  if (htable_insert(header_buf, "Content-Length", strfmt_direct("%lu", body_len)) != HTABLE_SUCCESS) return false;
+  if (client->keep_alive)
+  {
+    // Inform about the persistent connection's limits
+    if (!rb_append_literal(head, offs, "Connection", "keep-alive")) return false;
+    if (!rb_append(head, offs, "Keep-Alive: timeout=", 20)) return false;
+    if (!rb_append_ulong(head, offs, CWS_KEEPALIVE_TIMEOUT_MS / 1000)) return false;
+    if (!rb_append(head, offs, ", max=", 6)) return false;
+    if (!rb_append_ulong(head, offs, CWS_KEEPALIVE_MAX_REQUESTS - client->num_requests)) return false;
+    if (!rb_append(head, offs, CRLF, 2)) return false;
+  }
+  else if (!rb_append_literal(head, offs, "Connection", "close")) return false;
 
-  return true;
+  if (!(overridden & (1U << CWS_RH_CONTENT_TYPE)) && !rb_append_literal(head, offs, "Content-Type", "text/html")) return false;
+  if (!(overridden & (1U << CWS_RH_SERVER)) && !rb_append_literal(head, offs, "Server", CWS_RESPONSE_SERVER)) return false;
+  if (!(overridden & (1U << CWS_RH_DATE)) && !rb_append(head, offs, cws_clock_date_line(), CWS_CLOCK_DATE_LINE_LEN)) return false;
+
+  // Responses which never carry a body aren't framed by it's length
+  if (code == STATUS_NO_CONTENT || code == STATUS_NOT_MODIFIED) return true;
+
+  return (
+    rb_append(head, offs, "Content-Length: ", 16)
+    && rb_append_ulong(head, offs, body_len)
+    && rb_append(head, offs, CRLF, 2)
+  );
 }
 
 bool rb_headers_additional(
   cws_client_t *client,
   cws_response_code_t code,
-  htable_t *headers,
-  htable_t *header_buf,
-  char *body,
+  cws_response_t *response,
+  size_t body_len,
   size_t *offs,
-  char **response
+  char **head
 )
 {
   // No additional headers desired
-  if (!headers) return true;
+  if (!response) return true;
 
-  // Append all additional headers to the buffer, skip duplicates (predefineds are not changable)
-  if (htable_append_table(header_buf, headers, HTABLE_AM_SKIP) != HTABLE_SUCCESS) return false;
+  for (size_t i = 0; i < response->num_headers; i++)
+  {
+    cws_header_t *header = &response->headers[i];
+    if (!rb_append_header(head, offs, header->key.ptr, header->key.len, header->value.ptr, header->value.len)) return false;
+  }
 
-  return true;
+  return response->lines.len == 0 || rb_append(head, offs, response->lines.ptr, response->lines.len);
 }
 
 bool rb_empty_line(
   cws_client_t *client,
   cws_response_code_t code,
-  htable_t *headers,
-  htable_t *header_buf,
-  char *body,
+  cws_response_t *response,
+  size_t body_len,
   size_t *offs,
-  char **response
+  char **head
 )
 {
   // Just add an empty line
-  strfmt(response, offs, CRLF);
-  return true;
-}
-
-bool rb_body(
-  cws_client_t *client,
-  cws_response_code_t code,
-  htable_t *headers,
-  htable_t *header_buf,
-  char *body,
-  size_t *offs,
-  char **response
-)
-{
-  // Just add the body
-  if (body) strfmt(response, offs, "%s", body);
-  return true;
+  return rb_append(head, offs, CRLF, 2);
 }
 
 /*
@@ -130,44 +320,230 @@ bool rb_body(
 ============================================================================
 */
 
-bool cws_response_send(
+/**
+ * @brief Build the response's head by running all stages
+ * 
+ * @param client Recipient reference
+ * @param code HTTP status code
+ * @param response Additional headers, NULL for none
+ * @param body_len Length of the body which follows the head
+ * @param head_len Length of the head output buffer
+ * @return char* Managed head, NULL on errors
+ */
+static char *cws_response_build_head(
   cws_client_t *client,
   cws_response_code_t code,
-  htable_t *headers,
-  char *body
+  cws_response_t *response,
+  size_t body_len,
+  size_t *head_len
 )
 {
-  // Allocate some space for the message to be built
-  scptr char *message = mman_alloc(sizeof(char), CWS_RESPONSE_BUFFER, NULL);
-  size_t message_offs = 0;
+  // Allocate some space for the head to be built
+  scptr char *head = mman_alloc(sizeof(char), CWS_RESPONSE_BUFFER, NULL);
+  size_t head_offs = 0;
 
   // Register stages in the right order here
   cws_response_builder_t building_stages[] = {
     rb_status_line,
     rb_headers_required,
     rb_headers_additional,
-    rb_headers_append,
-    rb_empty_line,
-    rb_body
+    rb_empty_line
   };
 
   // Execute all stages
-  scptr htable_t *header_buf = htable_make(8, CWS_RESPONSE_MAX_HEADERS, mman_dealloc);
   size_t num_stages = sizeof(building_stages) / sizeof(cws_response_builder_t);
   for (size_t i = 0; i < num_stages; i++)
   {
     if (!building_stages[i](
       client,
       code,
-      headers,
-      header_buf,
-      body,
-      &message_offs,
-      &message
-    )) return false;
+      response,
+      body_len,
+      &head_offs,
+      &head
+    )) return NULL;
   }
 
-  // Send the finished message to the client
-  send(client->descriptor, message, strlen(message), 0);
-  return true;
+  *head_len = head_offs;
+  return mman_ref(head);
+}
+
+/**
+ * @brief Find a header the caller has added to a response
+ * 
+ * @param response Response to search in
+ * @param key Name of the header
+ * @return cws_header_t* Header, NULL if it hasn't been added
+ */
+static cws_header_t *cws_response_find_header(cws_response_t *response, const char *key)
+{
+  for (size_t i = 0; i < response->num_headers; i++)
+    if (strslice_eq_ci(response->headers[i].key, key)) return &response->headers[i];
+  return NULL;
+}
+
+/**
+ * @brief Compress a body if it's worth it and the client accepts it, the
+ * caller's headers are copied and extended by the encoding's headers
+ * 
+ * @param client Recipient
+ * @param code HTTP status code
+ * @param response Caller defined headers, NULL for none, replaced by the copy
+ * @param body Body to compress
+ * @param body_len Length of the body, replaced by the compressed length
+ * @param encoded Output for the copied headers
+ * @param etag Buffer of CWS_ETAG_MAXLEN bytes for a weakened entity tag
+ * @return char* Managed compressed body, NULL if the body is sent as it is
+ */
+static char *cws_response_encode(
+  cws_client_t *client,
+  cws_response_code_t code,
+  cws_response_t **response,
+  char *body,
+  size_t *body_len,
+  cws_response_t *encoded,
+  char *etag
+)
+{
+  if (
+    *body_len < CWS_ENCODING_MIN_LEN
+    || code == STATUS_NO_CONTENT || code == STATUS_PARTIAL_CONTENT || code == STATUS_NOT_MODIFIED
+    || !client->head || client->head->part != CWS_HP_DONE
+  ) return NULL;
+
+  if (*response) *encoded = **response;
+  else cws_response_init(encoded);
+
+  // Already encoded by the caller, or no room for the encoding's headers
+  if (cws_response_find_header(encoded, "Content-Encoding") || encoded->num_headers + 2 > CWS_RESPONSE_MAX_HEADERS) return NULL;
+
+  cws_header_t *type = cws_response_find_header(encoded, "Content-Type");
+  if (!cws_encoding_compressible(type ? type->value : strslice_make("text/html", 9))) return NULL;
+
+  // Caches have to tell the variants apart, no matter which one is sent
+  cws_response_add_header(encoded, "Vary", "Accept-Encoding");
+  *response = encoded;
+
+  cws_encoding_t encoding = cws_encoding_negotiate(client->head);
+  if (encoding == CWS_ENCODING_IDENTITY) return NULL;
+
+  // Tags set by handlers are not unique across resources, so bodies are only
+  // cached for responses which name their resource, strong tags no longer
+  // match byte for byte once compressed and are thus weakened
+  cws_header_t *tag = cws_response_find_header(encoded, "ETag");
+  strslice_t strong = strslice_make(NULL, 0);
+  if (tag && tag->value.len > 0 && *tag->value.ptr == '"')
+  {
+    if (tag->value.len + 2 >= CWS_ETAG_MAXLEN) return NULL;
+
+    strong = tag->value;
+    memcpy(etag, "W/", 2);
+    memcpy(&etag[2], strong.ptr, strong.len);
+    tag->value = strslice_make(etag, strong.len + 2);
+  }
+
+  size_t encoded_len;
+  scptr char *encoded_body = (
+    strong.len > 0 && encoded->resource.len > 0
+    ? cws_encoding_variant(encoded->resource, strong, encoding, body, *body_len, &encoded_len)
+    : cws_encoding_compress(encoding, body, *body_len, &encoded_len)
+  );
+  if (!encoded_body)
+  {
+    if (strong.len > 0) tag->value = strong;
+    return NULL;
+  }
+
+  cws_response_add_header(encoded, "Content-Encoding", cws_encoding_name(encoding));
+  *body_len = encoded_len;
+  return mman_ref(encoded_body);
+}
+
+/**
+ * @brief Build the response's head and send it, followed by the body
+ * 
+ * @param client Recipient reference
+ * @param code HTTP status code
+ * @param response Additional headers, NULL for none
+ * @param body Body contents, NULL for none
+ * @param body_len Length of the body
+ * @param body_managed Whether the body is a managed buffer which may be referenced
+ * until it's written, other bodies are copied if they can't be written right away
+ */
+static bool cws_response_write(
+  cws_client_t *client,
+  cws_response_code_t code,
+  cws_response_t *response,
+  char *body,
+  size_t body_len,
+  bool body_managed
+)
+{
+  // Answers to HEAD requests announce the body's length, but leave it out
+  if (cws_response_omits_body(client)) return cws_response_send_head(client, code, response, body_len);
+
+  // Compressed bodies are managed, so they're never copied
+  cws_response_t encoded;
+  char etag[CWS_ETAG_MAXLEN];
+  scptr char *encoded_body = cws_response_encode(client, code, &response, body, &body_len, &encoded, etag);
+  if (encoded_body)
+  {
+    body = encoded_body;
+    body_managed = true;
+  }
+
+  size_t head_len;
+  scptr char *head = cws_response_build_head(client, code, response, body_len, &head_len);
+  if (!head) return false;
+
+  // A queued body has to outlive the caller's buffer, copy it behind the head
+  if (client->corked && !body_managed && body_len > 0)
+  {
+    if (!mman_realloc((void **) &head, sizeof(char), head_len + body_len)) return false;
+    memcpy(&head[head_len], body, body_len);
+    return cws_client_send(client, head, head_len + body_len);
+  }
+
+  // Write the head along with the body, or queue both up by reference
+  struct iovec iov[] = {
+    { .iov_base = head, .iov_len = head_len },
+    { .iov_base = body, .iov_len = body_len }
+  };
+  return cws_client_sendv(client, iov, body_len > 0 ? 2 : 1);
+}
+
+bool cws_response_send(
+  cws_client_t *client,
+  cws_response_code_t code,
+  cws_response_t *response,
+  char *body
+)
+{
+  return cws_response_write(client, code, response, body, body ? strlen(body) : 0, false);
+}
+
+bool cws_response_send_buf(
+  cws_client_t *client,
+  cws_response_code_t code,
+  cws_response_t *response,
+  char *body,
+  size_t body_len
+)
+{
+  return cws_response_write(client, code, response, body, body_len, true);
+}
+
+
+bool cws_response_send_head(
+  cws_client_t *client,
+  cws_response_code_t code,
+  cws_response_t *response,
+  size_t body_len
+)
+{
+  size_t head_len;
+  scptr char *head = cws_response_build_head(client, code, response, body_len, &head_len);
+  if (!head) return false;
+
+  return cws_client_send(client, head, head_len);
 }
\ No newline at end of file
@@ -102,4 +102,37 @@ const char *cws_response_code_stringify(cws_response_code_t code)
   if (code < 0 || code >= cws_response_code_str_len)
     return NULL;
   return cws_response_code_str[code];
+}
+
+// Status lines of all codes, NULL where there is no code
+static char *cws_response_status_lines[sizeof(cws_response_code_str) / sizeof(char *)];
+static size_t cws_response_status_line_lens[sizeof(cws_response_code_str) / sizeof(char *)];
+
+/**
+ * @brief Format the status lines of all codes, runs before main
+ */
+__attribute__((constructor))
+static void cws_response_status_lines_make()
+{
+  static char lines[sizeof(cws_response_code_str) / sizeof(char *)][CWS_RESPONSE_STATUS_LINE_MAXLEN];
+
+  for (size_t code = 0; code < cws_response_code_str_len; code++)
+  {
+    if (!cws_response_code_str[code]) continue;
+
+    cws_response_status_lines[code] = lines[code];
+    cws_response_status_line_lens[code] = snprintf(
+      lines[code], CWS_RESPONSE_STATUS_LINE_MAXLEN,
+      "HTTP/1.1 %lu %s" CRLF, code, cws_response_code_str[code]
+    );
+  }
+}
+
+const char *cws_response_status_line(cws_response_code_t code, size_t *len)
+{
+  if (code < 0 || code >= cws_response_code_str_len || !cws_response_status_lines[code])
+    return NULL;
+
+  *len = cws_response_status_line_lens[code];
+  return cws_response_status_lines[code];
 }
\ No newline at end of file
@@ -0,0 +1,577 @@
+#include "cws/cws_router.h"
+
+/*
+============================================================================
+                                   Nodes                                    
+============================================================================
+*/
+
+/**
+ * @brief Clean up a router node and it's whole subtree
+ */
+static void cws_router_node_cleanup(mman_meta_t *ref)
+{
+  cws_router_node_t *node = (cws_router_node_t *) ref->ptr;
+
+  for (size_t i = 0; i < node->num_children; i++)
+    mman_dealloc(node->children[i]);
+
+  mman_dealloc(node->children);
+  mman_dealloc(node->indices);
+  mman_dealloc(node->param_child);
+  mman_dealloc(node->wildcard_child);
+  mman_dealloc(node->prefix);
+}
+
+/**
+ * @brief Create a node without any children or routes
+ */
+static cws_router_node_t *cws_router_node_make(const char *prefix, size_t prefix_len)
+{
+  cws_router_node_t *node = (cws_router_node_t *) mman_alloc(sizeof(cws_router_node_t), 1, cws_router_node_cleanup);
+  memset(node, 0, sizeof(cws_router_node_t));
+
+  node->prefix = strslice_dup(strslice_make((char *) prefix, prefix_len));
+  node->prefix_len = prefix_len;
+  return node;
+}
+
+/**
+ * @brief Find the static child whose prefix starts with a character
+ */
+INLINED static cws_router_node_t *cws_router_node_child(cws_router_node_t *node, char c)
+{
+  if (node->num_children == 0) return NULL;
+  char *index = memchr(node->indices, c, node->num_children);
+  return index ? node->children[index - node->indices] : NULL;
+}
+
+/**
+ * @brief Attach a static child, taking over the reference
+ */
+static void cws_router_node_attach(cws_router_node_t *node, cws_router_node_t *child)
+{
+  size_t num = node->num_children + 1;
+
+  if (!node->children)
+  {
+    node->children = (cws_router_node_t **) mman_alloc(sizeof(cws_router_node_t *), num, NULL);
+    node->indices = (char *) mman_alloc(sizeof(char), num, NULL);
+  }
+  else
+  {
+    mman_realloc((void **) &node->children, sizeof(cws_router_node_t *), num);
+    mman_realloc((void **) &node->indices, sizeof(char), num);
+  }
+
+  node->children[node->num_children] = child;
+  node->indices[node->num_children] = child->prefix[0];
+  node->num_children = num;
+}
+
+/**
+ * @brief Split a child's prefix after it's first len characters by putting
+ * a new node holding the common part in between the child and it's parent
+ */
+static cws_router_node_t *cws_router_node_split(cws_router_node_t *parent, cws_router_node_t *child, size_t len)
+{
+  cws_router_node_t *middle = cws_router_node_make(child->prefix, len);
+
+  // Shorten the child's prefix to what follows the common part
+  scptr char *rest = strslice_dup(strslice_make(&child->prefix[len], child->prefix_len - len));
+  mman_dealloc(child->prefix);
+  child->prefix = mman_ref(rest);
+  child->prefix_len -= len;
+
+  // Swap the middle node in for the child, the index character stays the same
+  for (size_t i = 0; i < parent->num_children; i++)
+    if (parent->children[i] == child) parent->children[i] = middle;
+
+  cws_router_node_attach(middle, child);
+  return middle;
+}
+
+/**
+ * @brief Deep copy a node and it's whole subtree
+ */
+static cws_router_node_t *cws_router_node_clone(cws_router_node_t *node)
+{
+  if (!node) return NULL;
+
+  cws_router_node_t *clone = cws_router_node_make(node->prefix, node->prefix_len);
+  memcpy(clone->routes, node->routes, sizeof(node->routes));
+  clone->methods = node->methods;
+
+  for (size_t i = 0; i < node->num_children; i++)
+    cws_router_node_attach(clone, cws_router_node_clone(node->children[i]));
+
+  clone->param_child = cws_router_node_clone(node->param_child);
+  clone->wildcard_child = cws_router_node_clone(node->wildcard_child);
+  return clone;
+}
+
+/*
+============================================================================
+                                   Tables                                   
+============================================================================
+*/
+
+/**
+ * @brief Clean up a table that's no longer reachable by any request
+ */
+static void cws_route_table_cleanup(mman_meta_t *ref)
+{
+  mman_dealloc(((cws_route_table_t *) ref->ptr)->root);
+}
+
+/**
+ * @brief Create a table, taking over the root node
+ */
+static cws_route_table_t *cws_route_table_make(cws_router_node_t *root)
+{
+  cws_route_table_t *table = (cws_route_table_t *) mman_alloc(sizeof(cws_route_table_t), 1, cws_route_table_cleanup);
+  table->root = root;
+  return table;
+}
+
+/*
+============================================================================
+                                    Pins                                    
+============================================================================
+*/
+
+// Pin of the current thread, released as it exits
+static __thread cws_route_pin_t *cws_route_pin_local = NULL;
+static pthread_key_t cws_route_pin_key;
+static pthread_once_t cws_route_pin_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Clean up a pin nobody uses anymore, letting go of it's table
+ */
+static void cws_route_pin_cleanup(mman_meta_t *ref)
+{
+  scptr cws_route_table_t *table = ((cws_route_pin_t *) ref->ptr)->table;
+}
+
+/**
+ * @brief Stop using a pin, the last user frees it
+ */
+static void cws_route_pin_drop(void *pin)
+{
+  if (pin && atomic_decrement(&((cws_route_pin_t *) pin)->users) == 0) mman_dealloc(pin);
+}
+
+static void cws_route_pin_key_make()
+{
+  pthread_key_create(&cws_route_pin_key, cws_route_pin_drop);
+}
+
+/**
+ * @brief Replace the current thread's pin by one on the router's current table,
+ * the table is loaded within a section, so it can't be freed before it's referenced
+ * 
+ * @return cws_route_pin_t* New pin, already used by the caller
+ */
+static cws_route_pin_t *cws_route_pin_renew(cws_router_t *router)
+{
+  pthread_once(&cws_route_pin_once, cws_route_pin_key_make);
+
+  epoch_slot_t *section = epoch_enter();
+  cws_route_table_t *table = mman_ref(__atomic_load_n(&router->table, __ATOMIC_SEQ_CST));
+  epoch_leave(section);
+
+  cws_route_pin_t *pin = (cws_route_pin_t *) mman_alloc(sizeof(cws_route_pin_t), 1, cws_route_pin_cleanup);
+  pin->table = table;
+  pin->users = 2;
+
+  // Matches which still use the previous pin keep it alive
+  cws_route_pin_drop(cws_route_pin_local);
+  cws_route_pin_local = pin;
+  pthread_setspecific(cws_route_pin_key, pin);
+  return pin;
+}
+
+/**
+ * @brief Use the current thread's pin on the router's current table
+ */
+INLINED static cws_route_pin_t *cws_route_pin_use(cws_router_t *router)
+{
+  // The table can only be equal to the pinned one while the pin keeps it alive
+  cws_route_table_t *table = __atomic_load_n(&router->table, __ATOMIC_ACQUIRE);
+  cws_route_pin_t *pin = cws_route_pin_local;
+  if (!pin || pin->table != table) return cws_route_pin_renew(router);
+
+  atomic_increment(&pin->users);
+  return pin;
+}
+
+/*
+============================================================================
+                                   Router                                   
+============================================================================
+*/
+
+/**
+ * @brief Clean up a router that's about to be destroyed
+ */
+static void cws_router_cleanup(mman_meta_t *ref)
+{
+  cws_router_t *router = (cws_router_t *) ref->ptr;
+
+  // Pins of threads which routed with the table keep it alive
+  scptr cws_route_table_t *table = router->table;
+  pthread_mutex_destroy(&router->write_lock);
+}
+
+cws_router_t *cws_router_make()
+{
+  cws_router_t *router = (cws_router_t *) mman_alloc(sizeof(cws_router_t), 1, cws_router_cleanup);
+  router->table = cws_route_table_make(cws_router_node_make("", 0));
+  pthread_mutex_init(&router->write_lock, NULL);
+  return router;
+}
+
+/**
+ * @brief Start changing the routes by copying the current table, writers
+ * stay serialized until the copy is published or dropped
+ */
+static cws_route_table_t *cws_router_begin_write(cws_router_t *router)
+{
+  pthread_mutex_lock(&router->write_lock);
+  return cws_route_table_make(cws_router_node_clone(router->table->root));
+}
+
+/**
+ * @brief Finish changing the routes, publishing the changed copy
+ * 
+ * @param router Router to publish on
+ * @param table Changed copy, NULL to drop the changes
+ */
+static void cws_router_end_write(cws_router_t *router, cws_route_table_t *table)
+{
+  if (table)
+  {
+    // Requests routed from now on see the new table, the old one lives on
+    // until all requests which have been routed with it are done
+    cws_route_table_t *prev = __atomic_exchange_n(&router->table, table, __ATOMIC_SEQ_CST);
+    epoch_retire(prev);
+  }
+
+  pthread_mutex_unlock(&router->write_lock);
+}
+
+/**
+ * @brief Length of the static part of a pattern, up to the first segment
+ * which is a parameter or a wildcard
+ */
+INLINED static size_t cws_router_static_len(const char *pattern)
+{
+  size_t len = 0;
+  while (pattern[len] && !((pattern[len] == ':' || pattern[len] == '*') && len > 0 && pattern[len - 1] == '/'))
+    len++;
+  return len;
+}
+
+/**
+ * @brief Insert a route into a tree
+ */
+static bool cws_router_node_insert(
+  cws_router_node_t *root,
+  cws_http_method_t method,
+  const char *pattern,
+  cws_route_t route,
+  char **error_msg
+)
+{
+  if (rp_exit(pattern[0] != '/', error_msg, "Route patterns have to start with a slash!")) return false;
+
+  cws_router_node_t *node = root;
+  size_t num_params = 0;
+
+  while (*pattern)
+  {
+    // Parameter capturing the whole segment
+    if (*pattern == ':')
+    {
+      size_t name_len = strcspn(pattern + 1, "/");
+      if (rp_exit(name_len == 0, error_msg, "Unnamed route parameter!")) return false;
+      if (rp_exit(++num_params > CWS_ROUTER_MAX_PARAMS, error_msg, "Too many route parameters (max=%d)!", CWS_ROUTER_MAX_PARAMS)) return false;
+
+      // Only one parameter can be in this place, regardless of the route
+      if (!node->param_child) node->param_child = cws_router_node_make(pattern + 1, name_len);
+      else if (rp_exit(
+        node->param_child->prefix_len != name_len || strncmp(node->param_child->prefix, pattern + 1, name_len) != 0,
+        error_msg, "Conflicting route parameter names!"
+      )) return false;
+
+      node = node->param_child;
+      pattern += name_len + 1;
+      continue;
+    }
+
+    // Wildcard capturing the rest of the path
+    if (*pattern == '*')
+    {
+      size_t name_len = strlen(pattern + 1);
+      if (rp_exit(name_len == 0, error_msg, "Unnamed route wildcard!")) return false;
+      if (rp_exit(strchr(pattern + 1, '/') != NULL, error_msg, "Wildcards have to be the last segment!")) return false;
+      if (rp_exit(++num_params > CWS_ROUTER_MAX_PARAMS, error_msg, "Too many route parameters (max=%d)!", CWS_ROUTER_MAX_PARAMS)) return false;
+
+      if (!node->wildcard_child) node->wildcard_child = cws_router_node_make(pattern + 1, name_len);
+      else if (rp_exit(
+        node->wildcard_child->prefix_len != name_len || strncmp(node->wildcard_child->prefix, pattern + 1, name_len) != 0,
+        error_msg, "Conflicting route wildcard names!"
+      )) return false;
+
+      node = node->wildcard_child;
+      pattern += name_len + 1;
+      continue;
+    }
+
+    // Static part, shares it's common prefix with an existing child
+    size_t static_len = cws_router_static_len(pattern);
+    cws_router_node_t *child = cws_router_node_child(node, *pattern);
+    if (!child)
+    {
+      child = cws_router_node_make(pattern, static_len);
+      cws_router_node_attach(node, child);
+      node = child;
+      pattern += static_len;
+      continue;
+    }
+
+    size_t common = 0;
+    while (common < static_len && common < child->prefix_len && child->prefix[common] == pattern[common])
+      common++;
+
+    if (common < child->prefix_len) child = cws_router_node_split(node, child, common);
+    node = child;
+    pattern += common;
+  }
+
+  if (rp_exit(node->methods & (1U << method), error_msg, "Duplicate route!")) return false;
+  node->routes[method] = route;
+  node->methods |= 1U << method;
+  return true;
+}
+
+/**
+ * @brief Find the node a pattern terminates at, without changing the tree
+ * 
+ * @return cws_router_node_t* Node of the pattern, NULL if there is none
+ */
+static cws_router_node_t *cws_router_node_find(cws_router_node_t *node, const char *pattern)
+{
+  while (node && *pattern)
+  {
+    if (*pattern == ':' || *pattern == '*')
+    {
+      cws_router_node_t *child = *pattern == ':' ? node->param_child : node->wildcard_child;
+      size_t name_len = strcspn(pattern + 1, "/");
+      if (!child || child->prefix_len != name_len || strncmp(child->prefix, pattern + 1, name_len) != 0) return NULL;
+
+      node = child;
+      pattern += name_len + 1;
+      continue;
+    }
+
+    // Static parts may span multiple nodes, but never end within one
+    cws_router_node_t *child = cws_router_node_child(node, *pattern);
+    if (!child || strncmp(child->prefix, pattern, child->prefix_len) != 0) return NULL;
+    if (child->prefix_len > cws_router_static_len(pattern)) return NULL;
+
+    node = child;
+    pattern += child->prefix_len;
+  }
+
+  return node;
+}
+
+bool cws_router_add(
+  cws_router_t *router,
+  cws_http_method_t method,
+  const char *pattern,
+  cws_route_t route,
+  char **error_msg
+)
+{
+  cws_route_table_t *table = cws_router_begin_write(router);
+
+  if (!cws_router_node_insert(table->root, method, pattern, route, error_msg))
+  {
+    mman_dealloc(table);
+    table = NULL;
+  }
+
+  cws_router_end_write(router, table);
+  return table != NULL;
+}
+
+bool cws_router_add_all(
+  cws_router_t *router,
+  const cws_route_def_t *defs,
+  size_t num_defs,
+  char **error_msg
+)
+{
+  cws_route_table_t *table = cws_router_begin_write(router);
+
+  for (size_t i = 0; i < num_defs; i++)
+  {
+    if (cws_router_node_insert(table->root, defs[i].method, defs[i].pattern, defs[i].route, error_msg)) continue;
+
+    mman_dealloc(table);
+    table = NULL;
+    break;
+  }
+
+  cws_router_end_write(router, table);
+  return table != NULL;
+}
+
+bool cws_router_remove(
+  cws_router_t *router,
+  cws_http_method_t method,
+  const char *pattern,
+  char **error_msg
+)
+{
+  cws_route_table_t *table = cws_router_begin_write(router);
+  cws_router_node_t *node = cws_router_node_find(table->root, pattern);
+
+  // Empty nodes are left in place, as they never terminate a match
+  if (rp_exit(!node || !(node->methods & (1U << method)), error_msg, "No such route!"))
+  {
+    mman_dealloc(table);
+    table = NULL;
+  }
+  else
+  {
+    node->routes[method] = (cws_route_t) { NULL, NULL, NULL };
+    node->methods &= ~(1U << method);
+  }
+
+  cws_router_end_write(router, table);
+  return table != NULL;
+}
+
+/**
+ * @brief Match the remaining path below a node whose prefix has been consumed
+ * 
+ * The path is matched in a single descent, without ever backtracking: a static
+ * child whose prefix matches is committed to, a parameter is only followed if
+ * there's no such child. If the descent doesn't terminate at a route, the
+ * deepest wildcard that has been passed on the way down captures the rest of
+ * the path. Every step consumes a part of the path, and finding a static child
+ * doesn't depend on the number of routes, so matching takes time linear to the
+ * path's length.
+ * 
+ * @return cws_router_node_t* Node the path terminates at, NULL if none
+ */
+static cws_router_node_t *cws_router_match_node(
+  cws_router_node_t *node,
+  char *path, size_t path_len,
+  cws_route_match_t *match
+)
+{
+  static const strscan_set_t slash = STRSCAN_SET("/");
+
+  // Deepest usable wildcard passed so far, along with what it captures
+  cws_router_node_t *wildcard = NULL;
+  strslice_t wildcard_value = strslice_make(NULL, 0);
+  size_t wildcard_num_params = 0;
+
+  while (true)
+  {
+    if (path_len == 0 && node->methods) return node;
+
+    // Wildcards capture everything that's left, unless all of their routes are gone
+    if (node->wildcard_child && node->wildcard_child->methods)
+    {
+      wildcard = node->wildcard_child;
+      wildcard_value = strslice_make(path, path_len);
+      wildcard_num_params = match->num_params;
+    }
+
+    // Static children take precedence
+    cws_router_node_t *child = path_len > 0 ? cws_router_node_child(node, *path) : NULL;
+    if (child && child->prefix_len <= path_len && memcmp(child->prefix, path, child->prefix_len) == 0)
+    {
+      node = child;
+      path += child->prefix_len;
+      path_len -= child->prefix_len;
+      continue;
+    }
+
+    // Parameters capture non-empty segments
+    if (node->param_child && path_len > 0 && *path != '/')
+    {
+      char *seg_end = strscan_find(path, path_len, &slash);
+      size_t seg_len = seg_end ? (size_t) (seg_end - path) : path_len;
+
+      cws_route_param_t *param = &match->params[match->num_params++];
+      param->name = strslice_make(node->param_child->prefix, node->param_child->prefix_len);
+      param->value = strslice_make(path, seg_len);
+
+      node = node->param_child;
+      path += seg_len;
+      path_len -= seg_len;
+      continue;
+    }
+
+    break;
+  }
+
+  if (!wildcard) return NULL;
+
+  // Parameters captured below the wildcard don't belong to it's route
+  match->num_params = wildcard_num_params;
+  cws_route_param_t *param = &match->params[match->num_params++];
+  param->name = strslice_make(wildcard->prefix, wildcard->prefix_len);
+  param->value = wildcard_value;
+  return wildcard;
+}
+
+bool cws_router_match(
+  cws_router_t *router,
+  cws_http_method_t method,
+  strslice_t path,
+  cws_route_match_t *match
+)
+{
+  match->route = NULL;
+  match->path_found = false;
+  match->allowed_methods = 0;
+  match->num_params = 0;
+
+  // The thread's pin keeps the table alive across reading the body, without
+  // holding back reclamation of anything else
+  match->pin = cws_route_pin_use(router);
+
+  cws_router_node_t *node = cws_router_match_node(match->pin->table->root, path.ptr, path.len, match);
+  if (node)
+  {
+    match->path_found = true;
+    match->allowed_methods = node->methods;
+    if (node->methods & (1U << method)) match->route = &node->routes[method];
+  }
+
+  // Unsuccessful matches don't refer to the table
+  if (!match->route) cws_route_match_release(match);
+  return match->route != NULL;
+}
+
+strslice_t *cws_route_match_param(cws_route_match_t *match, const char *name)
+{
+  for (size_t i = 0; i < match->num_params; i++)
+    if (strslice_eq(match->params[i].name, name)) return &match->params[i].value;
+
+  return NULL;
+}
+
+void cws_route_match_release(cws_route_match_t *match)
+{
+  if (!match->pin) return;
+  cws_route_pin_drop(match->pin);
+  match->pin = NULL;
+}
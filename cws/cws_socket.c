@@ -1,6 +1,14 @@
 #include "cws/cws_socket.h"
 
-cws_socket_t *cws_socket_create(in_addr_t addr, int port)
+/**
+ * @brief Clean up a socket that's about to be destroyed
+ */
+static void cws_socket_cleanup(mman_meta_t *ref)
+{
+  scptr cws_router_t *router = ((cws_socket_t *) ref->ptr)->router;
+}
+
+cws_socket_t *cws_socket_create(in_addr_t addr, int port, bool reuse_port)
 {
   // Build address information based on parameters
   struct sockaddr_in server_addr;
@@ -22,14 +30,25 @@ cws_socket_t *cws_socket_create(in_addr_t addr, int port)
   bool reuse_addr = true;
   setsockopt(srv_desc, SOL_SOCKET, SO_REUSEADDR, &reuse_addr, sizeof(int));
 
+  // Share the port with other sockets, if requested
+  int reuse_port_v = 1;
+  if (reuse_port && setsockopt(srv_desc, SOL_SOCKET, SO_REUSEPORT, &reuse_port_v, sizeof(int)) < 0)
+  {
+    close(srv_desc);
+    return NULL;
+  }
+
   // Bind to local endpoint
   int bind_ret = bind(srv_desc, (struct sockaddr *) &server_addr, sizeof(server_addr));
   if (bind_ret < 0) return NULL;
 
   // Create structure containing both elements
-  scptr cws_socket_t *sock = (cws_socket_t *) mman_alloc(sizeof(cws_socket_t), 1, NULL);
+  scptr cws_socket_t *sock = (cws_socket_t *) mman_alloc(sizeof(cws_socket_t), 1, cws_socket_cleanup);
   sock->addr = server_addr;
   sock->descriptor = srv_desc;
+  sock->cpu = -1;
+  sock->stats = (cws_socket_stats_t) { 0 };
+  sock->router = NULL;
 
   // Could not allocate socket container
   if (!sock)
@@ -51,6 +70,9 @@ static void *cws_socket_loop(void *arg)
   cws_socket_t *sock = (cws_socket_t *) arg;
   sock->thread_active = true;
 
+  // Stay on the designated core, if any
+  if (sock->cpu >= 0) cws_pin_thread(pthread_self(), sock->cpu);
+
   // Client request serve loop
   while (sock->thread_active)
   {
@@ -63,20 +85,43 @@ static void *cws_socket_loop(void *arg)
       printf("Could not accept incoming request from ");
       cws_print_addr_in(*client->address);
       printf(" (%d)!\n", errno);
+      sock->stats.accept_errors++;
       continue;
     }
 
-    // Pass serving onto the handler
-    sock->handler(client);
+    // Pass serving onto the handler, the router is only borrowed, as the socket keeps it alive
+    client->router = sock->router;
+    sock->stats.accepted++;
+    sock->handler(client, sock->handler_arg);
   }
 
   return NULL;
 }
 
-bool cws_socket_listen(cws_socket_t *socket, int backlog, cws_client_handler_t handler)
+void cws_socket_pin(cws_socket_t *socket, int cpu)
+{
+  socket->cpu = cpu;
+
+  // Prefer handing out connections whose packets are processed on that core
+  setsockopt(socket->descriptor, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(int));
+}
+
+void cws_socket_set_router(cws_socket_t *socket, cws_router_t *router)
+{
+  scptr cws_router_t *prev = socket->router;
+  socket->router = mman_ref(router);
+}
+
+bool cws_socket_listen(
+  cws_socket_t *socket,
+  int backlog,
+  cws_client_handler_t handler,
+  void *handler_arg
+)
 {
   // Start listening
   socket->handler = handler;
+  socket->handler_arg = handler_arg;
   if (listen(socket->descriptor, backlog) < 0) return false;
 
   // Start accepting in another thread
@@ -0,0 +1,636 @@
+#include "cws/cws_static.h"
+
+/*
+============================================================================
+                               Content types                                
+============================================================================
+*/
+
+/**
+ * @brief Content type of a file extension
+ */
+typedef struct cws_static_type
+{
+  const char *ext;
+  const char *type;
+} cws_static_type_t;
+
+static const cws_static_type_t cws_static_types[] = {
+  { "html", "text/html; charset=utf-8" },
+  { "htm", "text/html; charset=utf-8" },
+  { "css", "text/css; charset=utf-8" },
+  { "js", "text/javascript; charset=utf-8" },
+  { "mjs", "text/javascript; charset=utf-8" },
+  { "json", "application/json" },
+  { "txt", "text/plain; charset=utf-8" },
+  { "xml", "application/xml" },
+  { "svg", "image/svg+xml" },
+  { "png", "image/png" },
+  { "jpg", "image/jpeg" },
+  { "jpeg", "image/jpeg" },
+  { "gif", "image/gif" },
+  { "webp", "image/webp" },
+  { "avif", "image/avif" },
+  { "ico", "image/x-icon" },
+  { "wasm", "application/wasm" },
+  { "pdf", "application/pdf" },
+  { "mp3", "audio/mpeg" },
+  { "mp4", "video/mp4" },
+  { "webm", "video/webm" },
+  { "woff", "font/woff" },
+  { "woff2", "font/woff2" }
+};
+
+const char *cws_static_content_type(strslice_t path)
+{
+  // Find the extension within the last segment
+  size_t dot = path.len;
+  while (dot > 0 && path.ptr[dot - 1] != '.' && path.ptr[dot - 1] != '/') dot--;
+
+  if (dot > 0 && path.ptr[dot - 1] == '.')
+  {
+    strslice_t ext = strslice_make(&path.ptr[dot], path.len - dot);
+    for (size_t i = 0; i < sizeof(cws_static_types) / sizeof(cws_static_type_t); i++)
+      if (strslice_eq_ci(ext, cws_static_types[i].ext)) return cws_static_types[i].type;
+  }
+
+  return "application/octet-stream";
+}
+
+/*
+============================================================================
+                                 File cache                                 
+============================================================================
+*/
+
+/**
+ * @brief Clean up a cached file that's about to be destroyed
+ */
+static void cws_static_file_cleanup(mman_meta_t *ref)
+{
+  cws_static_file_t *file = (cws_static_file_t *) ref->ptr;
+  close(file->fd);
+  mman_dealloc(file->path);
+  mman_dealloc(file->lines);
+}
+
+/**
+ * @brief Hash a path using FNV-1a
+ */
+static uint64_t cws_static_hash(const char *path, size_t len)
+{
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < len; i++)
+  {
+    hash ^= (unsigned char) path[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+/**
+ * @brief Check whether or not a cached file is the one referred to by a path and encoding
+ */
+static bool cws_static_file_is(cws_static_file_t *file, const char *path, size_t len, cws_encoding_t encoding, uint64_t hash)
+{
+  return (
+    file->hash == hash
+    && file->encoding == encoding
+    && file->path_len == len
+    && memcmp(file->path, path, len) == 0
+  );
+}
+
+/**
+ * @brief Check whether or not a compressible file has a precompressed sibling
+ * 
+ * @param path Path of the file on disk
+ * @param len Length of the path
+ * @param compressible Whether or not the file's content type compresses well
+ * @return true A regular file of the same path suffixed by .gz exists
+ * @return false No sibling or not worth looking for one
+ */
+static bool cws_static_has_gzip(const char *path, size_t len, bool compressible)
+{
+  if (!compressible || len + 3 >= PATH_MAX) return false;
+
+  char gz_path[PATH_MAX];
+  memcpy(gz_path, path, len);
+  strcpy(&gz_path[len], ".gz");
+
+  struct stat gz_st;
+  return stat(gz_path, &gz_st) == 0 && S_ISREG(gz_st.st_mode);
+}
+
+/**
+ * @brief Check whether or not a cached file's metadata still matches the disk
+ */
+static bool cws_static_file_current(cws_static_file_t *file, struct stat *cur)
+{
+  return (
+    cur->st_dev == file->st.st_dev
+    && cur->st_ino == file->st.st_ino
+    && cur->st_size == file->st.st_size
+    && cur->st_mtim.tv_sec == file->st.st_mtim.tv_sec
+    && cur->st_mtim.tv_nsec == file->st.st_mtim.tv_nsec
+  );
+}
+
+/**
+ * @brief Open a file and format all of it's headers
+ * 
+ * @param path Path of the file on disk
+ * @param len Length of the path
+ * @param encoding Encoding of the file's contents
+ * @param hash Hash of the path and encoding
+ * @param err Output for the errno value if the file couldn't be opened
+ * @return cws_static_file_t* Opened file, NULL on errors
+ */
+static cws_static_file_t *cws_static_file_make(const char *path, size_t len, cws_encoding_t encoding, uint64_t hash, int *err)
+{
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    *err = errno;
+    return NULL;
+  }
+
+  // Only regular files are served
+  struct stat st_buf;
+  if (fstat(fd, &st_buf) < 0 || !S_ISREG(st_buf.st_mode))
+  {
+    close(fd);
+    *err = ENOENT;
+    return NULL;
+  }
+
+  scptr cws_static_file_t *file = (cws_static_file_t *) mman_alloc(sizeof(cws_static_file_t), 1, cws_static_file_cleanup);
+  file->path = strslice_dup(strslice_make((char *) path, len));
+  file->path_len = len;
+  file->hash = hash;
+  file->encoding = encoding;
+  file->fd = fd;
+  file->st = st_buf;
+  file->validated_ms = cws_clock_now_ms();
+
+  cws_http_date_format(st_buf.st_mtim.tv_sec, file->last_modified);
+  file->etag_len = cws_etag_file(&st_buf, file->etag);
+
+  // Encoded siblings have the type of the file they're a variant of
+  const char *encoding_name = cws_encoding_name(encoding);
+  size_t type_len = encoding_name ? len - strlen(".gz") : len;
+  file->content_type = cws_static_content_type(strslice_make((char *) path, type_len));
+  file->compressible = !encoding_name && cws_encoding_compressible(strslice_make((char *) file->content_type, strlen(file->content_type)));
+  file->has_gzip = cws_static_has_gzip(path, len, file->compressible);
+
+  // Lines shared with variants compressed on the fly come first
+  size_t offs = 0;
+  file->lines = (char *) mman_alloc(sizeof(char), 256, NULL);
+  bool res = strfmt(&file->lines, &offs, "Content-Type: %s\r\n", file->content_type);
+  file->type_line_len = offs;
+
+  if (res && encoding_name) res = strfmt(&file->lines, &offs, "Content-Encoding: %s\r\n", encoding_name);
+  if (res && (encoding_name || file->compressible)) res = strfmt(&file->lines, &offs, "Vary: Accept-Encoding\r\n");
+  if (res) res = strfmt(&file->lines, &offs, "Last-Modified: %s\r\n", file->last_modified);
+  file->shared_len = offs;
+
+  if (!res || !strfmt(&file->lines, &offs, "Accept-Ranges: bytes\r\nETag: %s\r\n", file->etag))
+  {
+    *err = ENOMEM;
+    return NULL;
+  }
+
+  file->lines_len = offs;
+  return mman_ref(file);
+}
+
+/**
+ * @brief Publish a file within it's shard, replacing an older version of it
+ * or evicting another file if the shard is full, the displaced file is retired
+ * 
+ * @param shard Shard to publish in
+ * @param file File to publish, NULL to only unpublish older versions
+ * @param path Path of the file on disk
+ * @param len Length of the path
+ * @param encoding Encoding of the file's contents
+ * @param hash Hash of the path and encoding
+ */
+static void cws_static_publish(
+  cws_static_shard_t *shard,
+  cws_static_file_t *file,
+  const char *path, size_t len,
+  cws_encoding_t encoding,
+  uint64_t hash
+)
+{
+  pthread_mutex_lock(&shard->lock);
+
+  // Prefer replacing an older version, then a free slot, then the victim
+  size_t slot = CWS_STATIC_CACHE_SHARD_SIZE;
+  for (size_t i = 0; i < CWS_STATIC_CACHE_SHARD_SIZE; i++)
+  {
+    cws_static_file_t *curr = shard->files[i];
+    if (curr && cws_static_file_is(curr, path, len, encoding, hash))
+    {
+      slot = i;
+      break;
+    }
+
+    if (!curr && slot == CWS_STATIC_CACHE_SHARD_SIZE) slot = i;
+  }
+
+  if (slot == CWS_STATIC_CACHE_SHARD_SIZE)
+  {
+    // Nothing to unpublish
+    if (!file)
+    {
+      pthread_mutex_unlock(&shard->lock);
+      return;
+    }
+
+    slot = shard->victim;
+    shard->victim = (shard->victim + 1) % CWS_STATIC_CACHE_SHARD_SIZE;
+  }
+
+  // Readers which already loaded the displaced file keep using it until
+  // they leave their sections, so it's fd stays open until then
+  cws_static_file_t *old = __atomic_exchange_n(&shard->files[slot], mman_ref(file), __ATOMIC_ACQ_REL);
+  pthread_mutex_unlock(&shard->lock);
+
+  if (old) epoch_retire(old);
+}
+
+cws_static_file_t *cws_static_open(cws_static_t *st, const char *path, cws_encoding_t encoding, int *err)
+{
+  size_t len = strlen(path);
+  uint64_t hash = cws_static_hash(path, len) + encoding;
+  cws_static_shard_t *shard = &st->shards[hash % CWS_STATIC_CACHE_SHARDS];
+  bool outdated = false;
+
+  for (size_t i = 0; i < CWS_STATIC_CACHE_SHARD_SIZE; i++)
+  {
+    cws_static_file_t *file = __atomic_load_n(&shard->files[i], __ATOMIC_ACQUIRE);
+    if (!file || !cws_static_file_is(file, path, len, encoding, hash)) continue;
+
+    // Trust the metadata within the revalidation interval
+    long now = cws_clock_now_ms();
+    if (now - __atomic_load_n(&file->validated_ms, __ATOMIC_RELAXED) < CWS_STATIC_REVALIDATE_MS) return file;
+
+    // Unchanged on disk, as is it's sibling, trust it for another interval
+    struct stat cur;
+    if (
+      stat(path, &cur) == 0
+      && cws_static_file_current(file, &cur)
+      && cws_static_has_gzip(path, len, file->compressible) == file->has_gzip
+    )
+    {
+      __atomic_store_n(&file->validated_ms, now, __ATOMIC_RELAXED);
+      return file;
+    }
+
+    // Outdated, open it again
+    outdated = true;
+    break;
+  }
+
+  // Published files are owned by the shard, the section keeps this one alive
+  scptr cws_static_file_t *file = cws_static_file_make(path, len, encoding, hash, err);
+  if (file || outdated) cws_static_publish(shard, file, path, len, encoding, hash);
+  return file;
+}
+
+/*
+============================================================================
+                                Static files                                
+============================================================================
+*/
+
+/**
+ * @brief Clean up a static file server that's about to be destroyed
+ */
+static void cws_static_cleanup(mman_meta_t *ref)
+{
+  cws_static_t *st = (cws_static_t *) ref->ptr;
+  mman_dealloc(st->root);
+
+  for (size_t i = 0; i < CWS_STATIC_CACHE_SHARDS; i++)
+  {
+    pthread_mutex_destroy(&st->shards[i].lock);
+    for (size_t j = 0; j < CWS_STATIC_CACHE_SHARD_SIZE; j++)
+      if (st->shards[i].files[j]) epoch_retire(st->shards[i].files[j]);
+  }
+}
+
+cws_static_t *cws_static_make(const char *root)
+{
+  // Paths below the root are appended with their leading slash
+  size_t root_len = strlen(root);
+  while (root_len > 1 && root[root_len - 1] == '/') root_len--;
+
+  cws_static_t *st = (cws_static_t *) mman_alloc(sizeof(cws_static_t), 1, cws_static_cleanup);
+  st->root = strslice_dup(strslice_make((char *) root, root_len));
+  st->root_len = root_len;
+
+  for (size_t i = 0; i < CWS_STATIC_CACHE_SHARDS; i++)
+  {
+    pthread_mutex_init(&st->shards[i].lock, NULL);
+    memset(st->shards[i].files, 0, sizeof(st->shards[i].files));
+    st->shards[i].victim = 0;
+  }
+
+  return st;
+}
+
+/**
+ * @brief Build the path of a requested file on disk
+ * 
+ * @param st Static file server
+ * @param rel Path below the document root, leading slashes are optional
+ * @param out Path output buffer of PATH_MAX bytes
+ * @return true Path built
+ * @return false Path is too long
+ */
+static bool cws_static_path(cws_static_t *st, strslice_t rel, char *out)
+{
+  while (rel.len > 0 && *rel.ptr == '/')
+  {
+    rel.ptr++;
+    rel.len--;
+  }
+
+  // Directories are served by their index
+  bool index = rel.len == 0 || rel.ptr[rel.len - 1] == '/';
+  size_t len = st->root_len + 1 + rel.len + (index ? strlen(CWS_STATIC_INDEX) : 0);
+  if (len >= PATH_MAX) return false;
+
+  memcpy(out, st->root, st->root_len);
+  out[st->root_len] = '/';
+  memcpy(&out[st->root_len + 1], rel.ptr, rel.len);
+  if (index) strcpy(&out[st->root_len + 1 + rel.len], CWS_STATIC_INDEX);
+  else out[len] = 0;
+  return true;
+}
+
+/**
+ * @brief Format the value of a Content-Range header for a part of a file
+ * 
+ * @param file File the part belongs to
+ * @param part Part of the file
+ * @param value Output buffer of 64 bytes
+ */
+static void cws_static_content_range(cws_static_file_t *file, cws_range_t *part, char *value)
+{
+  snprintf(
+    value, 64, "bytes %" PRIu64 "-%" PRIu64 "/%" PRIu64,
+    part->start, part->start + part->len - 1, (uint64_t) file->st.st_size
+  );
+}
+
+/**
+ * @brief Respond with 416, telling the client about the file's size
+ */
+static bool cws_static_send_unsatisfiable(cws_client_t *client, cws_static_file_t *file)
+{
+  char content_range[64];
+  snprintf(content_range, sizeof(content_range), "bytes */%" PRIu64, (uint64_t) file->st.st_size);
+
+  cws_response_t response;
+  cws_response_init(&response);
+  cws_response_add_header(&response, "Content-Range", content_range);
+  return cws_response_send(client, STATUS_RANGE_NOT_SATISFYABLE, &response, NULL);
+}
+
+/**
+ * @brief Respond with multiple parts of a file as a multipart/byteranges body,
+ * the part heads are formatted into one buffer and written as a vector
+ * entry in front of each part, which is then sent from the file directly
+ * 
+ * @param client Client that's being served
+ * @param file File to send parts of
+ * @param ranges Parts to send, at least two
+ * @param num_ranges Number of parts
+ * @return true Response sent
+ * @return false Could not build response or connection is down
+ */
+static bool cws_static_send_multipart(cws_client_t *client, cws_static_file_t *file, cws_range_t *ranges, size_t num_ranges)
+{
+  // Boundaries only have to be unlikely to occur within the parts
+  static uint64_t counter = 0;
+  uint64_t seed = (__atomic_add_fetch(&counter, 1, __ATOMIC_RELAXED) ^ file->hash) * 0x9e3779b97f4a7c15ULL;
+  char boundary[CWS_STATIC_BOUNDARY_MAXLEN];
+  snprintf(boundary, sizeof(boundary), "cws%016" PRIx64 "%08lx", seed, (unsigned long) cws_clock_now_ms());
+
+  // Format all part heads and the closing boundary, remembering where they end
+  scptr char *heads = (char *) mman_alloc(sizeof(char), 128 * (num_ranges + 1), NULL);
+  size_t heads_offs = 0;
+  size_t ends[CWS_RANGE_MAX + 1];
+  uint64_t body_len = 0;
+
+  for (size_t i = 0; i < num_ranges; i++)
+  {
+    char content_range[64];
+    cws_static_content_range(file, &ranges[i], content_range);
+    if (!strfmt(
+      &heads, &heads_offs, "\r\n--%s\r\nContent-Type: %s\r\nContent-Range: %s\r\n\r\n",
+      boundary, file->content_type, content_range
+    )) return false;
+
+    ends[i] = heads_offs;
+    body_len += ranges[i].len;
+  }
+
+  if (!strfmt(&heads, &heads_offs, "\r\n--%s--\r\n", boundary)) return false;
+  ends[num_ranges] = heads_offs;
+  body_len += heads_offs;
+
+  char content_type[CWS_STATIC_BOUNDARY_MAXLEN + 64];
+  snprintf(content_type, sizeof(content_type), "multipart/byteranges; boundary=%s", boundary);
+
+  // The file's own type describes the parts only
+  cws_response_t response;
+  cws_response_init(&response);
+  cws_response_set_lines(&response, &file->lines[file->type_line_len], file->lines_len - file->type_line_len, 0);
+  cws_response_add_header(&response, "Content-Type", content_type);
+  if (!cws_response_send_head(client, STATUS_PARTIAL_CONTENT, &response, body_len)) return false;
+
+  // Each part's head is flushed along with whatever has been queued by the
+  // part's transfer, the heads stay alive for as long as any of them is queued
+  for (size_t i = 0; i <= num_ranges; i++)
+  {
+    size_t start = i == 0 ? 0 : ends[i - 1];
+    if (!cws_client_send_view(client, heads, &heads[start], ends[i] - start)) return false;
+
+    if (i == num_ranges) return cws_client_flush(client);
+    if (!cws_client_sendfile(client, file->fd, ranges[i].start, ranges[i].len)) return false;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Send a file as it is, or the requested ranges of it
+ * 
+ * @param client Client that's being served
+ * @param file File to send
+ * @return true Response sent
+ * @return false Could not build response or connection is down
+ */
+static bool cws_static_send_file(cws_client_t *client, cws_static_file_t *file)
+{
+  cws_response_t response;
+  cws_response_init(&response);
+  cws_response_set_lines(&response, file->lines, file->lines_len, 1U << CWS_RH_CONTENT_TYPE);
+
+  // The client's copy is current, nothing has to be read from disk
+  if (cws_conditional_respond(client, &response, strslice_make(file->etag, file->etag_len), file->st.st_mtim.tv_sec)) return true;
+
+  cws_range_t ranges[CWS_RANGE_MAX];
+  size_t num_ranges;
+  cws_range_result_t range = cws_range_evaluate(
+    client->head, strslice_make(file->etag, file->etag_len), file->st.st_mtim.tv_sec,
+    file->st.st_size, ranges, &num_ranges
+  );
+
+  // The contents never pass through user space, every backend sends them from the page cache
+  if (range == CWS_RANGE_UNSATISFIABLE) return cws_static_send_unsatisfiable(client, file);
+  if (range == CWS_RANGE_PARTIAL && num_ranges > 1) return cws_static_send_multipart(client, file, ranges, num_ranges);
+
+  cws_range_t whole = { .start = 0, .len = file->st.st_size };
+  cws_range_t *part = range == CWS_RANGE_PARTIAL ? &ranges[0] : &whole;
+
+  char content_range[64];
+  if (range == CWS_RANGE_PARTIAL)
+  {
+    cws_static_content_range(file, part, content_range);
+    cws_response_add_header(&response, "Content-Range", content_range);
+  }
+
+  return (
+    cws_response_send_head(client, range == CWS_RANGE_PARTIAL ? STATUS_PARTIAL_CONTENT : STATUS_OK, &response, part->len)
+    && (client->head->method == HEAD || cws_client_sendfile(client, file->fd, part->start, part->len))
+  );
+}
+
+/**
+ * @brief Read all of a file's contents
+ * 
+ * @param file File to read
+ * @param buf Buffer of the file's size
+ * @return true Contents read
+ * @return false Could not read or the file has been truncated in the meantime
+ */
+static bool cws_static_read(cws_static_file_t *file, char *buf)
+{
+  size_t offs = 0;
+  while (offs < (size_t) file->st.st_size)
+  {
+    ssize_t res = pread(file->fd, &buf[offs], file->st.st_size - offs, offs);
+    if (res < 0 && errno == EINTR) continue;
+    if (res <= 0) return false;
+    offs += res;
+  }
+
+  return true;
+}
+
+/**
+ * @brief Send a file compressed on the fly, it's compressed variants are
+ * cached by the file's path and entity tag, so it's only compressed once per version
+ * 
+ * @param client Client that's being served
+ * @param file File to send
+ * @param encoding Encoding to compress into
+ * @param sent Output for whether or not the response has been sent successfully
+ * @return true Request has been answered
+ * @return false File doesn't get any smaller, it has to be sent as it is
+ */
+static bool cws_static_send_encoded(cws_client_t *client, cws_static_file_t *file, cws_encoding_t encoding, bool *sent)
+{
+  // The variant doesn't match the file byte for byte
+  char etag[CWS_ETAG_MAXLEN + 2];
+  int etag_len = snprintf(etag, sizeof(etag), "W/%s", file->etag);
+
+  cws_response_t response;
+  cws_response_init(&response);
+  cws_response_set_lines(&response, file->lines, file->shared_len, 1U << CWS_RH_CONTENT_TYPE);
+  cws_response_add_header(&response, "ETag", etag);
+
+  // Validators are compared weakly, so this one covers both variants
+  *sent = true;
+  if (cws_conditional_respond(client, &response, strslice_make(etag, etag_len), file->st.st_mtim.tv_sec)) return true;
+
+  strslice_t resource = strslice_make(file->path, file->path_len);
+  strslice_t etag_key = strslice_make(file->etag, file->etag_len);
+  char *encoded = NULL;
+  size_t encoded_len = 0;
+  if (!cws_encoding_cache_get(resource, etag_key, encoding, &encoded, &encoded_len))
+  {
+    scptr char *contents = (char *) mman_alloc(sizeof(char), file->st.st_size, NULL);
+    if (!cws_static_read(file, contents)) return false;
+    encoded = cws_encoding_variant(resource, etag_key, encoding, contents, file->st.st_size, &encoded_len);
+  }
+
+  scptr char *encoded_ref = encoded;
+  if (!encoded) return false;
+
+  cws_response_add_header(&response, "Content-Encoding", cws_encoding_name(encoding));
+  if (client->head->method == HEAD) *sent = cws_response_send_head(client, STATUS_OK, &response, encoded_len);
+  else *sent = cws_response_send_buf(client, STATUS_OK, &response, encoded, encoded_len);
+  return true;
+}
+
+void cws_static_handle(cws_client_t *client, cws_route_match_t *match, void *arg)
+{
+  cws_static_t *st = (cws_static_t *) arg;
+
+  // The path has been decoded and canonicalized, it can't climb above the root
+  strslice_t *rel = cws_route_match_param(match, "path");
+  char path[PATH_MAX];
+  if (!cws_static_path(st, rel ? *rel : client->head->uri.path, path))
+  {
+    cws_response_send_canned(client, STATUS_NOT_FOUND);
+    return;
+  }
+
+  // The file stays open for as long as the section is
+  int err = 0;
+  epoch_slot_t *pin = epoch_enter();
+  cws_static_file_t *file = cws_static_open(st, path, CWS_ENCODING_IDENTITY, &err);
+  if (!file)
+  {
+    epoch_leave(pin);
+    if (err == EACCES) cws_response_send(client, STATUS_FORBIDDEN, NULL, "Access to the requested resource is forbidden!");
+    else cws_response_send_canned(client, STATUS_NOT_FOUND);
+    return;
+  }
+
+  // Encoding still to be applied, ranges are only served from files as they are
+  bool ranged = client->head->method == GET && cws_request_head_known(client->head, CWS_HDR_RANGE);
+  cws_encoding_t encoding = file->compressible && !ranged ? cws_encoding_negotiate(client->head) : CWS_ENCODING_IDENTITY;
+
+  // A precompressed sibling is sent from disk just the same
+  if (encoding == CWS_ENCODING_GZIP && file->has_gzip)
+  {
+    char gz_path[PATH_MAX + sizeof(".gz")];
+    snprintf(gz_path, sizeof(gz_path), "%s.gz", path);
+
+    cws_static_file_t *gz = cws_static_open(st, gz_path, CWS_ENCODING_GZIP, &err);
+    if (gz)
+    {
+      file = gz;
+      encoding = CWS_ENCODING_IDENTITY;
+    }
+  }
+
+  // A failed transfer leaves the response incomplete, so the connection can't be reused
+  bool sent;
+  if (
+    encoding == CWS_ENCODING_IDENTITY
+    || file->st.st_size < CWS_ENCODING_MIN_LEN
+    || file->st.st_size > CWS_ENCODING_MAX_LEN
+    || !cws_static_send_encoded(client, file, encoding, &sent)
+  ) sent = cws_static_send_file(client, file);
+
+  if (!sent) client->keep_alive = false;
+  epoch_leave(pin);
+}
@@ -1,62 +1,208 @@
 #include "cws/cws_uri.h"
 
+// Delimiters the tokenizer scans for
+static const strscan_set_t cws_uri_delim_query = STRSCAN_SET("?");
+static const strscan_set_t cws_uri_delim_eq = STRSCAN_SET("=");
+static const strscan_set_t cws_uri_delim_amp = STRSCAN_SET("&");
+static const strscan_set_t cws_uri_delim_slash = STRSCAN_SET("/");
+
+void cws_uri_init(cws_uri_t *uri)
+{
+  uri->raw_uri = strslice_make(NULL, 0);
+  uri->path = strslice_make(NULL, 0);
+  uri->query_string = strslice_make(NULL, 0);
+  uri->query_parsed = false;
+  uri->query = NULL;
+  uri->num_query = 0;
+  uri->query_cap = 0;
+}
+
 /**
- * @brief Clean up a cws_uri struct that is about to be destroyed
+ * @brief Percent-decode a slice in place and make sure it's valid UTF-8 without NUL bytes
  */
-INLINED static void cws_uri_cleanup(mman_meta_t *ref)
+static bool cws_uri_decode(strslice_t *slice, bool plus_as_space)
 {
-  mman_dealloc(((cws_uri_t *) ref->ptr)->path);
-  mman_dealloc(((cws_uri_t *) ref->ptr)->query);
-  mman_dealloc(((cws_uri_t *) ref->ptr)->raw_uri);
+  return (
+    urlcodec_decode(slice, plus_as_space)
+    && !memchr(slice->ptr, 0, slice->len)
+    && urlcodec_utf8_valid(*slice)
+  );
 }
 
-bool cws_uri_parse(char *raw_uri, cws_uri_t **output, char **error_msg)
+/**
+ * @brief Canonicalize a decoded path in place by dropping empty and "." segments
+ * and resolving ".." segments, which can't climb above the root
+ */
+static void cws_uri_canonicalize(strslice_t *path)
 {
-  // Clone the raw URI for internal storage
-  scptr char *uri_copy = strclone(raw_uri, CWS_URI_MAXLEN);
-  if (rp_exit(!raw_uri, error_msg, "The URI was too long (max=%lu)!\n", CWS_URI_MAXLEN)) return NULL;
+  char *read = path->ptr + 1, *end = path->ptr + path->len;
 
-  // Parse the path without parameters
-  size_t raw_uri_offs = 0;
-  char *path = partial_strdup(raw_uri, &raw_uri_offs, "?", false);
-  if (rp_exit(!path, error_msg, "Could not parse the path!")) return false;
-
-  htable_t *query_table = htable_make(CWS_MIN_QUERYPARAMS, CWS_MAX_QUERYPARAMS, NULL);
-
-  // Parse all available headers
-  char *curr_param;
-  while (
-    // Parse next header line
-    (curr_param = partial_strdup(raw_uri, &raw_uri_offs, "&", false))
-  )
+  // Output always ends with a slash while segments are being appended
+  char *write = path->ptr + 1;
+  bool trailing_slash = true;
+
+  while (read < end)
+  {
+    char *seg_end = strscan_find(read, end - read, &cws_uri_delim_slash);
+    if (!seg_end) seg_end = end;
+    size_t seg_len = seg_end - read;
+
+    // Segments referring to directories leave a trailing slash
+    trailing_slash = seg_end < end || seg_len == 0;
+
+    // Drop the previous segment, which is terminated by the last slash
+    if (seg_len == 2 && read[0] == '.' && read[1] == '.')
+    {
+      trailing_slash = true;
+      if (write > path->ptr + 1)
+      {
+        write--;
+        while (write[-1] != '/') write--;
+      }
+    }
+
+    else if (seg_len == 1 && read[0] == '.') trailing_slash = true;
+
+    else if (seg_len > 0)
+    {
+      memmove(write, read, seg_len);
+      write += seg_len;
+      *write++ = '/';
+    }
+
+    read = seg_end + 1;
+  }
+
+  // Drop the slash behind the last segment if it's a file
+  if (!trailing_slash && write > path->ptr + 1) write--;
+  path->len = write - path->ptr;
+}
+
+/**
+ * @brief Parse the query string into the flat parameter array
+ */
+static void cws_uri_parse_query(cws_uri_t *uri)
+{
+  uri->query_parsed = true;
+  uri->num_query = 0;
+
+  char *curr = uri->query_string.ptr;
+  char *end = curr + uri->query_string.len;
+  if (curr == end) return;
+
+  // Every & starts another parameter
+  size_t num_params = 1;
+  for (char *amp = curr; (amp = strscan_find(amp, end - amp, &cws_uri_delim_amp)); amp++)
+    num_params++;
+  if (num_params > CWS_MAX_QUERYPARAMS) num_params = CWS_MAX_QUERYPARAMS;
+
+  // Grow the array kept from previous URIs if it's too small
+  if (num_params > uri->query_cap)
   {
-    // Split on "="
-    size_t curr_param_offs = 0;
-    scptr char *param_key = partial_strdup(curr_param, &curr_param_offs, "=", false);
-    char *param_value = partial_strdup(curr_param, &curr_param_offs, "\0", false);
-    if (rp_exit(!param_key || !param_value, error_msg, "Malformed query parameter!")) return NULL;
-
-    // Ensure existence of the value list array
-    dynarr_t *curr_value_list;
-    if (htable_fetch(query_table, param_key, (void **) &curr_value_list) == HTABLE_KEY_NOT_FOUND)
+    mman_dealloc(uri->query);
+    uri->query = mman_alloc(sizeof(cws_query_param_t), num_params, NULL);
+    uri->query_cap = num_params;
+  }
+
+  // Parse all available parameters, separated by &
+  while (curr <= end && uri->num_query < num_params)
+  {
+    char *param_end = strscan_find(curr, end - curr, &cws_uri_delim_amp);
+    if (!param_end) param_end = end;
+
+    // Skip empty parameters
+    if (param_end == curr)
     {
-      curr_value_list = dynarr_make(CWS_MIN_SAME_QUERYPARAMS, CWS_MAX_SAME_QUERYPARAMS, mman_dealloc);
-      htable_result_t ins_res = htable_insert(query_table, param_key, curr_value_list);
-      if (rp_exit(ins_res == HTABLE_FULL, error_msg, "Too many query parameters (max=%lu)!", CWS_MAX_QUERYPARAMS)) return NULL;
+      curr = param_end + 1;
+      continue;
     }
 
-    // Push value into key-array
-    dynarr_result_t arr_res = dynarr_push(curr_value_list, param_value, NULL);
-    if (rp_exit(arr_res == dynarr_FULL, error_msg, "Too many same-named query parameters (max=%lu)!", CWS_MAX_SAME_QUERYPARAMS)) return NULL;
+    // Split on the first "=", parameters without one have an empty value
+    cws_query_param_t *param = &uri->query[uri->num_query];
+    char *eq = strscan_find(curr, param_end - curr, &cws_uri_delim_eq);
+    if (eq)
+    {
+      param->key = strslice_make(curr, eq - curr);
+      param->value = strslice_make(eq + 1, param_end - (eq + 1));
+    }
+    else
+    {
+      param->key = strslice_make(curr, param_end - curr);
+      param->value = strslice_make(param_end, 0);
+    }
+
+    // Decode in place, parameters which don't decode to valid UTF-8 are dropped
+    curr = param_end + 1;
+    if (!cws_uri_decode(&param->key, true) || !cws_uri_decode(&param->value, true)) continue;
+    uri->num_query++;
+  }
+}
+
+bool cws_uri_parse(strslice_t raw_uri, cws_uri_t *output, char **error_msg)
+{
+  if (rp_exit(raw_uri.len > CWS_URI_MAXLEN, error_msg, "The URI was too long (max=%lu)!", CWS_URI_MAXLEN)) return false;
+  if (rp_exit(raw_uri.len == 0, error_msg, "Could not parse the path!")) return false;
+
+  output->raw_uri = raw_uri;
+  output->query_parsed = false;
+  output->num_query = 0;
 
-    mman_dealloc(curr_param);
+  // Parse the path without parameters
+  char *query_start = strscan_find(raw_uri.ptr, raw_uri.len, &cws_uri_delim_query);
+  if (!query_start)
+  {
+    output->path = raw_uri;
+    output->query_string = strslice_make(raw_uri.ptr + raw_uri.len, 0);
+  }
+  else
+  {
+    output->path = strslice_make(raw_uri.ptr, query_start - raw_uri.ptr);
+    output->query_string = strslice_make(query_start + 1, raw_uri.len - (output->path.len + 1));
   }
 
-  cws_uri_t *res = (cws_uri_t *) mman_alloc(sizeof(cws_uri_t), 1, cws_uri_cleanup);
-  res->raw_uri = mman_ref(uri_copy); // needs mman freeing
-  res->path = path; // needs mman freeing
-  res->query = query_table; // needs mman freeing
+  // Only the asterisk-form doesn't start with a slash, it's left as is
+  if (output->path.len == 1 && output->path.ptr[0] == '*') return true;
+  if (rp_exit(output->path.len == 0 || output->path.ptr[0] != '/', error_msg, "The path has to be absolute!")) return false;
 
-  if (output) *output = mman_ref(res);
+  // Decode and normalize the path once, so routing and file lookup don't have to
+  if (rp_exit(!cws_uri_decode(&output->path, false), error_msg, "The path is not properly encoded!")) return false;
+  cws_uri_canonicalize(&output->path);
   return true;
-}
\ No newline at end of file
+}
+
+strslice_t *cws_uri_query_find(cws_uri_t *uri, const char *key, size_t *iter)
+{
+  if (!uri->query_parsed) cws_uri_parse_query(uri);
+
+  for (; *iter < uri->num_query; (*iter)++)
+  {
+    cws_query_param_t *param = &uri->query[*iter];
+    if (!strslice_eq(param->key, key)) continue;
+
+    (*iter)++;
+    return &param->value;
+  }
+
+  return NULL;
+}
+
+void cws_uri_rebase(cws_uri_t *uri, char *old_base, char *new_base)
+{
+  strslice_rebase(&uri->raw_uri, old_base, new_base);
+  strslice_rebase(&uri->path, old_base, new_base);
+  strslice_rebase(&uri->query_string, old_base, new_base);
+
+  for (size_t i = 0; i < uri->num_query; i++)
+  {
+    strslice_rebase(&uri->query[i].key, old_base, new_base);
+    strslice_rebase(&uri->query[i].value, old_base, new_base);
+  }
+}
+
+void cws_uri_release(cws_uri_t *uri)
+{
+  mman_dealloc(uri->query);
+  uri->query = NULL;
+  uri->num_query = 0;
+  uri->query_cap = 0;
+}
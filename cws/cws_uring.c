@@ -0,0 +1,545 @@
+#define _GNU_SOURCE
+#include "cws/cws_uring.h"
+
+// Operation tags, encoded into the low bits of the user data next to the connection pointer
+#define CWS_URING_OP_ACCEPT 0UL
+#define CWS_URING_OP_RECV 1UL
+#define CWS_URING_OP_SEND 2UL
+#define CWS_URING_OP_CLOSE 3UL
+#define CWS_URING_OP_TIMEOUT 4UL
+#define CWS_URING_OP_SPLICE 5UL
+#define CWS_URING_OP_MASK 7UL
+
+/*
+============================================================================
+                                Ring access
+============================================================================
+*/
+
+/**
+ * @brief Get the next free submission queue entry, submits pending entries
+ * when the queue is full
+ */
+static struct io_uring_sqe *cws_uring_sqe(cws_uring_t *uring, __u8 opcode, int fd, void *conn, unsigned long op)
+{
+  unsigned tail = *uring->sq_tail;
+
+  // Queue is full, hand the pending entries over to the kernel first
+  while (tail - __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE) >= uring->sq_entries)
+  {
+    int submitted = syscall(__NR_io_uring_enter, uring->ring_fd, uring->to_submit, 0, 0, NULL, 0);
+    if (submitted > 0) uring->to_submit -= submitted;
+  }
+
+  unsigned index = tail & *uring->sq_mask;
+  struct io_uring_sqe *sqe = &uring->sqes[index];
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->user_data = (__u64) conn | op;
+
+  // Publish the entry
+  uring->sq_array[index] = index;
+  __atomic_store_n(uring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  uring->to_submit++;
+  return sqe;
+}
+
+/**
+ * @brief Hand a receive buffer back to the kernel
+ */
+static void cws_uring_buf_recycle(cws_uring_t *uring, unsigned short bid)
+{
+  struct io_uring_buf *buf = &uring->buf_ring->bufs[uring->buf_tail & (CWS_URING_NUM_BUFS - 1)];
+  buf->addr = (__u64) &uring->bufs[bid * CWS_HANDLER_SEGLEN];
+  buf->len = CWS_HANDLER_SEGLEN;
+  buf->bid = bid;
+
+  uring->buf_tail++;
+  __atomic_store_n(&uring->buf_ring->tail, uring->buf_tail, __ATOMIC_RELEASE);
+}
+
+/*
+============================================================================
+                                 Operations
+============================================================================
+*/
+
+static void cws_uring_arm_accept(cws_uring_t *uring)
+{
+  struct io_uring_sqe *sqe = cws_uring_sqe(uring, IORING_OP_ACCEPT, uring->socket->descriptor, NULL, CWS_URING_OP_ACCEPT);
+  if (uring->accept_multishot) sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+}
+
+static void cws_uring_arm_recv(cws_uring_t *uring, cws_uring_conn_t *conn)
+{
+  // Receive into a buffer the kernel picks from the provided ones
+  struct io_uring_sqe *sqe = cws_uring_sqe(uring, IORING_OP_RECV, conn->client->descriptor, conn, CWS_URING_OP_RECV);
+  sqe->flags = IOSQE_BUFFER_SELECT | IOSQE_IO_LINK;
+  sqe->buf_group = CWS_URING_BUF_GROUP;
+
+  // Cancel the receive when the connection stays idle for too long
+  sqe = cws_uring_sqe(uring, IORING_OP_LINK_TIMEOUT, -1, conn, CWS_URING_OP_TIMEOUT);
+  sqe->addr = (__u64) &conn->timeout;
+  sqe->len = 1;
+}
+
+static void cws_uring_arm_close(cws_uring_t *uring, cws_uring_conn_t *conn)
+{
+  cws_uring_sqe(uring, IORING_OP_CLOSE, conn->client->descriptor, conn, CWS_URING_OP_CLOSE);
+}
+
+/**
+ * @brief Send the next part of the connection's output, consecutive buffers at
+ * once and files chunk by chunk by splicing them through the connection's pipe,
+ * then close the connection if the client's state machine is done, or await
+ * the next request
+ */
+static void cws_uring_send_next(cws_uring_t *uring, cws_uring_conn_t *conn)
+{
+  cws_client_t *client = conn->client;
+  bool done = client->state == CWS_CS_CLOSE;
+
+  if (conn->out_next == conn->out_count)
+  {
+    conn->out_count = 0;
+    conn->out_next = 0;
+    if (done) cws_uring_arm_close(uring, conn);
+    else cws_uring_arm_recv(uring, conn);
+    return;
+  }
+
+  cws_client_out_t *out = &conn->out[conn->out_next];
+  size_t count = conn->out_count - conn->out_next;
+
+  // Files are spliced into the pipe chunk by chunk, never passing through user space
+  if (out->fd >= 0 && conn->piped == 0)
+  {
+    if (conn->pipe_fds[0] < 0 && pipe2(conn->pipe_fds, O_CLOEXEC) < 0)
+    {
+      cws_uring_arm_close(uring, conn);
+      return;
+    }
+
+    struct io_uring_sqe *sqe = cws_uring_sqe(uring, IORING_OP_SPLICE, conn->pipe_fds[1], conn, CWS_URING_OP_SPLICE);
+    sqe->splice_fd_in = out->fd;
+    sqe->splice_off_in = out->offset;
+    sqe->off = (__u64) -1;
+    sqe->len = out->iov.iov_len < CWS_URING_FILE_CHUNK ? out->iov.iov_len : CWS_URING_FILE_CHUNK;
+    return;
+  }
+
+  // What's been spliced into the pipe is spliced on into the socket, it's
+  // completion advances the file part like any other send
+  if (out->fd >= 0)
+  {
+    struct io_uring_sqe *sqe = cws_uring_sqe(uring, IORING_OP_SPLICE, client->descriptor, conn, CWS_URING_OP_SEND);
+    sqe->splice_fd_in = conn->pipe_fds[0];
+    sqe->splice_off_in = (__u64) -1;
+    sqe->off = (__u64) -1;
+    sqe->len = conn->piped;
+
+    // Close as soon as the last chunk went out
+    conn->closing = done && count == 1 && conn->piped == out->iov.iov_len;
+    if (conn->closing)
+    {
+      sqe->flags = IOSQE_IO_LINK;
+      cws_uring_arm_close(uring, conn);
+    }
+    return;
+  }
+
+  size_t iovcnt = cws_client_out_gather(out, count, conn->iov, CWS_CLIENT_MAX_QUEUED);
+  conn->msg = (struct msghdr) { .msg_iov = conn->iov, .msg_iovlen = iovcnt };
+
+  struct io_uring_sqe *sqe = cws_uring_sqe(uring, IORING_OP_SENDMSG, client->descriptor, conn, CWS_URING_OP_SEND);
+  sqe->addr = (__u64) &conn->msg;
+  sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+
+  // Close as soon as the last of the output went out
+  conn->closing = done && iovcnt == count;
+  if (conn->closing)
+  {
+    sqe->flags = IOSQE_IO_LINK;
+    cws_uring_arm_close(uring, conn);
+  }
+}
+
+/**
+ * @brief Send all output the client has queued up
+ */
+static void cws_uring_arm_send(cws_uring_t *uring, cws_uring_conn_t *conn)
+{
+  cws_client_t *client = conn->client;
+
+  // Swap queues with the client, the entries' references move along
+  cws_client_out_t *spare = conn->out;
+  size_t spare_cap = conn->out_cap;
+
+  conn->out = client->out_queue;
+  conn->out_cap = client->out_cap;
+  conn->out_count = client->out_count;
+  conn->out_next = 0;
+
+  client->out_queue = spare;
+  client->out_cap = spare_cap;
+  client->out_count = 0;
+
+  cws_uring_send_next(uring, conn);
+}
+
+/**
+ * @brief Decide on the connection's next operation after it's client has been fed
+ */
+static void cws_uring_continue(cws_uring_t *uring, cws_uring_conn_t *conn)
+{
+  if (conn->client->out_count > 0) cws_uring_arm_send(uring, conn);
+  else if (conn->client->state == CWS_CS_CLOSE) cws_uring_arm_close(uring, conn);
+  else cws_uring_arm_recv(uring, conn);
+}
+
+/*
+============================================================================
+                                Completions
+============================================================================
+*/
+
+/**
+ * @brief Clean up a connection that is about to be destroyed
+ */
+static void cws_uring_conn_cleanup(mman_meta_t *ref)
+{
+  cws_uring_conn_t *conn = (cws_uring_conn_t *) ref->ptr;
+  scptr cws_client_t *client = conn->client;
+
+  // Drop output of a send which had the close linked or failed
+  cws_client_out_drop(&conn->out[conn->out_next], conn->out_count - conn->out_next);
+  mman_dealloc(conn->out);
+
+  if (conn->pipe_fds[0] >= 0)
+  {
+    close(conn->pipe_fds[0]);
+    close(conn->pipe_fds[1]);
+  }
+}
+
+static void cws_uring_on_accept(cws_uring_t *uring, struct io_uring_cqe *cqe)
+{
+  // The accept has been terminated, re-arm it while still active
+  if (!(cqe->flags & IORING_CQE_F_MORE) && uring->thread_active)
+  {
+    // An invalid argument means the kernel doesn't support multishot accepts,
+    // fall back to single accepts, which fail like this only if the socket broke
+    if (cqe->res == -EINVAL && !uring->accept_multishot) uring->thread_active = false;
+    else
+    {
+      if (cqe->res == -EINVAL) uring->accept_multishot = false;
+      cws_uring_arm_accept(uring);
+    }
+  }
+
+  if (cqe->res < 0) return;
+
+  // Set up the client and it's connection state
+  scptr cws_client_t *client = cws_client_make();
+  client->descriptor = cqe->res;
+  client->router = uring->socket->router;
+  client->corked = true;
+  client->deferred_flush = true;
+  getpeername(client->descriptor, (struct sockaddr *) client->address, client->address_size);
+
+  cws_uring_conn_t *conn = (cws_uring_conn_t *) mman_alloc(sizeof(cws_uring_conn_t), 1, cws_uring_conn_cleanup);
+  conn->client = mman_ref(client);
+  conn->out = (cws_client_out_t *) mman_alloc(sizeof(cws_client_out_t), CWS_CLIENT_MAX_QUEUED, NULL);
+  conn->out_cap = CWS_CLIENT_MAX_QUEUED;
+  conn->out_count = 0;
+  conn->out_next = 0;
+  conn->pipe_fds[0] = -1;
+  conn->pipe_fds[1] = -1;
+  conn->piped = 0;
+  conn->closing = false;
+  conn->timeout = (struct __kernel_timespec) {
+    .tv_sec = CWS_KEEPALIVE_TIMEOUT_MS / 1000,
+    .tv_nsec = (CWS_KEEPALIVE_TIMEOUT_MS % 1000) * 1000000L
+  };
+
+  cws_uring_arm_recv(uring, conn);
+}
+
+static void cws_uring_on_recv(cws_uring_t *uring, cws_uring_conn_t *conn, struct io_uring_cqe *cqe)
+{
+  // Ran out of provided buffers, try again
+  if (cqe->res == -ENOBUFS)
+  {
+    cws_uring_arm_recv(uring, conn);
+    return;
+  }
+
+  // Orderly shutdown, connection error or idle timeout
+  if (cqe->res <= 0)
+  {
+    cws_uring_arm_close(uring, conn);
+    return;
+  }
+
+  // Feed the received data into the client's state machine and give the buffer back
+  unsigned short bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+  cws_client_process(conn->client, &uring->bufs[bid * CWS_HANDLER_SEGLEN], cqe->res);
+  cws_uring_buf_recycle(uring, bid);
+
+  cws_uring_continue(uring, conn);
+}
+
+static void cws_uring_on_send(cws_uring_t *uring, cws_uring_conn_t *conn, struct io_uring_cqe *cqe)
+{
+  // The linked close completes the connection
+  if (conn->closing) return;
+
+  if (cqe->res < 0)
+  {
+    cws_uring_arm_close(uring, conn);
+    return;
+  }
+
+  // Release what has been sent and resume after it, a file part's
+  // bytes have been taken out of the pipe
+  if (conn->out[conn->out_next].fd >= 0) conn->piped -= cqe->res;
+  conn->out_next += cws_client_out_advance(&conn->out[conn->out_next], conn->out_count - conn->out_next, cqe->res);
+  cws_uring_send_next(uring, conn);
+}
+
+static void cws_uring_on_splice(cws_uring_t *uring, cws_uring_conn_t *conn, struct io_uring_cqe *cqe)
+{
+  // The file can't be read or has been truncated, the response can't be completed
+  if (cqe->res <= 0)
+  {
+    cws_uring_arm_close(uring, conn);
+    return;
+  }
+
+  // Splice the chunk on into the socket
+  conn->piped = cqe->res;
+  cws_uring_send_next(uring, conn);
+}
+
+static void cws_uring_on_close(cws_uring_t *uring, cws_uring_conn_t *conn, struct io_uring_cqe *cqe)
+{
+  // The linked close has been cancelled by a failed send, close directly
+  if (cqe->res == -ECANCELED) close(conn->client->descriptor);
+
+  // This was the connection's last operation, the output in flight is dropped along
+  scptr cws_uring_conn_t *released = conn;
+}
+
+/**
+ * @brief Completion loop subroutine to be used as a thread function
+ *
+ * @param arg Ring structure pointer
+ */
+static void *cws_uring_loop(void *arg)
+{
+  cws_uring_t *uring = (cws_uring_t *) arg;
+  cws_uring_arm_accept(uring);
+
+  while (uring->thread_active)
+  {
+    // Submit everything that's pending and wait for at least one completion
+    int submitted = syscall(
+      __NR_io_uring_enter, uring->ring_fd, uring->to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0
+    );
+
+    if (submitted < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) break;
+    if (submitted > 0) uring->to_submit -= submitted;
+
+    // Process all available completions
+    unsigned head = *uring->cq_head;
+    unsigned tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++)
+    {
+      struct io_uring_cqe *cqe = &uring->cqes[head & *uring->cq_mask];
+      cws_uring_conn_t *conn = (cws_uring_conn_t *) (cqe->user_data & ~CWS_URING_OP_MASK);
+
+      switch (cqe->user_data & CWS_URING_OP_MASK)
+      {
+        case CWS_URING_OP_ACCEPT: cws_uring_on_accept(uring, cqe); break;
+        case CWS_URING_OP_RECV: cws_uring_on_recv(uring, conn, cqe); break;
+        case CWS_URING_OP_SEND: cws_uring_on_send(uring, conn, cqe); break;
+        case CWS_URING_OP_SPLICE: cws_uring_on_splice(uring, conn, cqe); break;
+        case CWS_URING_OP_CLOSE: cws_uring_on_close(uring, conn, cqe); break;
+      }
+    }
+
+    // Hand the processed completions back
+    __atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+  }
+
+  return NULL;
+}
+
+/*
+============================================================================
+                                   Setup
+============================================================================
+*/
+
+/**
+ * @brief Clean up a cws_uring struct that is about to be destroyed by
+ * stopping it's loop and unmapping all of it's memory
+ */
+static void cws_uring_cleanup(mman_meta_t *ref)
+{
+  cws_uring_t *uring = (cws_uring_t *) ref->ptr;
+
+  // Shutting the socket down terminates the accept and thus wakes the loop
+  if (uring->thread_active)
+  {
+    uring->thread_active = false;
+    shutdown(uring->socket->descriptor, SHUT_RDWR);
+    pthread_join(uring->thread, NULL);
+  }
+
+  if (uring->ring_fd >= 0) close(uring->ring_fd);
+  if (uring->sq_ptr) munmap(uring->sq_ptr, uring->sq_len);
+  if (uring->cq_ptr && uring->cq_ptr != uring->sq_ptr) munmap(uring->cq_ptr, uring->cq_len);
+  if (uring->sqes) munmap(uring->sqes, uring->sqes_len);
+  if (uring->buf_ring) munmap(uring->buf_ring, uring->buf_ring_len);
+  mman_dealloc(uring->bufs);
+}
+
+/**
+ * @brief Map the ring's queues into memory
+ */
+static bool cws_uring_map(cws_uring_t *uring, struct io_uring_params *params)
+{
+  // Both queues share one mapping
+  if (!(params->features & IORING_FEAT_SINGLE_MMAP))
+  {
+    errno = ENOSYS;
+    return false;
+  }
+
+  uring->sq_len = params->sq_off.array + params->sq_entries * sizeof(unsigned);
+  uring->cq_len = params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+  if (uring->cq_len > uring->sq_len) uring->sq_len = uring->cq_len;
+  uring->cq_len = uring->sq_len;
+
+  uring->sq_ptr = mmap(NULL, uring->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->ring_fd, IORING_OFF_SQ_RING);
+  if (uring->sq_ptr == MAP_FAILED)
+  {
+    uring->sq_ptr = NULL;
+    return false;
+  }
+  uring->cq_ptr = uring->sq_ptr;
+
+  uring->sqes_len = params->sq_entries * sizeof(struct io_uring_sqe);
+  uring->sqes = mmap(NULL, uring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->ring_fd, IORING_OFF_SQES);
+  if (uring->sqes == MAP_FAILED)
+  {
+    uring->sqes = NULL;
+    return false;
+  }
+
+  uring->sq_head = uring->sq_ptr + params->sq_off.head;
+  uring->sq_tail = uring->sq_ptr + params->sq_off.tail;
+  uring->sq_mask = uring->sq_ptr + params->sq_off.ring_mask;
+  uring->sq_array = uring->sq_ptr + params->sq_off.array;
+  uring->sq_entries = params->sq_entries;
+
+  uring->cq_head = uring->cq_ptr + params->cq_off.head;
+  uring->cq_tail = uring->cq_ptr + params->cq_off.tail;
+  uring->cq_mask = uring->cq_ptr + params->cq_off.ring_mask;
+  uring->cqes = uring->cq_ptr + params->cq_off.cqes;
+  return true;
+}
+
+/**
+ * @brief Check that the kernel supports all operations the ring submits,
+ * multishot accepts can't be probed for, but they arrived along with
+ * provided buffer rings, which are registered afterwards
+ */
+static bool cws_uring_probe(cws_uring_t *uring)
+{
+  static const __u8 required[] = {
+    IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SENDMSG,
+    IORING_OP_SPLICE, IORING_OP_CLOSE, IORING_OP_LINK_TIMEOUT
+  };
+
+  size_t probe_len = sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+  scptr struct io_uring_probe *probe = (struct io_uring_probe *) mman_alloc(probe_len, 1, NULL);
+  memset(probe, 0, probe_len);
+  if (syscall(__NR_io_uring_register, uring->ring_fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) < 0) return false;
+
+  for (size_t i = 0; i < sizeof(required) / sizeof(required[0]); i++)
+  {
+    if (required[i] > probe->last_op || !(probe->ops[required[i]].flags & IO_URING_OP_SUPPORTED))
+    {
+      errno = ENOSYS;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * @brief Register the ring of provided receive buffers and fill it up
+ */
+static bool cws_uring_provide_bufs(cws_uring_t *uring)
+{
+  uring->buf_ring_len = CWS_URING_NUM_BUFS * sizeof(struct io_uring_buf);
+  uring->buf_ring = mmap(NULL, uring->buf_ring_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (uring->buf_ring == MAP_FAILED)
+  {
+    uring->buf_ring = NULL;
+    return false;
+  }
+
+  struct io_uring_buf_reg reg = {
+    .ring_addr = (__u64) uring->buf_ring,
+    .ring_entries = CWS_URING_NUM_BUFS,
+    .bgid = CWS_URING_BUF_GROUP
+  };
+  if (syscall(__NR_io_uring_register, uring->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) return false;
+
+  uring->bufs = mman_alloc(sizeof(char), CWS_URING_NUM_BUFS * CWS_HANDLER_SEGLEN, NULL);
+  uring->buf_tail = 0;
+  for (unsigned short bid = 0; bid < CWS_URING_NUM_BUFS; bid++)
+    cws_uring_buf_recycle(uring, bid);
+
+  return true;
+}
+
+cws_uring_t *cws_uring_make(cws_socket_t *socket, int backlog)
+{
+  scptr cws_uring_t *uring = (cws_uring_t *) mman_alloc(sizeof(cws_uring_t), 1, cws_uring_cleanup);
+  memset(uring, 0, sizeof(cws_uring_t));
+  uring->socket = socket;
+
+  // Set up the ring
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  uring->ring_fd = syscall(__NR_io_uring_setup, CWS_URING_ENTRIES, &params);
+  if (uring->ring_fd < 0) return NULL;
+
+  if (!cws_uring_map(uring, &params)) return NULL;
+  if (!cws_uring_probe(uring)) return NULL;
+  if (!cws_uring_provide_bufs(uring)) return NULL;
+  uring->accept_multishot = true;
+
+  // Start listening
+  if (listen(socket->descriptor, backlog) < 0) return NULL;
+
+  // Start completing in another thread
+  uring->thread_active = true;
+  int err = pthread_create(&uring->thread, NULL, cws_uring_loop, uring);
+
+  // Could not create thread
+  if (err)
+  {
+    uring->thread_active = false;
+    errno = err;
+    return NULL;
+  }
+
+  return mman_ref(uring);
+}
@@ -0,0 +1,52 @@
+#include "datastruct/bytebuf.h"
+
+/**
+ * @brief Clean up a no longer needed bytebuf struct
+ */
+INLINED static void bytebuf_cleanup(mman_meta_t *ref)
+{
+  mman_dealloc(((bytebuf_t *) ref->ptr)->data);
+}
+
+bytebuf_t *bytebuf_make(size_t cap, size_t max_cap)
+{
+  scptr bytebuf_t *res = mman_alloc(sizeof(bytebuf_t), 1, bytebuf_cleanup);
+
+  res->_cap = cap; // no freeing
+  res->_max_cap = max_cap; // no freeing
+  res->len = 0; // no freeing
+
+  // Allocate the initial capacity and terminate the empty content
+  res->data = mman_alloc(sizeof(char), cap + 1, NULL); // needs mman freeing
+  res->data[0] = 0;
+
+  return mman_ref(res);
+}
+
+bytebuf_result_t bytebuf_append(bytebuf_t *buf, const char *data, size_t data_len)
+{
+  size_t req_len = buf->len + data_len;
+  if (req_len > buf->_max_cap) return BYTEBUF_FULL;
+
+  // Double the capacity until the data fits
+  if (req_len > buf->_cap)
+  {
+    size_t new_cap = buf->_cap ? buf->_cap : 1;
+    while (new_cap < req_len) new_cap *= 2;
+    if (new_cap > buf->_max_cap) new_cap = buf->_max_cap;
+
+    mman_realloc((void **) &buf->data, sizeof(char), new_cap + 1);
+    buf->_cap = new_cap;
+  }
+
+  memcpy(&buf->data[buf->len], data, data_len);
+  buf->len = req_len;
+  buf->data[buf->len] = 0;
+  return BYTEBUF_SUCCESS;
+}
+
+void bytebuf_clear(bytebuf_t *buf)
+{
+  buf->len = 0;
+  buf->data[0] = 0;
+}
@@ -0,0 +1,66 @@
+#include "datastruct/deque.h"
+
+/**
+ * @brief Clean up a no longer needed deque struct and all of it's items
+ */
+static void deque_cleanup(mman_meta_t *ref)
+{
+  deque_t *deque = (deque_t *) ref->ptr;
+
+  // Clean up left over items if applicable
+  if (deque->_cf)
+  {
+    for (size_t i = 0; i < deque->_item_count; i++)
+      deque->_cf(deque->items[(deque->_head + i) % deque->_item_cap]);
+  }
+
+  // Free the item pointers
+  mman_dealloc(deque->items);
+}
+
+deque_t *deque_make(size_t item_cap, cleanup_fn_t cf)
+{
+  scptr deque_t *res = mman_alloc(sizeof(deque_t), 1, deque_cleanup);
+
+  res->_head = 0; // no freeing
+  res->_item_count = 0; // no freeing
+  res->_item_cap = item_cap; // no freeing
+  res->_cf = cf; // no freeing
+
+  // Allocate the ring buffer
+  res->items = (void **) mman_alloc(sizeof(void *), item_cap, NULL); // needs mman freeing
+
+  return mman_ref(res);
+}
+
+deque_result_t deque_push_back(deque_t *deque, void *item)
+{
+  // Ring buffer is fully occupied
+  if (deque->_item_count >= deque->_item_cap) return DEQUE_FULL;
+
+  // Append behind the last item
+  deque->items[(deque->_head + deque->_item_count) % deque->_item_cap] = item;
+  deque->_item_count++;
+  return DEQUE_SUCCESS;
+}
+
+deque_result_t deque_pop_front(deque_t *deque, void **out)
+{
+  if (deque->_item_count == 0) return DEQUE_EMPTY;
+
+  // Take the front item and advance the head
+  if (out) *out = deque->items[deque->_head];
+  deque->_head = (deque->_head + 1) % deque->_item_cap;
+  deque->_item_count--;
+  return DEQUE_SUCCESS;
+}
+
+deque_result_t deque_pop_back(deque_t *deque, void **out)
+{
+  if (deque->_item_count == 0) return DEQUE_EMPTY;
+
+  // Take the last item, the head stays in place
+  deque->_item_count--;
+  if (out) *out = deque->items[(deque->_head + deque->_item_count) % deque->_item_cap];
+  return DEQUE_SUCCESS;
+}
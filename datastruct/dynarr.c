@@ -14,7 +14,7 @@ INLINED static void dynarr_item_cleanup(void *ref, cleanup_fn_t cf)
  */
 INLINED static void dynarr_cleanup(mman_meta_t *ref)
 {
-  dynarr_t *dynarr = (dynarr_t *) ref;
+  dynarr_t *dynarr = (dynarr_t *) ref->ptr;
 
   // Clean up items if applicable
   if (dynarr->_cf)
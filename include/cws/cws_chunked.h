@@ -0,0 +1,104 @@
+#ifndef cws_chunked_h
+#define cws_chunked_h
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "util/strslice.h"
+
+/*
+============================================================================
+                               Configuration                                
+============================================================================
+*/
+
+// Maximum length of a chunk size line, including it's extensions
+#define CWS_CHUNKED_MAX_LINE 4096UL
+
+// Maximum length of all trailer lines combined
+#define CWS_CHUNKED_MAX_TRAILERS 8192UL
+
+/*
+============================================================================
+                                  Decoder                                   
+============================================================================
+*/
+
+/**
+ * @brief Part of the chunked body the decoder awaits next
+ */
+typedef enum cws_chunked_state
+{
+  CWS_CK_SIZE,                    // Hexadecimal chunk size
+  CWS_CK_EXT,                     // Chunk extensions up to the line's end
+  CWS_CK_EXT_QUOTED,              // Quoted string within an extension's value
+  CWS_CK_EXT_ESCAPE,              // Escaped character within a quoted string
+  CWS_CK_SIZE_LF,                 // Line feed terminating the size line
+  CWS_CK_DATA,                    // Chunk data
+  CWS_CK_DATA_CR,                 // Carriage return terminating the chunk data
+  CWS_CK_DATA_LF,                 // Line feed terminating the chunk data
+  CWS_CK_TRAILER,                 // Start of a trailer line or the empty line
+  CWS_CK_TRAILER_LINE,            // Remainder of a trailer line
+  CWS_CK_TRAILER_LINE_LF,         // Line feed terminating a trailer line
+  CWS_CK_TRAILER_LF,              // Line feed terminating the body
+  CWS_CK_DONE                     // Body is complete
+} cws_chunked_state_t;
+
+/**
+ * @brief Outcome of a decoding step
+ */
+typedef enum cws_chunked_result
+{
+  CWS_CHUNKED_INCOMPLETE,         // All data has been consumed, more is needed
+  CWS_CHUNKED_DATA,               // A piece of chunk data has been decoded
+  CWS_CHUNKED_DONE,               // Body is complete, including it's trailers
+  CWS_CHUNKED_MALFORMED,          // Body is malformed, respond with 400
+  CWS_CHUNKED_TOO_LARGE           // Body exceeds it's limits, respond with 413
+} cws_chunked_result_t;
+
+/**
+ * @brief Incremental decoder of a chunked transfer-encoded body
+ */
+typedef struct cws_chunked
+{
+  cws_chunked_state_t state;
+
+  // Size of the current chunk which is yet to be decoded
+  size_t chunk_remaining;
+
+  // Length of the current size line or of all trailers
+  size_t line_len;
+
+  // Number of decoded bytes and the maximum thereof
+  size_t decoded;
+  size_t max_len;
+} cws_chunked_t;
+
+/**
+ * @brief Reset a decoder in order to decode a new body
+ * 
+ * @param decoder Decoder to reset
+ * @param max_len Maximum length of the decoded body
+ */
+void cws_chunked_init(cws_chunked_t *decoder, size_t max_len);
+
+/**
+ * @brief Decode as much of the received data as possible, stops after each
+ * piece of chunk data, which is never copied but points into the data
+ * 
+ * @param decoder Decoder keeping the state between calls
+ * @param data Received data, doesn't need to be zero terminated
+ * @param data_len Length of the data
+ * @param consumed Number of bytes the decoder has processed
+ * @param chunk Decoded piece of chunk data, set on CWS_CHUNKED_DATA
+ * @param error_msg Error message output buffer
+ * @return cws_chunked_result_t Outcome of the step
+ */
+cws_chunked_result_t cws_chunked_decode(
+  cws_chunked_t *decoder,
+  char *data, size_t data_len,
+  size_t *consumed, strslice_t *chunk,
+  char **error_msg
+);
+
+#endif
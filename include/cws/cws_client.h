@@ -2,11 +2,88 @@
 #define cws_client_h
 
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
 #include <arpa/inet.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
 #include <pthread.h>
 
 #include "util/mman.h"
+#include "datastruct/bytebuf.h"
+#include "cws/cws_chunked.h"
+
+/*
+============================================================================
+                               Configuration                                
+============================================================================
+*/
+
+// Maximum number of requests served on a persistent connection
+#define CWS_KEEPALIVE_MAX_REQUESTS 100UL
+
+// Time in milliseconds an idle persistent connection is kept open
+#define CWS_KEEPALIVE_TIMEOUT_MS 5000L
+
+// Number of buffers queued up for a batched write before it's written out, the
+// queue only grows beyond that while the socket can't take any more
+#define CWS_CLIENT_MAX_QUEUED 32
+
+// Time in milliseconds a blocking write waits for a full socket buffer to drain
+#define CWS_CLIENT_SEND_TIMEOUT_MS 5000
+
+/*
+============================================================================
+                                   Client                                   
+============================================================================
+*/
+
+// Forward ref, see cws/cws_request.h
+struct cws_request_head;
+
+// Forward refs, see cws/cws_router.h
+struct cws_router;
+struct cws_route_match;
+
+// Forward ref, see below
+struct cws_client;
+
+/**
+ * @brief Receives a request's body chunk by chunk as it arrives
+ * 
+ * @param client Client that's being served
+ * @param chunk Next chunk of the body, not zero terminated and only valid during the call
+ * @param chunk_len Length of the chunk
+ * @param arg Argument passed when registering the handler
+ * 
+ * @return true Chunk has been processed
+ * @return false Request is to be aborted, the handler already responded
+ */
+typedef bool (*cws_body_handler_t)(struct cws_client *client, char *chunk, size_t chunk_len, void *arg);
+
+/**
+ * @brief Stages a client passes through while it's request is being served
+ */
+typedef enum cws_client_state
+{
+  CWS_CS_HEAD,                    // Awaiting the segment containing the head
+  CWS_CS_BODY,                    // Awaiting the remaining body segments
+  CWS_CS_RESPOND,                 // Request complete, awaiting the response
+  CWS_CS_CLOSE                    // Connection is to be closed
+} cws_client_state_t;
+
+/**
+ * @brief A piece of output queued up for writing, either a buffer or a part of a file
+ */
+typedef struct cws_client_out
+{
+  struct iovec iov;               // Buffer, only the length is used for file parts
+  void *ref;                      // Reference held on the buffer, NULL for static buffers
+  int fd;                         // Own descriptor of the file, -1 for buffers
+  off_t offset;                   // Offset the file part starts at
+} cws_client_out_t;
 
 /**
  * @brief Encapsulates a client socket with all it's dependencies
@@ -17,6 +94,69 @@ typedef struct cws_client
   socklen_t *address_size;
   int descriptor;
   pthread_t *thread;
+
+  // Current stage of the serving state machine
+  cws_client_state_t state;
+
+  // Head of the request that's currently being served, reused for every request
+  struct cws_request_head *head;
+
+  // Routes requests to their handlers, NULL if there are no routes, borrowed
+  // from the listening socket, which keeps it alive
+  struct cws_router *router;
+
+  // Route matched by the current request, reused for every request
+  struct cws_route_match *route_match;
+
+  // Receive buffer holding data that's yet to be processed, zero terminated
+  char *rbuf;
+  size_t rbuf_len;
+  size_t rbuf_cap;
+
+  // Receives the current request's body, the body is discarded if NULL
+  cws_body_handler_t body_handler;
+  void *body_handler_arg;
+
+  // Buffered body of the current request, only set if buffering has been opted into
+  bytebuf_t *body;
+
+  // Number of body bytes that have been received and are yet to be read
+  size_t body_received;
+  long seg_data_remaining;
+
+  // Whether the body is chunked, it's length is unknown up front then
+  bool body_chunked;
+  cws_chunked_t chunked;
+
+  // Number of requests received on this connection
+  size_t num_requests;
+
+  // Whether or not the connection persists after the current response
+  bool keep_alive;
+
+  // Monotonic time of the last activity in milliseconds
+  long last_active_ms;
+
+  // Output queued up while corked or while the socket is full, written in order
+  cws_client_out_t *out_queue;
+  size_t out_count;
+  size_t out_cap;
+  bool corked;
+
+  // Whether queued responses are left for the I/O backend to write
+  bool deferred_flush;
+
+  // Whether writes never wait for the socket to drain, output that can't be
+  // written right away stays queued until the I/O backend resumes the client
+  bool nonblocking;
+
+  // Whether queued output is waiting for the non-blocking socket to drain,
+  // no further requests are served until it has been written
+  bool write_blocked;
+
+  // Links within the idle list of the event loop serving this client
+  struct cws_client *_idle_prev;
+  struct cws_client *_idle_next;
 } cws_client_t;
 
 /**
@@ -24,4 +164,138 @@ typedef struct cws_client
  */
 cws_client_t *cws_client_make();
 
-#endif
\ No newline at end of file
+/**
+ * @brief Drop the state of the request that has just been served in order
+ * to await the next request on the same connection
+ * 
+ * @param client Client to reset
+ */
+void cws_client_reset_request(cws_client_t *client);
+
+/**
+ * @brief Send a response to the client, while corked the response is only
+ * queued up and written with all other queued responses on the next flush
+ * 
+ * @param client Recipient
+ * @param buf Managed buffer containing the response, a reference is taken
+ * @param len Number of bytes to send
+ * 
+ * @return true Response has been sent or queued
+ * @return false Connection is down
+ */
+bool cws_client_send(cws_client_t *client, char *buf, size_t len);
+
+/**
+ * @brief Send multiple buffers to the client as one response using a single
+ * vectored write, while corked they're only queued up like single buffers
+ * 
+ * @param client Recipient
+ * @param iov Managed buffers, a reference is taken on each if they're queued up
+ * @param iovcnt Number of buffers
+ * 
+ * @return true Buffers have been sent or queued
+ * @return false Connection is down
+ */
+bool cws_client_sendv(cws_client_t *client, struct iovec *iov, size_t iovcnt);
+
+/**
+ * @brief Send a file's contents straight from the page cache, without passing
+ * them through user space, after all queued up responses have been written,
+ * whatever can't be sent right away is queued up along with a duplicate of
+ * the descriptor
+ * 
+ * @param client Recipient
+ * @param fd Descriptor of the file, only used during the call
+ * @param offset Offset to start sending from
+ * @param len Number of bytes to send
+ * 
+ * @return true File has been sent or queued
+ * @return false Connection is down, timed out or the file couldn't be read
+ */
+bool cws_client_sendfile(cws_client_t *client, int fd, off_t offset, size_t len);
+
+/**
+ * @brief Send a part of a managed buffer, a reference on the whole buffer is
+ * taken if the part is queued up
+ * 
+ * @param client Recipient
+ * @param owner Managed buffer the part lies within
+ * @param buf Start of the part
+ * @param len Length of the part
+ * 
+ * @return true Part has been sent or queued
+ * @return false Connection is down
+ */
+bool cws_client_send_view(cws_client_t *client, void *owner, char *buf, size_t len);
+
+/**
+ * @brief Send static buffers, which live as long as the process and thus
+ * are neither copied nor referenced when they're queued up
+ * 
+ * @param client Recipient
+ * @param iov Static buffers
+ * @param iovcnt Number of buffers
+ * 
+ * @return true Buffers have been sent or queued
+ * @return false Connection is down
+ */
+bool cws_client_sendv_static(cws_client_t *client, struct iovec *iov, size_t iovcnt);
+
+/**
+ * @brief Write all queued up output, consecutive buffers using single vectored
+ * writes, on non-blocking sockets only as much as the socket takes right away
+ * 
+ * @param client Recipient
+ * 
+ * @return true Output has been written, or is left queued while write_blocked
+ * is set, clients with deferred flushing always keep their queue
+ * @return false Connection is down, the queue has been dropped
+ */
+bool cws_client_flush(cws_client_t *client);
+
+/**
+ * @brief Write a whole vector of buffers to the client, resuming after partial
+ * writes, on non-blocking sockets whatever isn't taken right away is copied
+ * and queued up
+ * 
+ * @param client Recipient
+ * @param iov Buffers to write, gets advanced in place
+ * @param iovcnt Number of buffers
+ * 
+ * @return true All buffers have been written or queued
+ * @return false Connection is down or timed out
+ */
+bool cws_client_writev(cws_client_t *client, struct iovec *iov, size_t iovcnt);
+
+/**
+ * @brief Collect the buffers at the front of queued up output into a vector,
+ * up to the first file part
+ * 
+ * @param out Queued up output
+ * @param count Number of queued entries
+ * @param iov Vector output buffer
+ * @param max Capacity of the vector
+ * @return size_t Number of buffers collected, zero if a file part is first
+ */
+size_t cws_client_out_gather(cws_client_out_t *out, size_t count, struct iovec *iov, size_t max);
+
+/**
+ * @brief Advance queued up output by a number of written bytes, releasing all
+ * entries which have been written completely
+ * 
+ * @param out Queued up output
+ * @param count Number of queued entries
+ * @param written Number of bytes written from the front
+ * @return size_t Number of entries which have been written completely
+ */
+size_t cws_client_out_advance(cws_client_out_t *out, size_t count, size_t written);
+
+/**
+ * @brief Release queued up output without writing it
+ * 
+ * @param out Queued up output
+ * @param count Number of queued entries
+ */
+void cws_client_out_drop(cws_client_out_t *out, size_t count);
+
+#endif
@@ -6,21 +6,107 @@
 #include <unistd.h>
 #include <errno.h>
 #include <pthread.h>
+#include <sys/time.h>
 
 #include "cws/cws_client.h"
 #include "cws/cws_common.h"
 #include "cws/cws_request.h"
 #include "cws/cws_response.h"
+#include "cws/cws_router.h"
+#include "util/strfmt.h"
 #include "util/mman.h"
 
-// Size of one HTTP message segment
-// WARNING: This needs to fit a full head in order be able to
-// parse Content-Length in the first packet!
+// Size of one HTTP message segment, which is also the initial capacity of
+// a client's receive buffer
 #define CWS_HANDLER_SEGLEN 8192
 
+// Maximum length of a request head, the receive buffer grows up to this length
+// in order to fit heads spanning multiple segments, longer heads are rejected
+#define CWS_HANDLER_HEAD_MAXLEN (64UL * 1024UL)
+
+// Initial capacity of a buffered request body, which grows by doubling
+#define CWS_HANDLER_BODY_MINCAP 1024UL
+
+// Maximum length of a decoded chunked request body
+#define CWS_HANDLER_CHUNKED_MAXLEN (1024UL * 1024UL * 1024UL)
+
+/**
+ * @brief Represents a stage of the client serving state machine
+ * 
+ * @param client Client that's being served
+ * @param data Received data that's yet to be processed
+ * @param data_len Length of the data
+ * @param consumed Number of bytes the stage has processed, set to zero by the caller
+ * 
+ * @return cws_client_state_t State the client transitions into
+ */
+typedef cws_client_state_t (*cws_client_stage_t)(
+  cws_client_t *client,
+  char *data,
+  size_t data_len,
+  size_t *consumed
+);
+
+/**
+ * @brief Stream the body of the request that's currently being served into
+ * a handler, chunk by chunk as it arrives, without buffering it
+ * 
+ * @param client Client that's being served
+ * @param handler Handler receiving the body's chunks
+ * @param arg Argument passed to the handler
+ */
+void cws_client_stream_body(cws_client_t *client, cws_body_handler_t handler, void *arg);
+
+/**
+ * @brief Buffer the body of the request that's currently being served into
+ * the client's body buffer, requests with larger bodies are rejected with 413
+ * 
+ * @param client Client that's being served
+ * @param max_len Maximum length of the body
+ */
+void cws_client_buffer_body(cws_client_t *client, size_t max_len);
+
+/**
+ * @brief Advance a client's state machine by feeding it a newly received
+ * segment, runs all stages until more data is required or the connection
+ * is to be closed. Every request which is fully contained in the received
+ * data is served, their responses are written using a single vectored write.
+ * Clients with deferred flushing stay corked and keep their responses queued,
+ * non-blocking clients stop serving once their socket is full.
+ * 
+ * @param client Client that's being served
+ * @param seg Segment that has been received
+ * @param seg_len Length of the segment
+ * 
+ * @return cws_client_state_t State the client resides in afterwards
+ */
+cws_client_state_t cws_client_process(cws_client_t *client, char *seg, size_t seg_len);
+
+/**
+ * @brief Continue serving a non-blocking client whose socket has drained, by
+ * writing it's queued up output and then serving the requests which have been
+ * buffered while it was waiting
+ * 
+ * @param client Client that's being served
+ * 
+ * @return cws_client_state_t State the client resides in afterwards
+ */
+cws_client_state_t cws_client_resume(cws_client_t *client);
+
+/**
+ * @brief Serve a client on the calling thread using blocking reads until
+ * it's state machine is done, then close the connection
+ * 
+ * @param client Client to serve
+ */
+void cws_serve_client(cws_client_t *client);
+
 /**
  * @brief Start handling an individual client in it's own thread
+ * 
+ * @param client Client to handle
+ * @param arg Unused handler argument
  */
-void cws_handle_client(cws_client_t *client);
+void cws_handle_client(cws_client_t *client, void *arg);
 
-#endif
\ No newline at end of file
+#endif
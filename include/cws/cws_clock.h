@@ -0,0 +1,50 @@
+#ifndef cws_clock_h
+#define cws_clock_h
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+
+/*
+============================================================================
+                               Configuration                                
+============================================================================
+*/
+
+// Interval in milliseconds the clock is advanced in
+#define CWS_CLOCK_TICK_MS 10
+
+// Number of seconds a formatted Date line stays untouched after it's second
+// has passed, so readers which are still copying it never see a torn line
+#define CWS_CLOCK_DATE_SLOTS 8
+
+// Length of a formatted Date line, including it's CRLF
+#define CWS_CLOCK_DATE_LINE_LEN (sizeof("Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n") - 1)
+
+/*
+============================================================================
+                                   Clock                                    
+============================================================================
+*/
+
+/**
+ * @brief Get the time of the monotonic clock in milliseconds, as of the last
+ * tick of the process-wide coarse clock, which is started on first use
+ * 
+ * The time and the Date line are published separately, each is read with a
+ * single atomic load, but the two aren't guaranteed to stem from the same tick
+ */
+long cws_clock_now_ms();
+
+/**
+ * @brief Get the current Date header line, as of the last tick of the
+ * process-wide coarse clock, which is started on first use
+ * 
+ * @return const char* Date line of CWS_CLOCK_DATE_LINE_LEN bytes, which stays
+ * intact for CWS_CLOCK_DATE_SLOTS seconds, long enough to be copied, but not to
+ * be queued up for writing by reference
+ */
+const char *cws_clock_date_line();
+
+#endif
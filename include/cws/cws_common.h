@@ -8,6 +8,8 @@
 #include <stdarg.h>
 #include <unistd.h>
 #include <errno.h>
+#include <pthread.h>
+#include <time.h>
 
 #include "util/mman.h"
 #include "util/strfmt.h"
@@ -22,6 +24,17 @@
  */
 void cws_print_addr_in(struct sockaddr_in addr);
 
+/**
+ * @brief Pin a thread onto a single core
+ * 
+ * @param thread Thread to pin
+ * @param cpu Core to pin onto, wraps around the number of online cores
+ * 
+ * @return true Thread has been pinned
+ * @return false Could not set the thread's affinity
+ */
+bool cws_pin_thread(pthread_t thread, int cpu);
+
 /**
  * @brief Request parser exit routine, returns true if NULL should be
  * returned by the parser
@@ -44,7 +57,7 @@ void cws_discard_request(cws_client_t *client);
  * @param client Error recipient
  * @param error_cond Error condition
  * @param code Response code for this error
- * @param message Message for this error
+ * @param message Message for this error, unused for codes which have a canned response
  * 
  * @return true Error occurred, message sent
  * @return false Error didn't occur
@@ -0,0 +1,144 @@
+#ifndef cws_conditional_h
+#define cws_conditional_h
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "cws/cws_client.h"
+#include "cws/cws_request.h"
+#include "cws/cws_response.h"
+#include "util/strslice.h"
+
+/*
+============================================================================
+                               Configuration                                
+============================================================================
+*/
+
+// Maximum length of a generated entity tag, including it's quotes, weakness
+// prefix and terminator
+#define CWS_ETAG_MAXLEN 64
+
+// Length of a formatted HTTP date, including the terminator
+#define CWS_HTTP_DATE_LEN sizeof("Sun, 06 Nov 1994 08:49:37 GMT")
+
+/*
+============================================================================
+                                 Validators                                 
+============================================================================
+*/
+
+/**
+ * @brief Generate an entity tag by hashing a body's contents, a strong tag
+ * changes with every byte, a weak one is meant for semantically equivalent
+ * variants of a body
+ * 
+ * @param body Body contents
+ * @param body_len Length of the body
+ * @param weak Whether or not to mark the tag as weak
+ * @param etag Output buffer of CWS_ETAG_MAXLEN bytes, zero terminated
+ * @return size_t Length of the tag
+ */
+size_t cws_etag_body(const char *body, size_t body_len, bool weak, char *etag);
+
+/**
+ * @brief Generate a strong entity tag for a file from it's inode, size and
+ * modification time, without reading any of it
+ * 
+ * @param st Metadata of the file
+ * @param etag Output buffer of CWS_ETAG_MAXLEN bytes, zero terminated
+ * @return size_t Length of the tag
+ */
+size_t cws_etag_file(struct stat *st, char *etag);
+
+/**
+ * @brief Check whether or not a list of entity tags, as sent within If-None-Match,
+ * contains a tag, using the weak comparison
+ * 
+ * @param list Comma separated list of tags or *
+ * @param etag Tag to look for
+ * @return true Tag is listed
+ * @return false Tag is not listed
+ */
+bool cws_etag_listed(strslice_t list, strslice_t etag);
+
+/**
+ * @brief Format a timestamp as a HTTP date (IMF-fixdate)
+ * 
+ * @param time Seconds since the epoch
+ * @param date Output buffer of CWS_HTTP_DATE_LEN bytes, zero terminated
+ */
+void cws_http_date_format(time_t time, char *date);
+
+/**
+ * @brief Parse a HTTP date, only the IMF-fixdate format is supported, others
+ * are treated like invalid dates, which conditions ignore
+ * 
+ * @param date Formatted date
+ * @param time Output for the seconds since the epoch
+ * @return true Date parsed
+ * @return false Date is malformed
+ */
+bool cws_http_date_parse(strslice_t date, time_t *time);
+
+/*
+============================================================================
+                            Conditional requests                            
+============================================================================
+*/
+
+/**
+ * @brief Evaluate If-None-Match and If-Modified-Since of a GET or HEAD request,
+ * If-Modified-Since is only considered if If-None-Match is absent
+ * 
+ * @param head Request head
+ * @param etag Current entity tag, empty if there is none
+ * @param last_modified Current modification time, negative if there is none
+ * @return true The client's copy is current, respond with 304
+ * @return false The representation has to be sent
+ */
+bool cws_conditional_not_modified(cws_request_head_t *head, strslice_t etag, time_t last_modified);
+
+/**
+ * @brief Respond with 304 if the client's copy is current, meant to be called
+ * before the body is produced
+ * 
+ * @param client Client that's being served
+ * @param response Headers of the response, should carry the validators
+ * @param etag Current entity tag, empty if there is none
+ * @param last_modified Current modification time, negative if there is none
+ * @return true Request has been answered with 304
+ * @return false The representation has to be sent
+ */
+bool cws_conditional_respond(
+  cws_client_t *client,
+  cws_response_t *response,
+  strslice_t etag,
+  time_t last_modified
+);
+
+/**
+ * @brief Send a managed body along with a strong entity tag of it's contents,
+ * or only a 304 if the client's copy is current
+ * 
+ * @param client Client that's being served
+ * @param response Additional headers, leave NULL for none
+ * @param body Managed buffer containing the body, a reference is taken
+ * @param body_len Length of the body
+ * @return true Response sent
+ * @return false Could not build response or connection is down
+ */
+bool cws_conditional_send_buf(
+  cws_client_t *client,
+  cws_response_t *response,
+  char *body,
+  size_t body_len
+);
+
+#endif
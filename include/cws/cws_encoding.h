@@ -0,0 +1,142 @@
+#ifndef cws_encoding_h
+#define cws_encoding_h
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include <zlib.h>
+
+#include "cws/cws_request.h"
+#include "cws/cws_conditional.h"
+#include "util/mman.h"
+#include "util/strslice.h"
+
+/*
+============================================================================
+                               Configuration                                
+============================================================================
+*/
+
+// Compression level of gzip, from 1 (fastest) to 9 (smallest)
+#define CWS_ENCODING_GZIP_LEVEL 6
+
+// Bodies shorter than this are sent as they are, compressing them isn't worth it
+#define CWS_ENCODING_MIN_LEN 1024
+
+// Bodies longer than this are neither compressed on the fly nor cached
+#define CWS_ENCODING_MAX_LEN (256 * 1024)
+
+// Number of independently locked shards of the compression cache
+#define CWS_ENCODING_CACHE_SHARDS 16
+
+// Number of compressed variants each shard of the cache holds at most
+#define CWS_ENCODING_CACHE_SHARD_SIZE 8
+
+/*
+============================================================================
+                                 Encodings                                  
+============================================================================
+*/
+
+/**
+ * @brief Content codings a body can be sent in
+ */
+typedef enum cws_encoding
+{
+  CWS_ENCODING_IDENTITY,          // Sent as it is
+  CWS_ENCODING_GZIP               // Compressed by gzip
+} cws_encoding_t;
+
+/**
+ * @brief Choose the encoding to send a body in by the request's Accept-Encoding
+ * 
+ * @param head Request head
+ * @return cws_encoding_t Best encoding the client accepts
+ */
+cws_encoding_t cws_encoding_negotiate(cws_request_head_t *head);
+
+/**
+ * @brief Get the name of an encoding, as used within Content-Encoding
+ * 
+ * @param encoding Encoding
+ * @return const char* Name of the encoding, NULL for identity
+ */
+const char *cws_encoding_name(cws_encoding_t encoding);
+
+/**
+ * @brief Check whether or not bodies of a content type are worth compressing,
+ * which excludes media which has been compressed already
+ * 
+ * @param content_type Content type, parameters are ignored
+ * @return true Content type is textual
+ * @return false Content type is binary or unknown
+ */
+bool cws_encoding_compressible(strslice_t content_type);
+
+/**
+ * @brief Compress a body, using a deflate state which is reused by the current thread
+ * 
+ * @param encoding Encoding to compress into
+ * @param body Body to compress
+ * @param body_len Length of the body
+ * @param encoded_len Output for the length of the compressed body
+ * @return char* Managed compressed body, NULL if it couldn't be
+ * compressed or wouldn't become any smaller
+ */
+char *cws_encoding_compress(cws_encoding_t encoding, const char *body, size_t body_len, size_t *encoded_len);
+
+/*
+============================================================================
+                             Compression cache                              
+============================================================================
+*/
+
+/**
+ * @brief A compressed variant of a resource's body, kept inline within it's shard
+ */
+typedef struct cws_encoding_variant
+{
+  char *resource;                 // Managed name of the resource, NULL if the slot is free
+  size_t resource_len;            // Length of the resource's name
+  char etag[CWS_ETAG_MAXLEN];     // Strong entity tag of the uncompressed body
+  size_t etag_len;                // Length of the entity tag
+  cws_encoding_t encoding;        // Encoding of the variant
+  char *body;                     // Managed compressed body, NULL if compressing isn't worth it
+  size_t body_len;                // Length of the compressed body
+} cws_encoding_variant_t;
+
+/**
+ * @brief Look up a compressed variant of a resource's body, the strong entity
+ * tag identifies the version of the resource, so variants of outdated versions
+ * are never hit and simply age out. Entity tags are only unique per resource,
+ * so handlers only qualify by naming their resource, see cws_response_set_resource.
+ * 
+ * @param resource Name of the resource, like a file's path
+ * @param etag Strong entity tag of the uncompressed body
+ * @param encoding Encoding of the variant
+ * @param body Output for a reference to the compressed body, NULL if it's not worth compressing
+ * @param body_len Output for the length of the compressed body
+ * @return true Variant is cached
+ * @return false Variant is not cached
+ */
+bool cws_encoding_cache_get(strslice_t resource, strslice_t etag, cws_encoding_t encoding, char **body, size_t *body_len);
+
+/**
+ * @brief Get the compressed variant of a resource's body from the cache or
+ * compress and cache it, bodies above CWS_ENCODING_MAX_LEN are compressed but not cached
+ * 
+ * @param resource Name of the resource, like a file's path
+ * @param etag Strong entity tag of the uncompressed body
+ * @param encoding Encoding of the variant
+ * @param body Uncompressed body
+ * @param body_len Length of the uncompressed body
+ * @param encoded_len Output for the length of the compressed body
+ * @return char* Reference to the managed compressed body, NULL if it's not worth compressing
+ */
+char *cws_encoding_variant(strslice_t resource, strslice_t etag, cws_encoding_t encoding, const char *body, size_t body_len, size_t *encoded_len);
+
+#endif
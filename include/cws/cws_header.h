@@ -0,0 +1,70 @@
+#ifndef cws_header_h
+#define cws_header_h
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <strings.h>
+
+#include "util/strslice.h"
+
+/**
+ * @brief A single header of a request, viewing onto the raw head
+ */
+typedef struct cws_header
+{
+  strslice_t key;
+  strslice_t value;
+} cws_header_t;
+
+/**
+ * @brief Well-known headers, which are interned into fixed slots of a head
+ */
+typedef enum cws_header_id
+{
+  CWS_HDR_HOST,
+  CWS_HDR_CONTENT_LENGTH,
+  CWS_HDR_CONTENT_TYPE,
+  CWS_HDR_CONNECTION,
+  CWS_HDR_TRANSFER_ENCODING,
+  CWS_HDR_COOKIE,
+  CWS_HDR_ACCEPT,
+  CWS_HDR_ACCEPT_ENCODING,
+  CWS_HDR_ACCEPT_LANGUAGE,
+  CWS_HDR_IF_NONE_MATCH,
+  CWS_HDR_IF_MODIFIED_SINCE,
+  CWS_HDR_IF_RANGE,
+  CWS_HDR_RANGE,
+  CWS_HDR_USER_AGENT,
+  CWS_HDR_AUTHORIZATION,
+  CWS_HDR_EXPECT,
+  CWS_HDR_UPGRADE,
+  CWS_HDR_REFERER,
+  CWS_HDR_ORIGIN,
+  CWS_HDR_CACHE_CONTROL,
+  CWS_HDR_KEEP_ALIVE,
+  CWS_HDR_TE,
+  CWS_HDR_X_FORWARDED_FOR,
+  CWS_HDR_TRACEPARENT,
+
+  // Number of well-known headers, also marks unknown headers
+  CWS_HDR_UNKNOWN
+} cws_header_id_t;
+
+/**
+ * @brief Get the canonical name of a well-known header
+ * 
+ * @param id Well-known header
+ * @return const char* Name of the header, NULL for unknown headers
+ */
+const char *cws_header_name(cws_header_id_t id);
+
+/**
+ * @brief Resolve a header's name to it's well-known header using a perfect
+ * hash, ignoring case
+ * 
+ * @param name Name of the header
+ * @return cws_header_id_t Well-known header, CWS_HDR_UNKNOWN if it's not well-known
+ */
+cws_header_id_t cws_header_lookup(strslice_t name);
+
+#endif
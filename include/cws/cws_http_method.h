@@ -5,6 +5,8 @@
 #include <stdbool.h>
 #include <string.h>
 
+#include "util/strslice.h"
+
 typedef enum
 {
   OPTIONS,
@@ -17,6 +19,9 @@ typedef enum
   CONNECT
 } cws_http_method_t;
 
+// Number of HTTP methods, for tables indexed by the method
+#define CWS_HTTP_NUM_METHODS (CONNECT + 1)
+
 /**
  * @brief Turn the numeric HTTP method into it's string representation
  * 
@@ -34,6 +39,6 @@ const char *cws_http_method_stringify(cws_http_method_t method);
  * @return true Could parse successfully
  * @return false Invalid method provided
  */
-bool cws_http_method_parse(char *string, cws_http_method_t *output);
+bool cws_http_method_parse(strslice_t string, cws_http_method_t *output);
 
 #endif
\ No newline at end of file
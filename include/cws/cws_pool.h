@@ -0,0 +1,108 @@
+#ifndef cws_pool_h
+#define cws_pool_h
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "cws/cws_client.h"
+#include "cws/cws_client_handler.h"
+#include "cws/cws_clock.h"
+#include "cws/cws_common.h"
+#include "datastruct/deque.h"
+#include "util/mman.h"
+
+/*
+============================================================================
+                               Configuration                                
+============================================================================
+*/
+
+// Maximum number of clients queued up per worker
+#define CWS_POOL_QUEUE_LEN 1024UL
+
+// Maximum number of events the poller fetches per wait
+#define CWS_POOL_MAX_EVENTS 64
+
+// Maximum time in milliseconds the poller waits for events before checking for idle clients
+#define CWS_POOL_TICK_MS 1000L
+
+/*
+============================================================================
+                                    Pool                                    
+============================================================================
+*/
+
+// Forward ref
+struct cws_pool;
+
+/**
+ * @brief A worker thread with it's own run queue of clients
+ */
+typedef struct cws_pool_worker
+{
+  deque_t *queue;                 // Run queue, owner pops back, thieves pop front
+  pthread_mutex_t lock;           // Guards the run queue
+  sem_t wakeup;                   // Posted once to wake the worker from it's sleep
+  volatile bool idle;             // Whether the worker is about to sleep, awaiting a wakeup
+  pthread_t thread;               // Thread of the worker
+  bool thread_active;             // Whether or not the worker thread is active
+  size_t id;                      // Index of this worker within the pool
+  char *seg;                      // Segment buffer shared by all clients of this worker
+  struct cws_pool *pool;          // Pool this worker belongs to
+} cws_pool_worker_t;
+
+/**
+ * @brief A fixed size set of workers serving clients, idle workers steal
+ * work from the queues of busy workers and sleep once there's none left,
+ * connections waiting for their next request are parked with a poller thread,
+ * which submits them again once they turn readable
+ */
+typedef struct cws_pool
+{
+  cws_pool_worker_t *workers;     // Workers of this pool
+  size_t num_workers;             // Number of workers
+  volatile size_t next_worker;    // Round robin counter for distributing clients
+  int epoll_fd;                   // Descriptor of the poller's epoll instance
+  pthread_t poller;               // Thread watching parked clients
+  bool poller_active;             // Whether or not the poller thread is active
+  cws_client_t *parked;           // Parked clients not yet tracked by the poller
+  cws_client_t *idle_head;        // Least recently parked client
+  cws_client_t *idle_tail;        // Most recently parked client
+} cws_pool_t;
+
+/**
+ * @brief Create a new pool and start all of it's worker threads
+ * 
+ * @param num_workers Number of workers, zero means one per online core
+ * 
+ * @return cws_pool_t* Running pool, NULL on errors
+ */
+cws_pool_t *cws_pool_make(size_t num_workers);
+
+/**
+ * @brief Enqueue a client to be served by one of the pool's workers
+ * 
+ * @param pool Pool to enqueue into
+ * @param client Client to be served
+ * 
+ * @return true Client has been enqueued
+ * @return false All run queues are full
+ */
+bool cws_pool_submit(cws_pool_t *pool, cws_client_t *client);
+
+/**
+ * @brief Client handler which enqueues the client into the pool,
+ * use this in combination with cws_socket_listen, workers serve a connection
+ * until it's idle between two requests, then park it instead of waiting
+ * 
+ * @param client Client to handle
+ * @param arg Pool to enqueue into
+ */
+void cws_pool_handle_client(cws_client_t *client, void *arg);
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef cws_range_h
+#define cws_range_h
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "cws/cws_request.h"
+#include "cws/cws_conditional.h"
+#include "util/strslice.h"
+
+/*
+============================================================================
+                               Configuration                                
+============================================================================
+*/
+
+// Maximum number of ranges a request may ask for, requests for more ranges
+// are answered with the full representation instead of many tiny parts
+#define CWS_RANGE_MAX 16
+
+/*
+============================================================================
+                                   Ranges                                   
+============================================================================
+*/
+
+/**
+ * @brief A satisfiable range of bytes within a representation
+ */
+typedef struct cws_range
+{
+  uint64_t start;                 // Offset of the first byte
+  uint64_t len;                   // Number of bytes, never zero
+} cws_range_t;
+
+/**
+ * @brief How a request's Range header is to be answered
+ */
+typedef enum cws_range_result
+{
+  CWS_RANGE_FULL,                 // No usable ranges, respond with the full representation
+  CWS_RANGE_PARTIAL,              // Respond with 206 and the parsed ranges
+  CWS_RANGE_UNSATISFIABLE         // No range overlaps the representation, respond with 416
+} cws_range_result_t;
+
+/**
+ * @brief Parse the value of a Range header, ranges which don't overlap the
+ * representation are dropped, the remaining ones are sorted and overlapping
+ * or adjacent ranges are coalesced
+ * 
+ * @param header Value of the Range header
+ * @param size Size of the representation
+ * @param ranges Output buffer of CWS_RANGE_MAX ranges
+ * @param num_ranges Output for the number of ranges
+ * @return cws_range_result_t CWS_RANGE_FULL if the header is malformed, uses
+ * another unit or asks for too many ranges
+ */
+cws_range_result_t cws_range_parse(strslice_t header, uint64_t size, cws_range_t *ranges, size_t *num_ranges);
+
+/**
+ * @brief Evaluate If-Range, ranges are only served if the client's copy is
+ * still current, entity tags are compared strongly, dates have to match exactly
+ * 
+ * @param head Request head
+ * @param etag Current entity tag, empty if there is none
+ * @param last_modified Current modification time, negative if there is none
+ * @return true Ranges may be served
+ * @return false The full representation has to be sent
+ */
+bool cws_range_if_range(cws_request_head_t *head, strslice_t etag, time_t last_modified);
+
+/**
+ * @brief Evaluate the Range and If-Range headers of a request, ranges are
+ * only served for GET
+ * 
+ * @param head Request head
+ * @param etag Current entity tag, empty if there is none
+ * @param last_modified Current modification time, negative if there is none
+ * @param size Size of the representation
+ * @param ranges Output buffer of CWS_RANGE_MAX ranges
+ * @param num_ranges Output for the number of ranges
+ * @return cws_range_result_t How to respond
+ */
+cws_range_result_t cws_range_evaluate(
+  cws_request_head_t *head,
+  strslice_t etag,
+  time_t last_modified,
+  uint64_t size,
+  cws_range_t *ranges,
+  size_t *num_ranges
+);
+
+#endif
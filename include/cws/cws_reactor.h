@@ -0,0 +1,79 @@
+#ifndef cws_reactor_h
+#define cws_reactor_h
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "cws/cws_client.h"
+#include "cws/cws_client_handler.h"
+#include "cws/cws_clock.h"
+#include "util/mman.h"
+
+/*
+============================================================================
+                               Configuration                                
+============================================================================
+*/
+
+// Maximum number of events a loop fetches per wait
+#define CWS_REACTOR_MAX_EVENTS 64
+
+// Maximum time in milliseconds a loop waits for events before checking for idle clients
+#define CWS_REACTOR_TICK_MS 1000L
+
+/*
+============================================================================
+                                  Reactor                                   
+============================================================================
+*/
+
+/**
+ * @brief An event loop multiplexing non-blocking clients on a single thread
+ */
+typedef struct cws_reactor_loop
+{
+  int epoll_fd;                   // Descriptor of the loop's epoll instance
+  pthread_t thread;               // Thread running the loop
+  bool thread_active;             // Whether or not the loop thread is active
+  char *seg;                      // Segment buffer shared by all clients of this loop
+  cws_client_t *incoming;         // Registered clients not yet tracked by the loop
+  cws_client_t *idle_head;        // Least recently active client
+  cws_client_t *idle_tail;        // Most recently active client
+} cws_reactor_loop_t;
+
+/**
+ * @brief A set of event loops clients get distributed onto
+ */
+typedef struct cws_reactor
+{
+  cws_reactor_loop_t *loops;      // Event loops
+  size_t num_loops;               // Number of event loops
+  volatile size_t next_loop;      // Round robin counter for distributing clients
+} cws_reactor_t;
+
+/**
+ * @brief Create a new reactor and start all of it's event loop threads
+ * 
+ * @param num_loops Number of event loops, zero means one per online core
+ * @param cpu Core to pin the first loop onto, following loops are pinned onto
+ * the following cores, -1 for no pinning
+ * 
+ * @return cws_reactor_t* Running reactor, NULL on errors
+ */
+cws_reactor_t *cws_reactor_make(size_t num_loops, int cpu);
+
+/**
+ * @brief Client handler which registers the client with one of the reactor's
+ * event loops, use this in combination with cws_socket_listen
+ * 
+ * @param client Client to handle
+ * @param arg Reactor to register with
+ */
+void cws_reactor_handle_client(cws_client_t *client, void *arg);
+
+#endif
@@ -3,11 +3,13 @@
 
 #include "cws/cws_http_method.h"
 #include "cws/cws_uri.h"
+#include "cws/cws_header.h"
 #include "cws/cws_common.h"
 #include "datastruct/htable.h"
 #include "util/longp.h"
 #include "util/mman.h"
-#include "util/partial_strdup.h"
+#include "util/strslice.h"
+#include "util/strscan.h"
 #include <stdarg.h>
 
 /*
@@ -15,7 +17,7 @@
                                Configuration                                
 ============================================================================
 */
-// Maximum number of headers the hash table can grow to
+// Maximum number of headers which aren't well-known a request may carry
 #define CWS_MAX_NUM_HEADERS 64UL
 
 /*
@@ -25,22 +27,54 @@
 */
 
 /**
- * @brief Represents a HTTP request's head
+ * @brief Part of the head an incremental parse is currently awaiting
+ */
+typedef enum cws_head_part
+{
+  CWS_HP_REQUEST_LINE,            // Awaiting the request line
+  CWS_HP_HEADERS,                 // Awaiting header lines or the empty line
+  CWS_HP_DONE                     // Head is complete
+} cws_head_part_t;
+
+/**
+ * @brief Outcome of feeding data into an incremental head parse
+ */
+typedef enum cws_head_parse_result
+{
+  CWS_HEAD_INCOMPLETE,            // More data is needed to complete the head
+  CWS_HEAD_COMPLETE,              // Head is complete and parsed
+  CWS_HEAD_TOO_LARGE,             // Head exceeds it's limits, respond with 431
+  CWS_HEAD_MALFORMED              // Head is malformed, respond with 400
+} cws_head_parse_result_t;
+
+/**
+ * @brief Represents a HTTP request's head, all slices view onto the raw head
+ * which thus has to outlive the parsed head
  */
 typedef struct cws_request_head
 {
+  // Raw head this head has been parsed from, only the parsed part while incomplete
+  strslice_t raw;
+
+  // Part of the head the parser awaits next, the raw head's length is
+  // where it resumes on the next feed
+  cws_head_part_t part;
+
+  // Number of bytes which have already been searched for the current line's end
+  size_t scanned;
+
   // Request method performed on the URI
   cws_http_method_t method;
 
   // Requested resource
-  cws_uri_t *uri;
+  cws_uri_t uri;
 
-  // key: headerfname string
-  // value: header value string
-  htable_t *headers;
+  // Values of the well-known headers by their ID, slices are NULL if absent
+  strslice_t known_headers[CWS_HDR_UNKNOWN];
 
-  // Part of the body, which has been within the first segment
-  char *body_part;
+  // All other headers in the order of their appearance, as well as repeated well-known headers
+  cws_header_t headers[CWS_MAX_NUM_HEADERS];
+  size_t num_headers;
 
   // Http version
   long http_ver_major;
@@ -48,25 +82,88 @@ typedef struct cws_request_head
 } cws_request_head_t;
 
 /**
- * @brief Represents a stage of request head parsing
+ * @brief Represents a stage of request line parsing
  * @returns true On successful execution
  * @returns false On errors, error-description is set in err
  */
 typedef bool (*cws_head_parser_t)(
-  char *req,                    // Full request string
+  char *req,                    // Request line
+  size_t req_len,               // Length of the request line
   size_t *offs,                 // Offset pointer for change in place
   cws_request_head_t *result,   // Parse result to which partial results are applied
   char **err                    // Error buffer ptr
 );
 
 /**
- * @brief Parse a web request by it's raw request string
+ * @brief Create a new empty request head, which can be parsed into repeatedly
+ */
+cws_request_head_t *cws_request_head_make();
+
+/**
+ * @brief Reset a head in order to start parsing the next request into it
+ * 
+ * @param head Head to reset
+ */
+void cws_request_head_reset(cws_request_head_t *head);
+
+/**
+ * @brief Feed the data received so far into an incremental head parse. Every
+ * line is only parsed once, the parse resumes where the last feed stopped.
+ * The data has to start with the same bytes on every feed, but may have been
+ * moved in between, in which case the head is rebased onto it's new location.
+ * 
+ * @param head Head to parse into, reset before parsing the next request
+ * @param data Data received so far, doesn't need to be zero terminated
+ * @param data_len Length of the data
+ * @param max_len Maximum length of the head
+ * @param head_len Length of the head output buffer, set on completion
+ * @param error_msg Error message output buffer
+ * @return cws_head_parse_result_t Outcome of the parse
+ */
+cws_head_parse_result_t cws_request_head_feed(
+  cws_request_head_t *head,
+  char *data, size_t data_len, size_t max_len,
+  size_t *head_len, char **error_msg
+);
+
+/**
+ * @brief Parse a web request's head by it's raw string, which ends
+ * after the empty line terminating the headers, without copying any of it
  * 
- * @param request Raw request string
+ * @param request Raw head string, doesn't need to be zero terminated
+ * @param request_len Length of the raw head string
+ * @param head Head to parse into, previous results are overwritten
  * @param error_msg Error message output buffer
- * @return cws_request_t* Parsed result, NULL when an error occurred
+ * @return true Head parsed successfully
+ * @return false Could not parse the head
+ */
+bool cws_request_head_parse(char *request, size_t request_len, cws_request_head_t *head, char **error_msg);
+
+/**
+ * @brief Move all slices of a parsed head onto a new location of it's raw head
+ * 
+ * @param head Parsed head
+ * @param raw New location of the raw head, which has been copied there unchanged
+ */
+void cws_request_head_rebase(cws_request_head_t *head, char *raw);
+
+/**
+ * @brief Look up the value of a well-known header in constant time
+ * 
+ * @param head Parsed head
+ * @param id Well-known header
+ * @return strslice_t* Value of the header, NULL if absent
+ */
+strslice_t *cws_request_head_known(cws_request_head_t *head, cws_header_id_t id);
+
+/**
+ * @brief Look up the value of a header by it's name, ignoring case
+ * 
+ * @param head Parsed head
+ * @param name Name of the header
+ * @return strslice_t* Value of the first header with this name, NULL if absent
  */
-cws_request_head_t *cws_request_head_parse(char *request, char **error_msg);
+strslice_t *cws_request_head_header(cws_request_head_t *head, const char *name);
 
 /*
 ============================================================================
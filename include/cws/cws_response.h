@@ -2,33 +2,138 @@
 #define cws_response_h
 
 #include "cws/cws_client.h"
+#include "cws/cws_clock.h"
+#include "cws/cws_header.h"
 #include "cws/cws_response_code.h"
-#include "datastruct/htable.h"
+#include "util/strslice.h"
+
+/*
+============================================================================
+                               Configuration                                
+============================================================================
+*/
 
 // Initial size of the response-buffer, it grows as needed
 #define CWS_RESPONSE_BUFFER 1024
 
-// Maximum number of headers the response can contain
-// This includes automatic (required) headers
-#define CWS_RESPONSE_MAX_HEADERS 64
+// Maximum number of headers the caller can add to a response, not
+// including automatic (required) headers
+#define CWS_RESPONSE_MAX_HEADERS 16
+
+// Value of the Server header
+#define CWS_RESPONSE_SERVER "cWebSrv/0.0.1"
+
+// Maximum length of a canned response
+#define CWS_RESPONSE_CANNED_MAXLEN 256
+
+/*
+============================================================================
+                                  Response                                  
+============================================================================
+*/
+
+/**
+ * @brief Headers which are added to every response automatically
+ */
+typedef enum cws_response_required
+{
+  CWS_RH_CONNECTION,              // Fixed, frames the response
+  CWS_RH_KEEP_ALIVE,              // Fixed, frames the response
+  CWS_RH_CONTENT_LENGTH,          // Fixed, frames the response
+  CWS_RH_CONTENT_TYPE,            // Can be overridden
+  CWS_RH_SERVER,                  // Can be overridden
+  CWS_RH_DATE,                    // Can be overridden
+  CWS_RH_COUNT
+} cws_response_required_t;
+
+/**
+ * @brief Headers of a response, held inline so building a response doesn't
+ * allocate anything but it's serialized head
+ */
+typedef struct cws_response
+{
+  // Headers added by the caller, viewing onto the caller's strings, which
+  // have to stay valid until the response has been sent
+  cws_header_t headers[CWS_RESPONSE_MAX_HEADERS];
+  size_t num_headers;
+
+  // Preformatted header lines appended as they are, viewing onto the
+  // caller's buffer, which has to stay valid until the response has been sent
+  strslice_t lines;
+
+  // Stable name of the resource the body represents, viewing onto the caller's
+  // string, compressed variants are cached under it, empty if they're not cached
+  strslice_t resource;
+
+  // Required headers the caller has overridden, as a bit per cws_response_required_t
+  unsigned int overridden;
+} cws_response_t;
+
+/**
+ * @brief Initialize a response without any headers
+ * 
+ * @param response Response to initialize
+ */
+void cws_response_init(cws_response_t *response);
+
+/**
+ * @brief Add a header to a response, a required header is overridden if it
+ * may be, headers framing the response are ignored
+ * 
+ * @param response Response to add to
+ * @param key Name of the header
+ * @param value Value of the header
+ * 
+ * @return true Header added
+ * @return false Maximum number of headers reached or header frames the response
+ */
+bool cws_response_add_header(cws_response_t *response, const char *key, const char *value);
+
+/**
+ * @brief Set preformatted header lines of a response, which are copied into
+ * it's head without being looked at, so headers which rarely change can be
+ * formatted once up front
+ * 
+ * @param response Response to add to
+ * @param lines Header lines, each terminated by a CRLF
+ * @param len Length of the lines
+ * @param overrides Required headers contained within the lines, as a bit per cws_response_required_t
+ * 
+ * @return true Lines set
+ * @return false Lines frame the response
+ */
+bool cws_response_set_lines(cws_response_t *response, const char *lines, size_t len, unsigned int overrides);
+
+/**
+ * @brief Opt a response into caching the compressed variants of it's body,
+ * which are looked up by the resource's name along with the response's strong
+ * ETag, so the tag has to change whenever the resource's body does
+ * 
+ * @param response Response to opt in
+ * @param resource Name of the resource, like the request's path, has to stay
+ * valid until the response has been sent
+ * @param len Length of the name
+ */
+void cws_response_set_resource(cws_response_t *response, const char *resource, size_t len);
 
 typedef bool (*cws_response_builder_t)(
   cws_client_t *client,      // Response recipient
   cws_response_code_t code,  // Response code
-  htable_t *headers,         // Caller defined response headers
-  htable_t *header_buf,      // Response header builder buffer
-  char *body,                // Response body
+  cws_response_t *response,  // Caller defined response headers
+  size_t body_len,           // Length of the response body
   size_t *offs,              // Offset pointer for change in place
-  char **response            // Response message buffer
+  char **head                // Response head buffer
 );
 
 /**
- * @brief Sends a HTTP response to the active client connection
+ * @brief Sends a HTTP response to the active client connection, the head and
+ * the body are written using a single vectored write, responses to HEAD
+ * requests only consist of the head, which announces the body's length
  * 
  * @param client Recipient reference
  * @param code HTTP status code
- * @param headers Additional header map, leave NULL for none
- * @param body Body contents, leave NULL for none
+ * @param response Additional headers, leave NULL for none
+ * @param body Body contents, leave NULL for none, copied if it can't be written right away
  * 
  * @return true Response built and sent to client
  * @return false Could not build response or connection is down
@@ -36,8 +141,61 @@ typedef bool (*cws_response_builder_t)(
 bool cws_response_send(
   cws_client_t *client,
   cws_response_code_t code,
-  htable_t *headers,
+  cws_response_t *response,
   char *body
 );
 
+/**
+ * @brief Sends a HTTP response with a managed body, which is never copied but
+ * referenced until it has been written, and left out for HEAD requests
+ * 
+ * @param client Recipient reference
+ * @param code HTTP status code
+ * @param response Additional headers, leave NULL for none
+ * @param body Managed buffer containing the body, a reference is taken
+ * @param body_len Length of the body, which may contain zero bytes
+ * 
+ * @return true Response built and sent to client
+ * @return false Could not build response or connection is down
+ */
+bool cws_response_send_buf(
+  cws_client_t *client,
+  cws_response_code_t code,
+  cws_response_t *response,
+  char *body,
+  size_t body_len
+);
+
+/**
+ * @brief Sends only the head of a HTTP response, the caller sends the body
+ * right afterwards, or omits it when responding to a HEAD request
+ * 
+ * @param client Recipient reference
+ * @param code HTTP status code
+ * @param response Additional headers, leave NULL for none
+ * @param body_len Length of the body that follows
+ * 
+ * @return true Head built and sent to client
+ * @return false Could not build head or connection is down
+ */
+bool cws_response_send_head(
+  cws_client_t *client,
+  cws_response_code_t code,
+  cws_response_t *response,
+  size_t body_len
+);
+
+/**
+ * @brief Sends one of the error responses which have been serialized on
+ * startup, along with the queued responses, using a single vectored write
+ * which only allocates if the response can't be written right away
+ * 
+ * @param client Recipient reference
+ * @param code HTTP status code, one of 400, 404, 413, 431, 500 or 503
+ * 
+ * @return true Response sent to client
+ * @return false There is no canned response for the code or connection is down
+ */
+bool cws_response_send_canned(cws_client_t *client, cws_response_code_t code);
+
 #endif
\ No newline at end of file
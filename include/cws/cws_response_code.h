@@ -2,6 +2,12 @@
 #define cws_response_code_h
 
 #include <stddef.h>
+#include <stdio.h>
+
+#include "util/common_macros.h"
+
+// Maximum length of a status line, including it's CRLF
+#define CWS_RESPONSE_STATUS_LINE_MAXLEN 64
 
 typedef enum cws_response_code
 {
@@ -107,4 +113,14 @@ typedef enum cws_response_code
  */
 const char *cws_response_code_stringify(cws_response_code_t code);
 
+/**
+ * @brief Get the complete status line of a response code, which has been
+ * formatted once on startup
+ * 
+ * @param code Response code
+ * @param len Length of the status line output buffer
+ * @return const char* Status line including it's CRLF, NULL for invalid codes
+ */
+const char *cws_response_status_line(cws_response_code_t code, size_t *len);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,271 @@
+#ifndef cws_router_h
+#define cws_router_h
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "cws/cws_client.h"
+#include "cws/cws_common.h"
+#include "cws/cws_http_method.h"
+#include "util/mman.h"
+#include "util/epoch.h"
+#include "util/strslice.h"
+#include "util/strscan.h"
+
+/*
+============================================================================
+                               Configuration                                
+============================================================================
+*/
+
+// Maximum number of parameters a route's pattern may capture
+#define CWS_ROUTER_MAX_PARAMS 16
+
+/*
+============================================================================
+                                   Routes                                   
+============================================================================
+*/
+
+// Forward refs, see below
+struct cws_route_match;
+struct cws_route_pin;
+
+/**
+ * @brief Handles a request matching a route
+ * 
+ * @param client Client that's being served
+ * @param match Matched route and it's captured parameters
+ * @param arg Argument passed when adding the route
+ */
+typedef void (*cws_route_handler_t)(cws_client_t *client, struct cws_route_match *match, void *arg);
+
+/**
+ * @brief A route's handlers for a single method
+ */
+typedef struct cws_route
+{
+  // Responds once the request, including it's body, has been received
+  cws_route_handler_t handler;
+
+  // Called right after the head has been received, in order to opt into
+  // streaming or buffering the body, leave NULL in order to discard the body
+  cws_route_handler_t head_handler;
+
+  // Argument passed to both handlers
+  void *arg;
+} cws_route_t;
+
+/**
+ * @brief A parameter captured by a :param or *wildcard segment
+ */
+typedef struct cws_route_param
+{
+  strslice_t name;                // Name as found in the pattern
+  strslice_t value;               // Value, viewing onto the path
+} cws_route_param_t;
+
+/**
+ * @brief Result of matching a path against the routes
+ */
+typedef struct cws_route_match
+{
+  // Route for the requested method, NULL if there is none
+  cws_route_t *route;
+
+  // Whether or not the path matched a pattern, for any method
+  bool path_found;
+
+  // Methods routes exist for on the matched path, as a bit per method
+  unsigned int allowed_methods;
+
+  // Captured parameters in the order of the pattern
+  cws_route_param_t params[CWS_ROUTER_MAX_PARAMS];
+  size_t num_params;
+
+  // Pin of the routing thread keeping the matched route's table alive, NULL if released
+  struct cws_route_pin *pin;
+} cws_route_match_t;
+
+/*
+============================================================================
+                                   Router                                   
+============================================================================
+*/
+
+/**
+ * @brief A node of the radix tree, holding the compressed static prefix
+ * which leads to it from it's parent
+ */
+typedef struct cws_router_node
+{
+  // Static prefix, or the name of a parameter or wildcard node
+  char *prefix;
+  size_t prefix_len;
+
+  // Static children and the first character of each of their prefixes
+  struct cws_router_node **children;
+  char *indices;
+  size_t num_children;
+
+  // Children matching a whole segment or the whole remainder of the path
+  struct cws_router_node *param_child;
+  struct cws_router_node *wildcard_child;
+
+  // Routes terminating at this node, by method
+  cws_route_t routes[CWS_HTTP_NUM_METHODS];
+  unsigned int methods;
+} cws_router_node_t;
+
+/**
+ * @brief Immutable snapshot of all routes, replaced as a whole on changes
+ */
+typedef struct cws_route_table
+{
+  cws_router_node_t *root;
+} cws_route_table_t;
+
+/**
+ * @brief A thread's reference on the table it last routed with, shared by all
+ * of it's matches, which are thus only counted on an object of the thread's
+ * own, while the table's reference count is only touched once the table changed
+ */
+typedef struct cws_route_pin
+{
+  cws_route_table_t *table;       // Referenced table
+  size_t users;                   // Unreleased matches, plus one while it's the thread's pin
+} cws_route_pin_t;
+
+/**
+ * @brief A route to be added along with others, see cws_router_add_all
+ */
+typedef struct cws_route_def
+{
+  cws_http_method_t method;       // Method to route
+  const char *pattern;            // Pattern of the path
+  cws_route_t route;              // Handlers of the route
+} cws_route_def_t;
+
+/**
+ * @brief Routes requests by their path and method, the routes can be changed
+ * at any time without blocking requests: writers publish an updated copy of
+ * the table and the previous one is freed once no request can still use it
+ */
+typedef struct cws_router
+{
+  cws_route_table_t *table;       // Current table, published atomically
+  pthread_mutex_t write_lock;     // Serializes writers
+} cws_router_t;
+
+/**
+ * @brief Create a new router without any routes
+ */
+cws_router_t *cws_router_make();
+
+/**
+ * @brief Add a route, patterns consist of static segments, :param segments
+ * capturing a whole segment and a trailing *wildcard segment capturing the rest
+ * 
+ * Every change copies the whole table, so adding many routes one by one takes
+ * time quadratic to their number, use cws_router_add_all to add them at once
+ * 
+ * @param router Router to add to
+ * @param method Method to route
+ * @param pattern Pattern of the path, starting with a /
+ * @param route Handlers of the route
+ * @param error_msg Error message output buffer
+ * 
+ * @return true Route added
+ * @return false Malformed pattern or conflicting route
+ */
+bool cws_router_add(
+  cws_router_t *router,
+  cws_http_method_t method,
+  const char *pattern,
+  cws_route_t route,
+  char **error_msg
+);
+
+/**
+ * @brief Add multiple routes with a single copy of the table, they're published
+ * all at once, or not at all if any of them can't be added
+ * 
+ * @param router Router to add to
+ * @param defs Routes to add
+ * @param num_defs Number of routes
+ * @param error_msg Error message output buffer
+ * 
+ * @return true All routes added
+ * @return false Malformed pattern or conflicting route, none have been added
+ */
+bool cws_router_add_all(
+  cws_router_t *router,
+  const cws_route_def_t *defs,
+  size_t num_defs,
+  char **error_msg
+);
+
+/**
+ * @brief Remove a route, copying the whole table just like adding one
+ * 
+ * @param router Router to remove from
+ * @param method Method of the route
+ * @param pattern Pattern the route has been added with
+ * @param error_msg Error message output buffer
+ * 
+ * @return true Route removed
+ * @return false There is no such route
+ */
+bool cws_router_remove(
+  cws_router_t *router,
+  cws_http_method_t method,
+  const char *pattern,
+  char **error_msg
+);
+
+/**
+ * @brief Match a path against all routes in time linear to the path's length,
+ * no matter their number, in a single descent: static prefixes take precedence
+ * over parameters and are committed to once they match, if the descent doesn't
+ * end at a route, the deepest wildcard passed captures the rest, a successful
+ * match keeps the route's table alive until it's released again, by the routing
+ * thread's pin on it
+ * 
+ * Each thread keeps it's pin on the table it last routed with, so replaced
+ * tables live on until every thread which has routed with them routed again
+ * 
+ * @param router Router to match with
+ * @param method Requested method
+ * @param path Decoded, canonical path
+ * @param match Match output buffer
+ * 
+ * @return true A route for the method matched
+ * @return false No route matched, see path_found for whether another method would
+ */
+bool cws_router_match(
+  cws_router_t *router,
+  cws_http_method_t method,
+  strslice_t path,
+  cws_route_match_t *match
+);
+
+/**
+ * @brief Look up a captured parameter by it's name
+ * 
+ * @param match Route match
+ * @param name Name of the parameter
+ * @return strslice_t* Value of the parameter, NULL if it hasn't been captured
+ */
+strslice_t *cws_route_match_param(cws_route_match_t *match, const char *name);
+
+/**
+ * @brief Release the route of a match after it has been served, may be
+ * called from any thread and on released matches
+ * 
+ * @param match Route match
+ */
+void cws_route_match_release(cws_route_match_t *match);
+
+#endif
@@ -8,12 +8,23 @@
 
 #include "cws/cws_client.h"
 #include "cws/cws_common.h"
+#include "cws/cws_router.h"
 #include "util/mman.h"
 
 /**
- * @brief A handler for incoming clients
+ * @brief A handler for incoming clients, receiving the argument
+ * which has been provided when going into listening mode
  */
-typedef void (*cws_client_handler_t)(cws_client_t *);
+typedef void (*cws_client_handler_t)(cws_client_t *, void *);
+
+/**
+ * @brief Statistics of a server socket, only written by it's accept loop
+ */
+typedef struct cws_socket_stats
+{
+  size_t accepted;                // Number of accepted connections
+  size_t accept_errors;           // Number of failed accepts
+} cws_socket_stats_t;
 
 /**
  * @brief A server socket with it's address and file descriptor
@@ -25,6 +36,10 @@ typedef struct cws_socket
   pthread_t thread;               // Thread of the accept loop
   bool thread_active;             // Whether or not the loop thread is active
   cws_client_handler_t handler;   // Client handler function
+  void *handler_arg;              // Argument passed to the handler function
+  int cpu;                        // Core the accept loop is pinned to, -1 for none
+  cws_socket_stats_t stats;       // Statistics of this socket
+  cws_router_t *router;           // Routes of accepted clients, NULL for none
 } cws_socket_t;
 
 /**
@@ -32,10 +47,30 @@ typedef struct cws_socket
  * 
  * @param addr Address to listen on
  * @param port Port to listen on
+ * @param reuse_port Whether multiple sockets may bind to the same address and port,
+ * the kernel then distributes incoming connections among them
  * 
  * @return cws_socket_t* Instance of socket struct or NULL on errors
  */
-cws_socket_t *cws_socket_create(in_addr_t addr, int port);
+cws_socket_t *cws_socket_create(in_addr_t addr, int port, bool reuse_port);
+
+/**
+ * @brief Pin the socket's accept loop onto a core, call this before listening
+ * 
+ * @param socket Previously created socket handle
+ * @param cpu Core to pin onto
+ */
+void cws_socket_pin(cws_socket_t *socket, int cpu);
+
+/**
+ * @brief Route the requests of all clients accepted from now on, call this before listening
+ * 
+ * @param socket Previously created socket handle
+ * @param router Router to use, a reference is taken and held for the socket's
+ * lifetime, accepted clients only borrow the router, so they don't share a
+ * reference count across listeners
+ */
+void cws_socket_set_router(cws_socket_t *socket, cws_router_t *router);
 
 /**
  * @brief Start listening for client requests
@@ -43,10 +78,16 @@ cws_socket_t *cws_socket_create(in_addr_t addr, int port);
  * @param socket Previously created socket handle
  * @param backlog Size of connection request queue
  * @param handler Client request handler function
+ * @param handler_arg Argument passed to the handler function
  * 
  * @return true Successful went into listening mode
  * @return false Could not start listening
  */
-bool cws_socket_listen(cws_socket_t *socket, int backlog, cws_client_handler_t handler);
+bool cws_socket_listen(
+  cws_socket_t *socket,
+  int backlog,
+  cws_client_handler_t handler,
+  void *handler_arg
+);
 
 #endif
\ No newline at end of file
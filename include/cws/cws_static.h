@@ -0,0 +1,149 @@
+#ifndef cws_static_h
+#define cws_static_h
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "cws/cws_client.h"
+#include "cws/cws_clock.h"
+#include "cws/cws_conditional.h"
+#include "cws/cws_range.h"
+#include "cws/cws_encoding.h"
+#include "cws/cws_request.h"
+#include "cws/cws_response.h"
+#include "cws/cws_router.h"
+#include "util/epoch.h"
+#include "util/mman.h"
+#include "util/strfmt.h"
+#include "util/strslice.h"
+
+/*
+============================================================================
+                               Configuration                                
+============================================================================
+*/
+
+// File served for paths which end in a slash
+#define CWS_STATIC_INDEX "index.html"
+
+// Number of independently locked shards of the open file cache
+#define CWS_STATIC_CACHE_SHARDS 32
+
+// Number of open files each shard of the cache holds at most
+#define CWS_STATIC_CACHE_SHARD_SIZE 8
+
+// Maximum length of the boundary separating the parts of a multipart/byteranges body
+#define CWS_STATIC_BOUNDARY_MAXLEN 32
+
+// Interval in milliseconds a cached file's metadata is trusted for before
+// it's checked against the disk again
+#define CWS_STATIC_REVALIDATE_MS 1000
+
+/*
+============================================================================
+                                 File cache                                 
+============================================================================
+*/
+
+/**
+ * @brief An open file with it's metadata and preformatted headers, shared
+ * by all requests for it, it's reclaimed through epochs once unpublished
+ */
+typedef struct cws_static_file
+{
+  char *path;                     // Path on disk, key within the cache along with the encoding
+  size_t path_len;                // Length of the path
+  cws_encoding_t encoding;        // Encoding of the contents, gzip for precompressed siblings
+  uint64_t hash;                  // Hash of the path and encoding
+  int fd;                         // Open descriptor, transfers read at explicit offsets
+  struct stat st;                 // Metadata as of opening the file
+  char last_modified[CWS_HTTP_DATE_LEN]; // Modification time as a HTTP date
+  char etag[CWS_ETAG_MAXLEN];     // Entity tag, derived from inode, size and modification time
+  size_t etag_len;                // Length of the entity tag
+  const char *content_type;       // Content type by the file's extension, not counting .gz of siblings
+  bool compressible;              // Whether or not the contents are worth compressing
+  bool has_gzip;                  // Whether or not a precompressed sibling existed when last validated
+  char *lines;                    // Header lines, all of which describe the file as it is
+  size_t lines_len;               // Length of the header lines
+  size_t type_line_len;           // Length of the leading Content-Type line
+  size_t shared_len;              // Length of the leading lines which describe compressed variants as well
+  long validated_ms;              // Last time the metadata has been checked against the disk
+} cws_static_file_t;
+
+/**
+ * @brief Part of the cache, holding the files whose hashes map to it, readers
+ * look files up without locking, the lock only serializes publishing
+ */
+typedef struct cws_static_shard
+{
+  pthread_mutex_t lock;                                 // Serializes writers
+  cws_static_file_t *files[CWS_STATIC_CACHE_SHARD_SIZE]; // Published files, NULL if free
+  size_t victim;                                        // Next slot to be evicted when full
+} cws_static_shard_t;
+
+/*
+============================================================================
+                                Static files                                
+============================================================================
+*/
+
+/**
+ * @brief Serves the files below a document root
+ */
+typedef struct cws_static
+{
+  char *root;                     // Document root, without a trailing slash
+  size_t root_len;                // Length of the document root
+  cws_static_shard_t shards[CWS_STATIC_CACHE_SHARDS]; // Cache of open files
+} cws_static_t;
+
+/**
+ * @brief Create a new static file server
+ * 
+ * @param root Document root directory
+ * @return cws_static_t* Static file server
+ */
+cws_static_t *cws_static_make(const char *root);
+
+/**
+ * @brief Route handler serving a file, meant to be added for GET and HEAD with
+ * a cws_static_t as it's argument, the file's path below the document root is
+ * taken from the route's "path" parameter if captured, else from the request's path
+ * 
+ * @param client Client that's being served
+ * @param match Matched route
+ * @param arg Static file server
+ */
+void cws_static_handle(cws_client_t *client, cws_route_match_t *match, void *arg);
+
+/**
+ * @brief Look up an open file within the cache, opening and publishing it if
+ * it's not cached yet or it's cached metadata is outdated, has to be called
+ * within a read-side epoch section, which the file stays valid for
+ * 
+ * @param st Static file server
+ * @param path Path of the file on disk
+ * @param encoding Encoding of the file's contents, files of other encodings
+ * than identity are the precompressed siblings of a file, suffixed by .gz
+ * @param err Output for the errno value of a failed lookup, ENOENT for non-regular files
+ * @return cws_static_file_t* Open file, NULL if it couldn't be opened
+ */
+cws_static_file_t *cws_static_open(cws_static_t *st, const char *path, cws_encoding_t encoding, int *err);
+
+/**
+ * @brief Determine the content type of a file by it's extension
+ * 
+ * @param path Path of the file
+ * @return const char* Content type, application/octet-stream for unknown extensions
+ */
+const char *cws_static_content_type(strslice_t path);
+
+#endif
@@ -2,11 +2,10 @@
 #define cws_uri_h
 
 #include "cws/cws_common.h"
-#include "datastruct/htable.h"
 #include "util/mman.h"
-#include "util/partial_strdup.h"
-#include "util/strclone.h"
-#include "datastruct/dynarr.h"
+#include "util/strslice.h"
+#include "util/strscan.h"
+#include "util/urlcodec.h"
 
 /*
 ============================================================================
@@ -14,18 +13,9 @@
 ============================================================================
 */
 
-// Default number of headers the hash table gets allocated to
-#define CWS_MIN_QUERYPARAMS 4UL
-
-// Maximum number of headers the hash table can grow to
+// Maximum number of query parameters, further parameters are ignored
 #define CWS_MAX_QUERYPARAMS 128UL
 
-// Default number of same named query parameter values (array)
-#define CWS_MIN_SAME_QUERYPARAMS 128UL
-
-// Maximum number of same named query parameter values (array)
-#define CWS_MAX_SAME_QUERYPARAMS 128UL
-
 // Maximum length in characters of the raw URI
 #define CWS_URI_MAXLEN 1024UL
 
@@ -35,21 +25,45 @@
 ============================================================================
 */
 
+/**
+ * @brief A single query parameter, viewing onto the raw URI
+ */
+typedef struct cws_query_param
+{
+  strslice_t key;
+  strslice_t value;
+} cws_query_param_t;
+
 typedef struct cws_uri
 {
-  // Raw URI as found in the request
-  char *raw_uri;
+  // Raw URI as found in the request, the path and parameters within it are decoded in place
+  strslice_t raw_uri;
+
+  // Absolute, requested path, starting with a /, decoded and canonicalized
+  strslice_t path;
 
-  // Absolute, requested path, starting with a /
-  char *path;
+  // Raw query string following the ?, empty if there is none
+  strslice_t query_string;
 
-  // key: query parameter name (string)
-  // value: query parameter values (zero terminated string array)
-  htable_t *query;
+  // Decoded query parameters in the order of their appearance, only parsed on
+  // first access, the array is kept for all URIs parsed into this struct
+  bool query_parsed;
+  cws_query_param_t *query;
+  size_t num_query;
+  size_t query_cap;
 } cws_uri_t;
 
 /**
- * @brief Parse a URI and all it's elements by it's raw string
+ * @brief Initialize an empty URI struct before parsing into it for the first time
+ * 
+ * @param uri URI to initialize
+ */
+void cws_uri_init(cws_uri_t *uri);
+
+/**
+ * @brief Parse a URI and all it's elements by it's raw string, the resulting
+ * slices point into the raw string. The path is percent-decoded, validated as
+ * UTF-8 and canonicalized in place. The query string is only parsed on first access.
  * 
  * @param raw_uri Raw URI string
  * @param output URI output buffer
@@ -58,6 +72,34 @@ typedef struct cws_uri
  * @return true URI parsed successfully
  * @return false Could not parse URI
  */
-bool cws_uri_parse(char *raw_uri, cws_uri_t **output, char **error_msg);
+bool cws_uri_parse(strslice_t raw_uri, cws_uri_t *output, char **error_msg);
+
+/**
+ * @brief Find the next value of a query parameter, parses the query string
+ * on first access, parameters without a value have an empty value. Parameters
+ * are decoded in place, those which aren't valid UTF-8 are dropped.
+ * 
+ * @param uri Parsed URI
+ * @param key Name of the parameter
+ * @param iter Position to resume the search at, start at zero in order to get the first value
+ * @return strslice_t* Value of the parameter, NULL if there are no more values
+ */
+strslice_t *cws_uri_query_find(cws_uri_t *uri, const char *key, size_t *iter);
+
+/**
+ * @brief Move all slices of a parsed URI onto a new location of it's raw string
+ * 
+ * @param uri Parsed URI
+ * @param old_base Previous location of the buffer containing the raw URI
+ * @param new_base New location of the buffer containing the raw URI
+ */
+void cws_uri_rebase(cws_uri_t *uri, char *old_base, char *new_base);
+
+/**
+ * @brief Free all resources a parsed URI holds, the URI itself is not freed
+ * 
+ * @param uri URI to release
+ */
+void cws_uri_release(cws_uri_t *uri);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,105 @@
+#ifndef cws_uring_h
+#define cws_uring_h
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "cws/cws_client.h"
+#include "cws/cws_client_handler.h"
+#include "cws/cws_socket.h"
+#include "util/mman.h"
+
+/*
+============================================================================
+                               Configuration                                
+============================================================================
+*/
+
+// Number of submission queue entries, the completion queue is twice as large
+#define CWS_URING_ENTRIES 1024
+
+// Number of provided receive buffers, needs to be a power of two
+#define CWS_URING_NUM_BUFS 256
+
+// Buffer group ID of the provided receive buffers
+#define CWS_URING_BUF_GROUP 0
+
+// Maximum number of bytes of a file part spliced through a connection's pipe
+// at once, must not exceed the default pipe capacity
+#define CWS_URING_FILE_CHUNK (64UL * 1024UL)
+
+/*
+============================================================================
+                                  io_uring                                  
+============================================================================
+*/
+
+/**
+ * @brief Per connection state of a client served by the ring, only one
+ * operation (chain) is in flight per connection at any time
+ */
+typedef struct cws_uring_conn
+{
+  cws_client_t *client;                             // Client that's being served
+  struct msghdr msg;                                // Message of the send in flight
+  struct iovec iov[CWS_CLIENT_MAX_QUEUED];          // Buffers of the send in flight
+  cws_client_out_t *out;                            // Output being sent, taken over from the client
+  size_t out_count, out_cap;                        // Number of entries and capacity of the output
+  size_t out_next;                                  // First entry that's yet to be sent completely
+  int pipe_fds[2];                                  // File parts are spliced through, created on first use
+  size_t piped;                                     // Number of bytes within the pipe that are yet to be sent
+  struct __kernel_timespec timeout;                 // Idle timeout of receives
+  bool closing;                                     // Whether a close has been linked
+} cws_uring_conn_t;
+
+/**
+ * @brief An io_uring instance accepting, receiving and sending on it's own thread
+ */
+typedef struct cws_uring
+{
+  int ring_fd;                    // Descriptor of the ring
+  cws_socket_t *socket;           // Socket connections are accepted on
+  pthread_t thread;               // Thread of the completion loop
+  bool thread_active;             // Whether or not the loop thread is active
+  bool accept_multishot;          // Whether accepts stay armed, cleared if the kernel rejects them
+
+  // Mapped ring memory
+  void *sq_ptr, *cq_ptr;
+  size_t sq_len, cq_len, sqes_len;
+
+  // Submission queue
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  struct io_uring_sqe *sqes;
+  unsigned sq_entries, to_submit;
+
+  // Completion queue
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_cqe *cqes;
+
+  // Provided receive buffers
+  struct io_uring_buf_ring *buf_ring;
+  size_t buf_ring_len;
+  char *bufs;
+  unsigned short buf_tail;
+} cws_uring_t;
+
+/**
+ * @brief Set up a ring serving the socket using multishot accepts, receives into
+ * provided buffers and sends which are linked with closing the connection, then
+ * start it's completion loop in another thread
+ * 
+ * @param socket Previously created socket handle
+ * @param backlog Size of connection request queue
+ * 
+ * @return cws_uring_t* Running ring, NULL if io_uring or one of the required
+ * operations is unavailable, errno is set accordingly
+ */
+cws_uring_t *cws_uring_make(cws_socket_t *socket, int backlog);
+
+#endif
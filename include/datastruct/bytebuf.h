@@ -0,0 +1,64 @@
+#ifndef bytebuf_h
+#define bytebuf_h
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "util/mman.h"
+
+/**
+ * @brief Represents a binary-safe byte buffer, which grows geometrically
+ * up to it's maximum capacity
+ */
+typedef struct
+{
+  // Buffered bytes, followed by a zero terminator for convenience
+  char *data;
+
+  // Number of buffered bytes
+  size_t len;
+
+  // Current capacity of the buffer, excluding the terminator
+  size_t _cap;
+
+  // Maximum capacity the buffer can grow to
+  size_t _max_cap;
+} bytebuf_t;
+
+typedef enum
+{
+  // Successful operation
+  BYTEBUF_SUCCESS,
+
+  // The data would exceed the maximum capacity
+  BYTEBUF_FULL
+} bytebuf_result_t;
+
+/**
+ * @brief Make a new, empty buffer
+ * 
+ * @param cap Initial capacity of the buffer
+ * @param max_cap Maximum capacity of the buffer, set to cap for no automatic growth
+ * @return bytebuf_t* Pointer to the new buffer
+ */
+bytebuf_t *bytebuf_make(size_t cap, size_t max_cap);
+
+/**
+ * @brief Append bytes to the buffer, doubling it's capacity as often as needed
+ * 
+ * @param buf Buffer reference
+ * @param data Bytes to append, may contain zeros
+ * @param data_len Number of bytes to append
+ * @return bytebuf_result_t Result of the operation, nothing is appended when full
+ */
+bytebuf_result_t bytebuf_append(bytebuf_t *buf, const char *data, size_t data_len);
+
+/**
+ * @brief Drop all buffered bytes while keeping the allocated capacity
+ * 
+ * @param buf Buffer reference
+ */
+void bytebuf_clear(bytebuf_t *buf);
+
+#endif
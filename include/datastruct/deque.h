@@ -0,0 +1,80 @@
+#ifndef deque_h
+#define deque_h
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "util/mman.h"
+#include "util/common_types.h"
+
+/**
+ * @brief Represents a bounded double ended queue, implemented as a
+ * ring buffer, keeping track of it's items and cleanup method
+ */
+typedef struct
+{
+  // Ring buffer of items
+  void **items;
+
+  // Index of the front item
+  size_t _head;
+
+  // Current number of items
+  size_t _item_count;
+
+  // Maximum number of items
+  size_t _item_cap;
+
+  // Cleanup function for the items
+  cleanup_fn_t _cf;
+} deque_t;
+
+typedef enum
+{
+  // Successful operation
+  DEQUE_SUCCESS,
+
+  // No more space for more items
+  DEQUE_FULL,
+
+  // No more item to pop
+  DEQUE_EMPTY,
+} deque_result_t;
+
+/**
+ * @brief Make a new, empty deque
+ * 
+ * @param item_cap Maximum number of items
+ * @param cf Cleanup function for the items left over on destruction
+ * @return deque_t* Pointer to the new deque
+ */
+deque_t *deque_make(size_t item_cap, cleanup_fn_t cf);
+
+/**
+ * @brief Push a new item onto the back of the deque
+ * 
+ * @param deque Deque reference
+ * @param item Item to push
+ * @return deque_result_t Operation result
+ */
+deque_result_t deque_push_back(deque_t *deque, void *item);
+
+/**
+ * @brief Pop the item off the front of the deque
+ * 
+ * @param deque Deque reference
+ * @param out Output pointer buffer
+ * @return deque_result_t Operation result
+ */
+deque_result_t deque_pop_front(deque_t *deque, void **out);
+
+/**
+ * @brief Pop the item off the back of the deque
+ * 
+ * @param deque Deque reference
+ * @param out Output pointer buffer
+ * @return deque_result_t Operation result
+ */
+deque_result_t deque_pop_back(deque_t *deque, void **out);
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef epoch_h
+#define epoch_h
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "util/mman.h"
+
+/*
+============================================================================
+                               Configuration                                
+============================================================================
+*/
+
+// Maximum number of threads with a slot of their own, further threads share an
+// overflow slot, which stays pinned for as long as any of them is within a
+// section and may thus hold back reclamation
+#define EPOCH_MAX_SLOTS 4096
+
+// Number of bits of a slot's state holding the nesting depth of it's sections
+#define EPOCH_DEPTH_BITS 24
+
+/*
+============================================================================
+                                 Reclamation                                
+============================================================================
+*/
+
+/**
+ * @brief Read-side state of a thread, on it's own cache line as it's only
+ * ever written by it's own thread (or when releasing a section that has
+ * been migrated to another thread)
+ */
+typedef struct epoch_slot
+{
+  // Epoch the outermost open section has been entered in and the number of
+  // open sections, packed into one word so both change atomically
+  uint64_t state;
+
+  // Whether or not a thread owns this slot
+  bool claimed;
+} __attribute__((aligned(64))) epoch_slot_t;
+
+/**
+ * @brief Enter a read-side section, shared objects loaded after entering stay
+ * valid until the section is left again, sections may be nested and
+ * interleaved, as long as each one is left exactly once
+ * 
+ * @return epoch_slot_t* Slot to leave the section on, from any thread
+ */
+epoch_slot_t *epoch_enter();
+
+/**
+ * @brief Leave a read-side section
+ * 
+ * @param slot Slot the section has been entered on
+ */
+void epoch_leave(epoch_slot_t *slot);
+
+/**
+ * @brief Retire a managed object which has been unpublished, it's freed as
+ * soon as no read-side section which could still have loaded it is open
+ * 
+ * @param ptr Managed object, the caller's reference is taken over
+ */
+void epoch_retire(void *ptr);
+
+/**
+ * @brief Free all retired objects no open read-side section can still see
+ */
+void epoch_collect();
+
+#endif
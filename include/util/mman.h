@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <pthread.h>
 
 #include "util/common_macros.h"
 #include "util/atomanip.h"
@@ -141,7 +142,8 @@ void *mman_ref(void *ptr);
 */
 
 /**
- * @brief Prints informations about the current alloc/dealloc status on stdout
+ * @brief Prints informations about the alloc/dealloc status on stdout, summed up
+ * over the counters each thread keeps on it's own, including exited threads
  */
 void mman_print_info();
 
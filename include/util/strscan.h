@@ -0,0 +1,64 @@
+#ifndef strscan_h
+#define strscan_h
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+============================================================================
+                               Configuration                                
+============================================================================
+*/
+
+// Maximum number of delimiters a set may contain
+#define STRSCAN_MAX_DELIMS 8
+
+/*
+============================================================================
+                                  Scanning                                  
+============================================================================
+*/
+
+/**
+ * @brief A set of delimiters to scan for at once
+ */
+typedef struct strscan_set
+{
+  char delims[STRSCAN_MAX_DELIMS];
+  size_t num_delims;
+} strscan_set_t;
+
+/**
+ * @brief Initializer of a delimiter set from a string literal containing
+ * all delimiters, meant for static sets
+ */
+#define STRSCAN_SET(delims_str) \
+  { .delims = delims_str, .num_delims = sizeof(delims_str) - 1 }
+
+/**
+ * @brief Locate the first occurrence of any delimiter of a set, using the
+ * widest vector instructions the CPU supports (AVX2, SSE2 or plain scalar)
+ * 
+ * @param data Data to search in, doesn't need to be zero terminated
+ * @param len Length of the data
+ * @param set Delimiters to search for
+ * @return char* First delimiter, NULL if none occurs
+ */
+char *strscan_find(char *data, size_t len, const strscan_set_t *set);
+
+/**
+ * @brief Measure the length of the leading run of ASCII characters, using
+ * the same kernel selection as strscan_find
+ * 
+ * @param data Data to search in, doesn't need to be zero terminated
+ * @param len Length of the data
+ * @return size_t Offset of the first non-ASCII byte, len if there is none
+ */
+size_t strscan_ascii(char *data, size_t len);
+
+/**
+ * @brief Get the name of the kernel strscan_find dispatches to on this CPU
+ */
+const char *strscan_kernel_name();
+
+#endif
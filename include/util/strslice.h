@@ -0,0 +1,91 @@
+#ifndef strslice_h
+#define strslice_h
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+
+#include "util/mman.h"
+
+/**
+ * @brief A non-owning view onto a sequence of characters within
+ * another buffer, which is not zero terminated
+ */
+typedef struct strslice
+{
+  char *ptr;
+  size_t len;
+} strslice_t;
+
+/**
+ * @brief Create a slice viewing onto a buffer
+ * 
+ * @param ptr Start of the slice
+ * @param len Length of the slice
+ * @return strslice_t Slice
+ */
+strslice_t strslice_make(char *ptr, size_t len);
+
+/**
+ * @brief Check whether or not the slice equals a zero terminated string
+ * 
+ * @param slice Slice to compare
+ * @param str String to compare with
+ * @return true Both are equal
+ * @return false Both differ
+ */
+bool strslice_eq(strslice_t slice, const char *str);
+
+/**
+ * @brief Check whether or not the slice equals a zero terminated string,
+ * while ignoring the case of ASCII letters
+ * 
+ * @param slice Slice to compare
+ * @param str String to compare with
+ * @return true Both are equal
+ * @return false Both differ
+ */
+bool strslice_eq_ci(strslice_t slice, const char *str);
+
+/**
+ * @brief Check whether or not the slice, being a comma separated list of tokens,
+ * contains a token while ignoring the case of ASCII letters
+ * 
+ * @param slice Token list to search in
+ * @param token Token to search for
+ * @return true Token is contained
+ * @return false Token is not contained
+ */
+bool strslice_has_token_ci(strslice_t slice, const char *token);
+
+/**
+ * @brief Parse the whole slice as an unsigned decimal number
+ * 
+ * @param slice Slice containing nothing but digits
+ * @param out Output buffer
+ * @return true Number parsed successfully
+ * @return false Empty slice, non-digit characters or overflow
+ */
+bool strslice_ulong(strslice_t slice, unsigned long *out);
+
+/**
+ * @brief Move a slice along with the buffer it views onto, which has been
+ * copied to a new location unchanged, slices viewing onto nothing stay as is
+ * 
+ * @param slice Slice to move
+ * @param old_base Previous location of the buffer
+ * @param new_base New location of the buffer
+ */
+void strslice_rebase(strslice_t *slice, char *old_base, char *new_base);
+
+/**
+ * @brief Create a managed, zero terminated copy of the slice
+ * 
+ * @param slice Slice to copy
+ * @return char* Copy of the slice
+ */
+char *strslice_dup(strslice_t slice);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef urlcodec_h
+#define urlcodec_h
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "util/strslice.h"
+#include "util/strscan.h"
+
+/**
+ * @brief Decode all percent-encoded octets of a slice in place, the slice
+ * shrinks to the decoded length
+ * 
+ * @param slice Slice to decode
+ * @param plus_as_space Whether + encodes a space, as it does in query strings
+ * @return true Slice decoded successfully
+ * @return false Malformed escape sequence, the slice is partially decoded
+ */
+bool urlcodec_decode(strslice_t *slice, bool plus_as_space);
+
+/**
+ * @brief Check whether or not a slice is valid UTF-8, rejecting overlong
+ * encodings, surrogates and code points beyond U+10FFFF
+ * 
+ * @param slice Slice to validate
+ * @return true Valid UTF-8
+ * @return false Invalid UTF-8
+ */
+bool urlcodec_utf8_valid(strslice_t slice);
+
+#endif
@@ -0,0 +1,191 @@
+#include "util/epoch.h"
+
+// Depth part of a slot's state
+#define EPOCH_DEPTH_MASK ((1UL << EPOCH_DEPTH_BITS) - 1)
+
+/**
+ * @brief An object awaiting it's reclamation
+ */
+typedef struct epoch_retired
+{
+  void *ptr;                      // Managed object
+  uint64_t epoch;                 // Epoch the object has been unpublished in
+  struct epoch_retired *next;     // Next retired object
+} epoch_retired_t;
+
+// Global epoch, advanced whenever an object is retired
+static uint64_t epoch_global = 1;
+
+// Read-side state of all threads, followed by the shared overflow slot
+static epoch_slot_t epoch_slots[EPOCH_MAX_SLOTS + 1];
+#define EPOCH_OVERFLOW_SLOT (&epoch_slots[EPOCH_MAX_SLOTS])
+
+// Number of slots which have ever been claimed, writers only scan those
+static size_t epoch_slots_used = 0;
+
+// Slot claimed by the current thread, if any
+static __thread epoch_slot_t *epoch_local = NULL;
+
+// Releases a thread's slot as it exits
+static pthread_key_t epoch_local_key;
+static pthread_once_t epoch_local_once = PTHREAD_ONCE_INIT;
+
+// Objects awaiting their reclamation, only touched by writers
+static epoch_retired_t *epoch_retired = NULL;
+static pthread_mutex_t epoch_retired_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+============================================================================
+                                   Slots                                    
+============================================================================
+*/
+
+/**
+ * @brief Hand an exiting thread's slot back, open sections stay tracked by it's state
+ */
+static void epoch_slot_release(void *slot)
+{
+  __atomic_store_n(&((epoch_slot_t *) slot)->claimed, false, __ATOMIC_RELEASE);
+}
+
+static void epoch_local_key_make()
+{
+  pthread_key_create(&epoch_local_key, epoch_slot_release);
+}
+
+/**
+ * @brief Claim a free slot for the current thread, falling back to the shared
+ * overflow slot if all are taken
+ */
+static epoch_slot_t *epoch_slot_claim()
+{
+  pthread_once(&epoch_local_once, epoch_local_key_make);
+
+  for (size_t i = 0; i < EPOCH_MAX_SLOTS; i++)
+  {
+    epoch_slot_t *slot = &epoch_slots[i];
+    bool expected = false;
+
+    if (__atomic_load_n(&slot->claimed, __ATOMIC_RELAXED)) continue;
+    if (!__atomic_compare_exchange_n(&slot->claimed, &expected, true, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) continue;
+
+    // Make the slot visible to writers before any section is entered on it
+    size_t used = __atomic_load_n(&epoch_slots_used, __ATOMIC_SEQ_CST);
+    while (used < i + 1 && !__atomic_compare_exchange_n(&epoch_slots_used, &used, i + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+
+    pthread_setspecific(epoch_local_key, slot);
+    return slot;
+  }
+
+  // Sections of multiple threads nest on the overflow slot just like sections
+  // of one thread do, as entering and leaving are atomic on the whole state
+  return EPOCH_OVERFLOW_SLOT;
+}
+
+/*
+============================================================================
+                                 Read side                                  
+============================================================================
+*/
+
+epoch_slot_t *epoch_enter()
+{
+  if (!epoch_local) epoch_local = epoch_slot_claim();
+  epoch_slot_t *slot = epoch_local;
+
+  // The outermost section pins the current epoch, nested ones keep that
+  // older epoch, which is just as safe
+  uint64_t state = __atomic_load_n(&slot->state, __ATOMIC_RELAXED);
+  uint64_t next;
+  do {
+    if ((state & EPOCH_DEPTH_MASK) == 0)
+      next = (__atomic_load_n(&epoch_global, __ATOMIC_SEQ_CST) << EPOCH_DEPTH_BITS) | 1;
+    else
+      next = state + 1;
+  } while (!__atomic_compare_exchange_n(&slot->state, &state, next, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+  return slot;
+}
+
+void epoch_leave(epoch_slot_t *slot)
+{
+  // Leaving the outermost section unpins the epoch
+  uint64_t state = __atomic_load_n(&slot->state, __ATOMIC_RELAXED);
+  uint64_t next;
+  do {
+    next = (state & EPOCH_DEPTH_MASK) == 1 ? 0 : state - 1;
+  } while (!__atomic_compare_exchange_n(&slot->state, &state, next, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/*
+============================================================================
+                                 Write side                                 
+============================================================================
+*/
+
+/**
+ * @brief Find the oldest epoch pinned by any open section
+ * 
+ * @return uint64_t Oldest pinned epoch, UINT64_MAX if there are no open sections
+ */
+static uint64_t epoch_oldest_pinned()
+{
+  uint64_t oldest = UINT64_MAX;
+
+  // Slots claimed after loading the count pin a later epoch than any retired
+  // object's, the overflow slot is always scanned
+  size_t used = __atomic_load_n(&epoch_slots_used, __ATOMIC_SEQ_CST);
+  for (size_t i = 0; i <= EPOCH_MAX_SLOTS; i++)
+  {
+    if (i == used) i = EPOCH_MAX_SLOTS;
+
+    uint64_t state = __atomic_load_n(&epoch_slots[i].state, __ATOMIC_SEQ_CST);
+    if ((state & EPOCH_DEPTH_MASK) == 0) continue;
+
+    uint64_t pinned = state >> EPOCH_DEPTH_BITS;
+    if (pinned < oldest) oldest = pinned;
+  }
+
+  return oldest;
+}
+
+void epoch_retire(void *ptr)
+{
+  epoch_retired_t *retired = (epoch_retired_t *) mman_alloc(sizeof(epoch_retired_t), 1, NULL);
+  retired->ptr = ptr;
+
+  // Sections entered from now on pin a later epoch and thus can't load the
+  // object anymore, as it has been unpublished before
+  retired->epoch = __atomic_fetch_add(&epoch_global, 1, __ATOMIC_SEQ_CST);
+
+  pthread_mutex_lock(&epoch_retired_lock);
+  retired->next = epoch_retired;
+  epoch_retired = retired;
+  pthread_mutex_unlock(&epoch_retired_lock);
+
+  epoch_collect();
+}
+
+void epoch_collect()
+{
+  pthread_mutex_lock(&epoch_retired_lock);
+  uint64_t oldest = epoch_oldest_pinned();
+
+  // Objects retired before the oldest pinned epoch are unreachable
+  epoch_retired_t **link = &epoch_retired;
+  while (*link)
+  {
+    epoch_retired_t *retired = *link;
+    if (retired->epoch >= oldest)
+    {
+      link = &retired->next;
+      continue;
+    }
+
+    *link = retired->next;
+    scptr void *ptr = retired->ptr;
+    mman_dealloc(retired);
+  }
+
+  pthread_mutex_unlock(&epoch_retired_lock);
+}
@@ -1,6 +1,83 @@
 #include "util/mman.h"
 
-static volatile size_t mman_alloc_count, mman_dealloc_count;
+/**
+ * @brief Allocation statistics of a single thread, only ever written by it's
+ * own thread, so allocating threads never share a counter
+ */
+typedef struct mman_stats
+{
+  volatile size_t alloc_count;
+  volatile size_t dealloc_count;
+  struct mman_stats *prev;
+  struct mman_stats *next;
+} mman_stats_t;
+
+// Statistics of the current thread, registered on first use
+static __thread mman_stats_t mman_local_stats;
+static __thread bool mman_local_stats_registered = false;
+
+// Statistics of all running threads, summed up on demand, along with the
+// sums of all threads which exited, only touched when threads come and go
+static mman_stats_t *mman_all_stats = NULL;
+static size_t mman_exited_alloc_count, mman_exited_dealloc_count;
+static pthread_mutex_t mman_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Unregisters a thread's statistics as it exits
+static pthread_key_t mman_stats_key;
+static pthread_once_t mman_stats_once = PTHREAD_ONCE_INIT;
+
+/*
+============================================================================
+                                 Statistics                                 
+============================================================================
+*/
+
+/**
+ * @brief Fold an exiting thread's statistics into the sums of all exited threads
+ */
+static void mman_stats_unregister(void *stats_ptr)
+{
+  mman_stats_t *stats = (mman_stats_t *) stats_ptr;
+
+  pthread_mutex_lock(&mman_stats_lock);
+  mman_exited_alloc_count += stats->alloc_count;
+  mman_exited_dealloc_count += stats->dealloc_count;
+  if (stats->prev) stats->prev->next = stats->next;
+  else mman_all_stats = stats->next;
+  if (stats->next) stats->next->prev = stats->prev;
+  pthread_mutex_unlock(&mman_stats_lock);
+
+  // Allocations by later destructors register the thread once more
+  stats->alloc_count = 0;
+  stats->dealloc_count = 0;
+  mman_local_stats_registered = false;
+}
+
+static void mman_stats_key_make()
+{
+  pthread_key_create(&mman_stats_key, mman_stats_unregister);
+}
+
+/**
+ * @brief Get the current thread's statistics, registering them on first use
+ */
+INLINED static mman_stats_t *mman_stats_local()
+{
+  if (mman_local_stats_registered) return &mman_local_stats;
+
+  pthread_once(&mman_stats_once, mman_stats_key_make);
+
+  pthread_mutex_lock(&mman_stats_lock);
+  mman_local_stats.prev = NULL;
+  mman_local_stats.next = mman_all_stats;
+  if (mman_all_stats) mman_all_stats->prev = &mman_local_stats;
+  mman_all_stats = &mman_local_stats;
+  pthread_mutex_unlock(&mman_stats_lock);
+
+  pthread_setspecific(mman_stats_key, &mman_local_stats);
+  mman_local_stats_registered = true;
+  return &mman_local_stats;
+}
 
 /*
 ============================================================================
@@ -45,6 +122,7 @@ INLINED static mman_meta_t *mman_create(size_t block_size, size_t num_blocks, mm
     sizeof(mman_meta_t) // Meta information
     + (block_size * num_blocks) // Data blocks
   );
+  if (!meta) return NULL;
 
   *meta = (mman_meta_t) {
     .ptr = meta + 1,
@@ -60,10 +138,11 @@ INLINED static mman_meta_t *mman_create(size_t block_size, size_t num_blocks, mm
 void *mman_alloc(size_t block_size, size_t num_blocks, mman_cleanup_f_t cf)
 {
   // INFO: Increment the allocation count for debugging purposes
-  atomic_increment(&mman_alloc_count);
+  mman_stats_local()->alloc_count++;
 
   // Create new meta-info and return a pointer to the data block
-  return mman_create(block_size, num_blocks, cf)->ptr;
+  mman_meta_t *meta = mman_create(block_size, num_blocks, cf);
+  return meta ? meta->ptr : NULL;
 }
 
 mman_meta_t *mman_realloc(void **ptr_ptr, size_t block_size, size_t num_blocks)
@@ -124,7 +203,7 @@ void mman_dealloc(void *ptr)
 
   if (mman_dealloc_direct(meta))
     // INFO: Increment the deallocation count for debugging purposes
-    atomic_increment(&mman_dealloc_count);
+    mman_stats_local()->dealloc_count++;
 }
 
 void mman_attr_dealloc(void *ptr_ptr)
@@ -163,8 +242,19 @@ void *mman_ref(void *ptr)
 
 void mman_print_info()
 {
+  // Counters of running threads are read while they may still change
+  pthread_mutex_lock(&mman_stats_lock);
+  size_t alloc_count = mman_exited_alloc_count;
+  size_t dealloc_count = mman_exited_dealloc_count;
+  for (mman_stats_t *stats = mman_all_stats; stats; stats = stats->next)
+  {
+    alloc_count += stats->alloc_count;
+    dealloc_count += stats->dealloc_count;
+  }
+  pthread_mutex_unlock(&mman_stats_lock);
+
   printf("----------< MMAN Statistics >----------\n");
-  printf("> Allocated: %lu\n", mman_alloc_count);
-  printf("> Deallocated: %lu\n", mman_alloc_count);
+  printf("> Allocated: %lu\n", alloc_count);
+  printf("> Deallocated: %lu\n", dealloc_count);
   printf("----------< MMAN Statistics >----------\n");
 }
\ No newline at end of file
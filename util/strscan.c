@@ -0,0 +1,170 @@
+#include "util/strscan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define STRSCAN_X86
+#include <immintrin.h>
+#endif
+
+typedef char *(*strscan_kernel_t)(char *data, size_t len, const strscan_set_t *set);
+typedef size_t (*strscan_ascii_kernel_t)(char *data, size_t len);
+
+/*
+============================================================================
+                                  Kernels                                   
+============================================================================
+*/
+
+static char *strscan_scalar(char *data, size_t len, const strscan_set_t *set)
+{
+  for (size_t i = 0; i < len; i++)
+    for (size_t j = 0; j < set->num_delims; j++)
+      if (data[i] == set->delims[j]) return &data[i];
+
+  return NULL;
+}
+
+static size_t strscan_ascii_scalar(char *data, size_t len)
+{
+  for (size_t i = 0; i < len; i++)
+    if (data[i] & 0x80) return i;
+
+  return len;
+}
+
+#ifdef STRSCAN_X86
+
+__attribute__((target("sse2")))
+static size_t strscan_ascii_sse2(char *data, size_t len)
+{
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16)
+  {
+    // The sign bits are exactly the non-ASCII bytes
+    int mask = _mm_movemask_epi8(_mm_loadu_si128((__m128i *) &data[i]));
+    if (mask) return i + __builtin_ctz(mask);
+  }
+
+  return i + strscan_ascii_scalar(&data[i], len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t strscan_ascii_avx2(char *data, size_t len)
+{
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32)
+  {
+    // The sign bits are exactly the non-ASCII bytes
+    unsigned int mask = (unsigned int) _mm256_movemask_epi8(_mm256_loadu_si256((__m256i *) &data[i]));
+    if (mask) return i + __builtin_ctz(mask);
+  }
+
+  return i + strscan_ascii_sse2(&data[i], len - i);
+}
+
+__attribute__((target("sse2")))
+static char *strscan_sse2(char *data, size_t len, const strscan_set_t *set)
+{
+  // Broadcast every delimiter into it's own vector once
+  __m128i delims[STRSCAN_MAX_DELIMS];
+  for (size_t j = 0; j < set->num_delims; j++)
+    delims[j] = _mm_set1_epi8(set->delims[j]);
+
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16)
+  {
+    __m128i block = _mm_loadu_si128((__m128i *) &data[i]);
+
+    // Mark all bytes matching any of the delimiters
+    __m128i hits = _mm_setzero_si128();
+    for (size_t j = 0; j < set->num_delims; j++)
+      hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, delims[j]));
+
+    int mask = _mm_movemask_epi8(hits);
+    if (mask) return &data[i + __builtin_ctz(mask)];
+  }
+
+  // Scan the tail that doesn't fill a whole vector
+  return strscan_scalar(&data[i], len - i, set);
+}
+
+__attribute__((target("avx2")))
+static char *strscan_avx2(char *data, size_t len, const strscan_set_t *set)
+{
+  // Broadcast every delimiter into it's own vector once
+  __m256i delims[STRSCAN_MAX_DELIMS];
+  for (size_t j = 0; j < set->num_delims; j++)
+    delims[j] = _mm256_set1_epi8(set->delims[j]);
+
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32)
+  {
+    __m256i block = _mm256_loadu_si256((__m256i *) &data[i]);
+
+    // Mark all bytes matching any of the delimiters
+    __m256i hits = _mm256_setzero_si256();
+    for (size_t j = 0; j < set->num_delims; j++)
+      hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, delims[j]));
+
+    unsigned int mask = (unsigned int) _mm256_movemask_epi8(hits);
+    if (mask) return &data[i + __builtin_ctz(mask)];
+  }
+
+  // Less than a full AVX2 vector left, hand it to the SSE2 kernel
+  return strscan_sse2(&data[i], len - i, set);
+}
+
+#endif
+
+/*
+============================================================================
+                                  Dispatch                                  
+============================================================================
+*/
+
+static strscan_kernel_t strscan_kernel = NULL;
+static strscan_ascii_kernel_t strscan_ascii_kernel = NULL;
+static const char *strscan_kernel_str = "scalar";
+
+/**
+ * @brief Pick the widest kernel the CPU supports, runs before main
+ */
+__attribute__((constructor))
+static void strscan_dispatch()
+{
+  strscan_kernel = strscan_scalar;
+  strscan_ascii_kernel = strscan_ascii_scalar;
+  strscan_kernel_str = "scalar";
+
+#ifdef STRSCAN_X86
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2"))
+  {
+    strscan_kernel = strscan_avx2;
+    strscan_ascii_kernel = strscan_ascii_avx2;
+    strscan_kernel_str = "avx2";
+  }
+
+  else if (__builtin_cpu_supports("sse2"))
+  {
+    strscan_kernel = strscan_sse2;
+    strscan_ascii_kernel = strscan_ascii_sse2;
+    strscan_kernel_str = "sse2";
+  }
+#endif
+}
+
+char *strscan_find(char *data, size_t len, const strscan_set_t *set)
+{
+  return strscan_kernel(data, len, set);
+}
+
+size_t strscan_ascii(char *data, size_t len)
+{
+  return strscan_ascii_kernel(data, len);
+}
+
+const char *strscan_kernel_name()
+{
+  return strscan_kernel_str;
+}
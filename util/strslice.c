@@ -0,0 +1,70 @@
+#include "util/strslice.h"
+
+strslice_t strslice_make(char *ptr, size_t len)
+{
+  return (strslice_t) { .ptr = ptr, .len = len };
+}
+
+bool strslice_eq(strslice_t slice, const char *str)
+{
+  return strlen(str) == slice.len && memcmp(slice.ptr, str, slice.len) == 0;
+}
+
+bool strslice_eq_ci(strslice_t slice, const char *str)
+{
+  return strlen(str) == slice.len && strncasecmp(slice.ptr, str, slice.len) == 0;
+}
+
+bool strslice_has_token_ci(strslice_t slice, const char *token)
+{
+  size_t offs = 0;
+  while (offs < slice.len)
+  {
+    // Skip leading whitespace and separators
+    while (offs < slice.len && (slice.ptr[offs] == ' ' || slice.ptr[offs] == '\t' || slice.ptr[offs] == ','))
+      offs++;
+
+    // Cut the token up to the next separator, without trailing whitespace
+    size_t start = offs;
+    while (offs < slice.len && slice.ptr[offs] != ',') offs++;
+    size_t end = offs;
+    while (end > start && (slice.ptr[end - 1] == ' ' || slice.ptr[end - 1] == '\t')) end--;
+
+    if (end > start && strslice_eq_ci(strslice_make(&slice.ptr[start], end - start), token))
+      return true;
+  }
+
+  return false;
+}
+
+bool strslice_ulong(strslice_t slice, unsigned long *out)
+{
+  if (slice.len == 0) return false;
+
+  unsigned long res = 0;
+  for (size_t i = 0; i < slice.len; i++)
+  {
+    char c = slice.ptr[i];
+    if (c < '0' || c > '9') return false;
+
+    // Would overflow
+    if (res > (ULONG_MAX - (c - '0')) / 10) return false;
+    res = res * 10 + (c - '0');
+  }
+
+  *out = res;
+  return true;
+}
+
+void strslice_rebase(strslice_t *slice, char *old_base, char *new_base)
+{
+  if (slice->ptr) slice->ptr = new_base + (slice->ptr - old_base);
+}
+
+char *strslice_dup(strslice_t slice)
+{
+  char *res = mman_alloc(sizeof(char), slice.len + 1, NULL);
+  memcpy(res, slice.ptr, slice.len);
+  res[slice.len] = 0;
+  return res;
+}
@@ -0,0 +1,101 @@
+#include "util/urlcodec.h"
+
+// Characters starting an encoded octet
+static const strscan_set_t urlcodec_delim_pct = STRSCAN_SET("%");
+static const strscan_set_t urlcodec_delim_pct_plus = STRSCAN_SET("%+");
+
+/**
+ * @brief Get the value of a hexadecimal digit
+ * 
+ * @return int Value of the digit, -1 if it's not a hexadecimal digit
+ */
+INLINED static int urlcodec_hex(char c)
+{
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+bool urlcodec_decode(strslice_t *slice, bool plus_as_space)
+{
+  const strscan_set_t *delims = plus_as_space ? &urlcodec_delim_pct_plus : &urlcodec_delim_pct;
+  char *read = slice->ptr, *write = slice->ptr;
+  char *end = slice->ptr + slice->len;
+
+  while (read < end)
+  {
+    // Move the whole run up to the next escape at once
+    char *esc = strscan_find(read, end - read, delims);
+    size_t run = (esc ? esc : end) - read;
+    if (write != read) memmove(write, read, run);
+    write += run;
+    read += run;
+    if (!esc) break;
+
+    if (*read == '+')
+    {
+      *write++ = ' ';
+      read++;
+      continue;
+    }
+
+    // Percent followed by two hexadecimal digits
+    int hi, lo;
+    if (end - read < 3 || (hi = urlcodec_hex(read[1])) < 0 || (lo = urlcodec_hex(read[2])) < 0)
+    {
+      slice->len = write - slice->ptr;
+      return false;
+    }
+
+    *write++ = (char) ((hi << 4) | lo);
+    read += 3;
+  }
+
+  slice->len = write - slice->ptr;
+  return true;
+}
+
+bool urlcodec_utf8_valid(strslice_t slice)
+{
+  unsigned char *data = (unsigned char *) slice.ptr;
+  size_t i = 0;
+
+  while (i < slice.len)
+  {
+    // Skip ASCII runs vectorized
+    i += strscan_ascii(&slice.ptr[i], slice.len - i);
+    if (i == slice.len) break;
+
+    // Length and lower bound of the second byte are decided by the lead byte
+    unsigned char lead = data[i];
+    size_t seq_len;
+    unsigned char min = 0x80, max = 0xBF;
+
+    if (lead >= 0xC2 && lead <= 0xDF) seq_len = 2;
+    else if (lead >= 0xE0 && lead <= 0xEF)
+    {
+      seq_len = 3;
+      if (lead == 0xE0) min = 0xA0; // Overlong
+      if (lead == 0xED) max = 0x9F; // Surrogates
+    }
+    else if (lead >= 0xF0 && lead <= 0xF4)
+    {
+      seq_len = 4;
+      if (lead == 0xF0) min = 0x90; // Overlong
+      if (lead == 0xF4) max = 0x8F; // Beyond U+10FFFF
+    }
+    else return false;
+
+    if (slice.len - i < seq_len) return false;
+    if (data[i + 1] < min || data[i + 1] > max) return false;
+
+    // All further bytes are plain continuation bytes
+    for (size_t j = 2; j < seq_len; j++)
+      if ((data[i + j] & 0xC0) != 0x80) return false;
+
+    i += seq_len;
+  }
+
+  return true;
+}